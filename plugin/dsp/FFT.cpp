@@ -0,0 +1,147 @@
+//
+//  FFT.cpp
+//
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "FFT.h"
+
+bool dsp::fft::IsPowerOfTwo(const size_t n)
+{
+  return n > 0 && (n & (n - 1)) == 0;
+}
+
+size_t dsp::fft::NextPowerOfTwo(const size_t n)
+{
+  size_t p = 1;
+  while (p < n)
+    p <<= 1;
+  return p;
+}
+
+dsp::fft::RealFFT::RealFFT(const size_t size)
+: mSize(size)
+, mHalfSize(size / 2)
+{
+  if (size < 4 || !IsPowerOfTwo(size))
+  {
+    std::stringstream ss;
+    ss << "FFT size must be a power of two and at least 4; got " << size;
+    throw std::runtime_error(ss.str());
+  }
+  const double pi = 3.14159265358979323846;
+
+  size_t numBits = 0;
+  while (((size_t)1 << numBits) < this->mHalfSize)
+    numBits++;
+  this->mBitReverse.resize(this->mHalfSize);
+  for (size_t i = 0; i < this->mHalfSize; i++)
+  {
+    size_t reversed = 0;
+    for (size_t b = 0; b < numBits; b++)
+      if (i & ((size_t)1 << b))
+        reversed |= (size_t)1 << (numBits - 1 - b);
+    this->mBitReverse[i] = reversed;
+  }
+
+  this->mTwiddles.resize(this->mHalfSize / 2);
+  for (size_t k = 0; k < this->mTwiddles.size(); k++)
+  {
+    const double angle = -2.0 * pi * (double)k / (double)this->mHalfSize;
+    this->mTwiddles[k] = std::complex<float>((float)std::cos(angle), (float)std::sin(angle));
+  }
+  this->mSplitTwiddles.resize(this->mHalfSize);
+  for (size_t k = 0; k < this->mSplitTwiddles.size(); k++)
+  {
+    const double angle = -2.0 * pi * (double)k / (double)this->mSize;
+    this->mSplitTwiddles[k] = std::complex<float>((float)std::cos(angle), (float)std::sin(angle));
+  }
+  this->mScratch.resize(this->mHalfSize);
+}
+
+void dsp::fft::RealFFT::Forward(const float* input, float* outputReal, float* outputImag)
+{
+  const size_t half = this->mHalfSize;
+  // Pack even samples into the real part and odd samples into the imaginary
+  // part, in bit-reversed order, ready for the in-place transform.
+  for (size_t i = 0; i < half; i++)
+    this->mScratch[this->mBitReverse[i]] = std::complex<float>(input[2 * i], input[2 * i + 1]);
+  this->_ComplexTransform(false);
+
+  // Untangle: X[k] = E[k] + W^k O[k], where
+  // E[k] = (Z[k] + conj(Z[M-k])) / 2 and O[k] = (Z[k] - conj(Z[M-k])) / 2i
+  const std::complex<float>* z = this->mScratch.data();
+  outputReal[0] = z[0].real() + z[0].imag();
+  outputImag[0] = 0.0f;
+  outputReal[half] = z[0].real() - z[0].imag();
+  outputImag[half] = 0.0f;
+  for (size_t k = 1; k < half; k++)
+  {
+    const float zr = z[k].real(), zi = z[k].imag();
+    const float cr = z[half - k].real(), ci = -z[half - k].imag(); // conj(Z[M-k])
+    const float er = 0.5f * (zr + cr), ei = 0.5f * (zi + ci);
+    // (Z - conj) / 2i = (b - i a) / 2 for (a + ib)
+    const float dr = zr - cr, di = zi - ci;
+    const float orr = 0.5f * di, oi = -0.5f * dr;
+    const float wr = this->mSplitTwiddles[k].real(), wi = this->mSplitTwiddles[k].imag();
+    outputReal[k] = er + (wr * orr - wi * oi);
+    outputImag[k] = ei + (wr * oi + wi * orr);
+  }
+}
+
+void dsp::fft::RealFFT::Inverse(const float* inputReal, const float* inputImag, float* output)
+{
+  const size_t half = this->mHalfSize;
+  // Re-tangle: Z[k] = (X[k] + conj(X[M-k])) + i (X[k] - conj(X[M-k])) conj(W^k)
+  // (the factor of 1/2 is folded into the final normalization)
+  for (size_t k = 0; k < half; k++)
+  {
+    const float xr = inputReal[k], xi = inputImag[k];
+    const float cr = inputReal[half - k], ci = -inputImag[half - k];
+    const float er = xr + cr, ei = xi + ci;
+    const float dr = xr - cr, di = xi - ci;
+    const float wr = this->mSplitTwiddles[k].real(), wi = -this->mSplitTwiddles[k].imag();
+    const float orr = dr * wr - di * wi, oi = dr * wi + di * wr;
+    // E + i O
+    this->mScratch[this->mBitReverse[k]] = std::complex<float>(er - oi, ei + orr);
+  }
+  this->_ComplexTransform(true);
+
+  const float scale = 1.0f / (float)this->mSize;
+  for (size_t i = 0; i < half; i++)
+  {
+    output[2 * i] = scale * this->mScratch[i].real();
+    output[2 * i + 1] = scale * this->mScratch[i].imag();
+  }
+}
+
+void dsp::fft::RealFFT::_ComplexTransform(const bool inverse)
+{
+  // Iterative decimation-in-time. Input is expected in bit-reversed order.
+  const size_t n = this->mHalfSize;
+  float* data = reinterpret_cast<float*>(this->mScratch.data());
+  const float sign = inverse ? -1.0f : 1.0f;
+  for (size_t length = 2; length <= n; length <<= 1)
+  {
+    const size_t halfLength = length / 2;
+    const size_t twiddleStride = n / length;
+    for (size_t start = 0; start < n; start += length)
+    {
+      for (size_t j = 0; j < halfLength; j++)
+      {
+        const std::complex<float>& w = this->mTwiddles[j * twiddleStride];
+        const float wr = w.real(), wi = sign * w.imag();
+        float* a = data + 2 * (start + j);
+        float* b = data + 2 * (start + j + halfLength);
+        const float tr = wr * b[0] - wi * b[1];
+        const float ti = wr * b[1] + wi * b[0];
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
+      }
+    }
+  }
+}
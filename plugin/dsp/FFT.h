@@ -0,0 +1,59 @@
+//
+//  FFT.h
+//
+// Real-input FFT used by the frequency-domain convolution code.
+// Spectra are kept in split (real, imaginary) form so that the complex
+// multiply-accumulates in the convolvers vectorize cleanly.
+
+#pragma once
+
+#include <complex>
+#include <vector>
+
+namespace dsp
+{
+namespace fft
+{
+// Returns true if n is a power of two (and non-zero).
+bool IsPowerOfTwo(const size_t n);
+// Smallest power of two that is >= n.
+size_t NextPowerOfTwo(const size_t n);
+
+// Radix-2 FFT of real-valued signals of a fixed (power-of-two) size.
+// Internally this runs a complex FFT of half the size on the even/odd samples
+// and untangles the result, so a size-N transform costs about as much as a
+// complex transform of size N/2.
+// All memory is allocated in the constructor; Forward() and Inverse() don't
+// allocate and are safe to call on the audio thread.
+class RealFFT
+{
+public:
+  // :param size: Number of real samples. Must be a power of two >= 4.
+  RealFFT(const size_t size);
+
+  size_t GetSize() const { return this->mSize; };
+  // Number of non-redundant complex bins (size / 2 + 1).
+  size_t GetNumBins() const { return this->mHalfSize + 1; };
+
+  // Transform GetSize() real samples into GetNumBins() complex bins.
+  void Forward(const float* input, float* outputReal, float* outputImag);
+  // Inverse of Forward(), including the 1/N normalization, so that
+  // Inverse(Forward(x)) == x.
+  void Inverse(const float* inputReal, const float* inputImag, float* output);
+
+private:
+  // In-place complex FFT of size mHalfSize on mScratch.
+  // Unnormalized in both directions.
+  void _ComplexTransform(const bool inverse);
+
+  size_t mSize;
+  size_t mHalfSize;
+  std::vector<size_t> mBitReverse;
+  // exp(-2*pi*i*k/mHalfSize) for the half-size complex transform
+  std::vector<std::complex<float>> mTwiddles;
+  // exp(-2*pi*i*k/mSize) for splitting the packed real transform
+  std::vector<std::complex<float>> mSplitTwiddles;
+  std::vector<std::complex<float>> mScratch;
+};
+}; // namespace fft
+}; // namespace dsp
@@ -10,83 +10,236 @@
 
 #include "ImpulseResponse.h"
 
-dsp::ImpulseResponse::ImpulseResponse(const char* fileName, const double sampleRate)
+template <typename T>
+dsp::ImpulseResponse<T>::ImpulseResponse(const char* fileName, const double sampleRate, const ConvolutionMode mode,
+                                         const IRTrimParams& trimParams)
 : mWavState(dsp::wav::LoadReturnCode::ERROR_OTHER)
 , mSampleRate(sampleRate)
+, mMode(mode)
+, mTrimParams(trimParams)
 {
   // Try to load the WAV
-  this->mWavState = dsp::wav::Load(fileName, this->mRawAudio, this->mRawAudioSampleRate);
+  auto irData = std::make_shared<IRData>();
+  this->mWavState = dsp::wav::Load(fileName, irData->mRawAudio, irData->mRawAudioSampleRate);
   if (this->mWavState != dsp::wav::LoadReturnCode::SUCCESS)
   {
     std::stringstream ss;
     ss << "Failed to load IR at " << fileName << std::endl;
   }
   else
+  {
+    this->mSource = MakeSource(irData);
     // Set the weights based on the raw audio.
     this->_SetWeights();
+  }
 }
 
-dsp::ImpulseResponse::ImpulseResponse(const IRData& irData, const double sampleRate)
+template <typename T>
+dsp::ImpulseResponse<T>::ImpulseResponse(const IRData& irData, const double sampleRate, const ConvolutionMode mode,
+                                         const IRTrimParams& trimParams)
 : mWavState(dsp::wav::LoadReturnCode::SUCCESS)
 , mSampleRate(sampleRate)
+, mMode(mode)
+, mTrimParams(trimParams)
 {
-  this->mRawAudio = irData.mRawAudio;
-  this->mRawAudioSampleRate = irData.mRawAudioSampleRate;
+  this->mSource = MakeSource(std::make_shared<const IRData>(irData));
   this->_SetWeights();
 }
 
-double** dsp::ImpulseResponse::Process(double** inputs, const size_t numChannels, const size_t numFrames)
+template <typename T>
+dsp::ImpulseResponse<T>::ImpulseResponse(const IRSource& source, const double sampleRate, const ConvolutionMode mode,
+                                         const IRTrimParams& trimParams)
+: mWavState(dsp::wav::LoadReturnCode::SUCCESS)
+, mSource(source)
+, mSampleRate(sampleRate)
+, mMode(mode)
+, mTrimParams(trimParams)
+{
+  this->_SetWeights();
+}
+
+template <typename T>
+T** dsp::ImpulseResponse<T>::Process(T** inputs, const size_t numChannels, const size_t numFrames)
 {
   this->_PrepareBuffers(numChannels, numFrames);
+  T** outputs = this->_GetPointers();
+  this->_Process(inputs, outputs, numChannels, numFrames);
+  return outputs;
+}
+
+template <typename T>
+void dsp::ImpulseResponse<T>::ProcessInPlace(T* const* buffers, const size_t numChannels, const size_t numFrames)
+{
+  this->_Process(buffers, buffers, numChannels, numFrames);
+}
+
+template <typename T>
+void dsp::ImpulseResponse<T>::_Process(const T* const* inputs, T* const* outputs, const size_t numChannels,
+                                       const size_t numFrames)
+{
   this->_UpdateHistory(inputs, numChannels, numFrames);
 
   for (size_t i = 0, j = this->mHistoryIndex - this->mHistoryRequired; i < numFrames; i++, j++)
   {
     auto input = Eigen::Map<const Eigen::VectorXf>(&this->mHistory[j], this->mHistoryRequired + 1);
-    this->mOutputs[0][i] = (double)this->mWeight.dot(input);
+    outputs[0][i] = (T)this->mWeight.dot(input);
+  }
+  if (this->mTail != nullptr)
+  {
+    // The new input is already sitting in the history as floats.
+    const float* tailInput = &this->mHistory[this->mHistoryIndex];
+    for (size_t done = 0; done < numFrames;)
+    {
+      const size_t count = std::min(numFrames - done, this->mTailOutput.size());
+      this->mTail->Process(tailInput + done, this->mTailOutput.data(), count);
+      for (size_t i = 0; i < count; i++)
+        outputs[0][done + i] += (T)this->mTailOutput[i];
+      done += count;
+    }
   }
   // Copy out for more-than-mono.
   for (size_t c = 1; c < numChannels; c++)
     for (size_t i = 0; i < numFrames; i++)
-      this->mOutputs[c][i] = this->mOutputs[0][i];
+      outputs[c][i] = outputs[0][i];
 
   this->_AdvanceHistoryIndex(numFrames);
-  return this->_GetPointers();
 }
 
-void dsp::ImpulseResponse::_SetWeights()
+template <typename T>
+size_t dsp::ImpulseResponse<T>::_GetMaxHistoryRequired() const
 {
-  if (this->mRawAudioSampleRate == mSampleRate)
+  return (this->mMode == ConvolutionMode::PARTITIONED ? this->mPartitionSize : this->mMaxLength) - 1;
+}
+
+template <typename T>
+void dsp::ImpulseResponse<T>::_SetWeights()
+{
+  // The source as it is if it's at the right rate; otherwise resampled, just
+  // for as long as it takes to set the weights.
+  std::vector<float> resampled;
+  const float* ir = this->mSource.mSamples;
+  size_t length = this->mSource.mNumSamples;
+  if (this->mSource.mSampleRate != mSampleRate)
   {
-    this->mResampled.resize(this->mRawAudio.size());
-    memcpy(this->mResampled.data(), this->mRawAudio.data(), sizeof(float) * this->mResampled.size());
+    resampled = Resample(this->mSource, mSampleRate).mRawAudio;
+    ir = resampled.data();
+    length = resampled.size();
+  }
+  // Keep a (silent) tap if there's nothing to convolve
+  static const float silence = 0.0f;
+  if (length == 0)
+  {
+    ir = &silence;
+    length = 1;
+  }
+  this->mUntrimmedLength = length;
+  const size_t trimmedLength = this->_GetTrimmedLength(ir, length);
+  const size_t maxLength = this->mMode == ConvolutionMode::PARTITIONED
+                             ? (size_t)(this->mMaxLengthSeconds * this->mSampleRate)
+                             : this->mMaxLength;
+  const size_t irLength = std::min(trimmedLength, maxLength);
+  const bool partitioned = this->mMode == ConvolutionMode::PARTITIONED && irLength > this->mPartitionSize;
+  const size_t headLength = partitioned ? this->mPartitionSize : irLength;
+  this->mNumTaps = irLength;
+
+  // Gain reduction.
+  // https://github.com/sdatkinson/NeuralAmpModelerPlugin/issues/100#issuecomment-1455273839
+  // Add sample rate-dependence
+  const float gain = pow(10, -18 * 0.05) * 48000 / mSampleRate;
+  std::vector<float> scaled(irLength);
+  for (size_t i = 0; i < irLength; i++)
+    scaled[i] = gain * ir[i];
+  // Fade out if it was trimmed (raised cosine)
+  if (irLength < length && this->mTrimParams.mTrimTail)
+  {
+    const size_t fadeLength = std::min(this->mFadeLength, irLength);
+    for (size_t i = 0; i < fadeLength; i++)
+      scaled[irLength - 1 - i] *= 0.5f - 0.5f * std::cos((float)M_PI * (i + 1) / (fadeLength + 1));
+  }
+
+  this->mWeight.resize(headLength);
+  for (size_t i = 0, j = headLength - 1; i < headLength; i++, j--)
+    this->mWeight[j] = scaled[i];
+  this->mHistoryRequired = headLength - 1;
+
+  if (partitioned)
+  {
+    // The convolver skips the head taps itself, so hand it the whole IR.
+    this->mTail = std::make_unique<convolution::NonUniformPartitioned>(this->mPartitionSize);
+    this->mTail->SetImpulseResponse(scaled.data(), scaled.size());
+    this->mTailOutput.resize(this->mPartitionSize);
   }
   else
+  {
+    this->mTail.reset();
+    this->mTailOutput.clear();
+  }
+}
+
+template <typename T>
+size_t dsp::ImpulseResponse<T>::_GetTrimmedLength(const float* ir, const size_t length) const
+{
+  if (!this->mTrimParams.mTrimTail)
+    return length;
+  const double threshold = pow(10.0, this->mTrimParams.mThresholdDB / 10.0);
+  double total = 0.0;
+  for (size_t i = 0; i < length; i++)
+    total += (double)ir[i] * ir[i];
+  // Energy decay: walk back until the energy after the cut would be over the
+  // threshold
+  size_t end = length;
+  double remaining = 0.0;
+  while (end > 1)
+  {
+    remaining += (double)ir[end - 1] * ir[end - 1];
+    if (remaining > threshold * total)
+      break;
+    end--;
+  }
+  return end;
+}
+
+template <typename T>
+typename dsp::ImpulseResponse<T>::IRData dsp::ImpulseResponse<T>::Resample(const IRSource& source,
+                                                                         const double sampleRate)
+{
+  IRData resampled;
+  resampled.mRawAudioSampleRate = sampleRate;
+  if (source.mSampleRate == sampleRate)
+    resampled.mRawAudio.assign(source.mSamples, source.mSamples + source.mNumSamples);
+  else
   {
     // Cubic resampling
     std::vector<float> padded;
-    padded.resize(this->mRawAudio.size() + 2);
+    padded.resize(source.mNumSamples + 2);
     padded[0] = 0.0f;
     padded[padded.size() - 1] = 0.0f;
-    memcpy(padded.data() + 1, this->mRawAudio.data(), sizeof(float) * this->mRawAudio.size());
-    dsp::ResampleCubic<float>(padded, this->mRawAudioSampleRate, mSampleRate, 0.0, this->mResampled);
+    if (source.mNumSamples > 0)
+      memcpy(padded.data() + 1, source.mSamples, sizeof(float) * source.mNumSamples);
+    dsp::ResampleCubic<float>(padded, source.mSampleRate, sampleRate, 0.0, resampled.mRawAudio);
   }
-  // Simple implementation w/ no resample...
-  const size_t irLength = std::min(this->mResampled.size(), this->mMaxLength);
-  this->mWeight.resize(irLength);
-  // Gain reduction.
-  // https://github.com/sdatkinson/NeuralAmpModelerPlugin/issues/100#issuecomment-1455273839
-  // Add sample rate-dependence
-  const float gain = pow(10, -18 * 0.05) * 48000 / mSampleRate;
-  for (size_t i = 0, j = irLength - 1; i < irLength; i++, j--)
-    this->mWeight[j] = gain * this->mResampled[i];
-  this->mHistoryRequired = irLength - 1;
+  return resampled;
+}
+
+template <typename T>
+dsp::IRSource dsp::ImpulseResponse<T>::MakeSource(std::shared_ptr<const IRData> irData)
+{
+  IRSource source;
+  source.mSamples = irData->mRawAudio.data();
+  source.mNumSamples = irData->mRawAudio.size();
+  source.mSampleRate = irData->mRawAudioSampleRate;
+  source.mOwner = std::move(irData);
+  return source;
 }
 
-dsp::ImpulseResponse::IRData dsp::ImpulseResponse::GetData()
+template <typename T>
+typename dsp::ImpulseResponse<T>::IRData dsp::ImpulseResponse<T>::GetData()
 {
   IRData irData;
-  irData.mRawAudio = this->mRawAudio;
-  irData.mRawAudioSampleRate = this->mRawAudioSampleRate;
+  irData.mRawAudio.assign(this->mSource.mSamples, this->mSource.mSamples + this->mSource.mNumSamples);
+  irData.mRawAudioSampleRate = this->mSource.mSampleRate;
   return irData;
 }
+
+template class dsp::ImpulseResponse<float>;
+template class dsp::ImpulseResponse<double>;
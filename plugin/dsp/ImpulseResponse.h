@@ -9,46 +9,136 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
 
 #include <Eigen/Dense>
 
 #include "dsp.h"
+#include "PartitionedConvolution.h"
 #include "wav.h"
 
 namespace dsp
 {
-class ImpulseResponse : public History
+// How much of an IR is convolved. By default, all of it. With mTrimTail, the
+// tail is cut where the energy left in it falls below mThresholdDB of the
+// IR's total (with a short fade), so that long stretches of near-silence cost
+// nothing. The start is never cut: any pre-delay is part of the sound.
+struct IRTrimParams
+{
+  bool mTrimTail = false;
+  double mThresholdDB = -80.0;
+};
+
+// The audio an IR is made from, viewed rather than copied: it's either static
+// (e.g. embedded in the binary) or kept alive by mOwner, which every IR made
+// from it shares.
+struct IRSource
+{
+  const float* mSamples = nullptr;
+  size_t mNumSamples = 0;
+  double mSampleRate = 0.0;
+  std::shared_ptr<const void> mOwner;
+};
+
+template <typename T = DSP_SAMPLE>
+class ImpulseResponse : public History<T>
 {
 public:
   struct IRData;
-  ImpulseResponse(const char* fileName, const double sampleRate);
-  ImpulseResponse(const IRData& irData, const double sampleRate);
-  double** Process(double** inputs, const size_t numChannels, const size_t numFrames) override;
+  // How the convolution is computed.
+  // DIRECT: time-domain dot product over every tap for every sample.
+  // PARTITIONED: the first partition is convolved directly (so there's no
+  //   added latency) and the rest of the taps go through non-uniformly
+  //   partitioned FFT convolution. This mode accepts IRs up to
+  //   mMaxLengthSeconds long.
+  // Both give the same output (up to rounding) for IRs within mMaxLength.
+  enum class ConvolutionMode
+  {
+    DIRECT = 0,
+    PARTITIONED
+  };
+  ImpulseResponse(const char* fileName, const double sampleRate,
+                  const ConvolutionMode mode = ConvolutionMode::PARTITIONED,
+                  const IRTrimParams& trimParams = IRTrimParams());
+  ImpulseResponse(const IRData& irData, const double sampleRate,
+                  const ConvolutionMode mode = ConvolutionMode::PARTITIONED,
+                  const IRTrimParams& trimParams = IRTrimParams());
+  // Doesn't copy the source's audio: only what's convolved is allocated.
+  ImpulseResponse(const IRSource& source, const double sampleRate,
+                  const ConvolutionMode mode = ConvolutionMode::PARTITIONED,
+                  const IRTrimParams& trimParams = IRTrimParams());
+  T** Process(T** inputs, const size_t numChannels, const size_t numFrames) override;
+  void ProcessInPlace(T* const* buffers, const size_t numChannels, const size_t numFrames) override;
+  // A copy of the audio the IR was made from
   IRData GetData();
+  // The audio the IR was made from, to make more IRs from without copying it
+  const IRSource& GetSource() const { return mSource; };
+  // A source for audio that's shared by its owners
+  static IRSource MakeSource(std::shared_ptr<const IRData> irData);
+  // The source's audio resampled to sampleRate, as it's convolved at that
+  // rate (an IR made from the result at sampleRate doesn't resample it again).
+  static IRData Resample(const IRSource& source, const double sampleRate);
   double GetSampleRate() const { return mSampleRate; };
+  ConvolutionMode GetConvolutionMode() const { return mMode; };
+  const IRTrimParams& GetTrimParams() const { return mTrimParams; };
+  // Taps that are convolved, after trimming, and the length of the IR at
+  // the sample rate before it (so the difference is the CPU saved).
+  size_t GetNumTaps() const { return mNumTaps; };
+  size_t GetUntrimmedLength() const { return mUntrimmedLength; };
+  // See convolution::NonUniformPartitioned::SetNonRealtime()
+  void SetNonRealtime(const bool nonRealtime)
+  {
+    if (this->mTail != nullptr)
+      this->mTail->SetNonRealtime(nonRealtime);
+  };
   // TODO states for the IR class
   dsp::wav::LoadReturnCode GetWavState() const { return this->mWavState; };
 
+protected:
+  // The longest direct-form part of the mode: mMaxLength taps in DIRECT
+  // mode, the head in PARTITIONED mode
+  size_t _GetMaxHistoryRequired() const override;
+
 private:
+  // Convolve channel 1 of inputs into every channel of outputs (which may be
+  // the inputs: the input is in the history before any output is written).
+  void _Process(const T* const* inputs, T* const* outputs, const size_t numChannels, const size_t numFrames);
   // Set the weights, given that the plugin is running at the provided sample
   // rate.
   void _SetWeights();
+  // Length of the part of the resampled IR that's convolved, per mTrimParams
+  size_t _GetTrimmedLength(const float* ir, const size_t length) const;
 
   // State of audio
   dsp::wav::LoadReturnCode mWavState;
-  // Keep a copy of the raw audio that was loaded so that it can be resampled
-  std::vector<float> mRawAudio;
-  double mRawAudioSampleRate;
-  // Resampled to the required sample rate.
-  std::vector<float> mResampled;
+  // The raw audio, kept (not copied) so that it can be resampled
+  IRSource mSource;
   double mSampleRate;
+  ConvolutionMode mMode;
+  IRTrimParams mTrimParams;
+  size_t mNumTaps = 0;
+  size_t mUntrimmedLength = 0;
 
+  // Longest IR in DIRECT mode, in samples
   const size_t mMaxLength = 8192;
-  // The weights
+  // Longest IR in PARTITIONED mode, in seconds
+  const double mMaxLengthSeconds = 10.0;
+  // Length of the direct-form head (and the smallest FFT partition) in
+  // PARTITIONED mode
+  const size_t mPartitionSize = 128;
+  // Length of the fade at the end of a trimmed IR, in samples
+  const size_t mFadeLength = 64;
+  // The weights of the direct-form part (all of the IR in DIRECT mode, the
+  // head in PARTITIONED mode), time-reversed
   Eigen::VectorXf mWeight;
+  // Zero-latency FFT convolution for the taps after the head
+  std::unique_ptr<convolution::NonUniformPartitioned> mTail;
+  // Scratch for the tail output
+  std::vector<float> mTailOutput;
 };
 
-struct dsp::ImpulseResponse::IRData
+template <typename T>
+struct ImpulseResponse<T>::IRData
 {
   std::vector<float> mRawAudio;
   double mRawAudioSampleRate;
@@ -0,0 +1,61 @@
+//
+//  InstructionSet.cpp
+//
+
+#include "InstructionSet.h"
+#include "SimdTargets.h"
+
+namespace
+{
+#if DSP_KERNELS_X86
+dsp::InstructionSet DetectInstructionSet()
+{
+  using dsp::InstructionSet;
+  #if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  const int maxLeaf = info[0];
+  __cpuid(info, 1);
+  const bool sse41 = (info[2] & (1 << 19)) != 0;
+  const bool fma = (info[2] & (1 << 12)) != 0;
+  // The OS has to save the AVX registers too
+  const bool avx = (info[2] & (1 << 28)) != 0 && (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+  bool avx2 = false;
+  if (maxLeaf >= 7)
+  {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+  }
+  if (avx && avx2 && fma)
+    return InstructionSet::AVX2;
+  return sse41 ? InstructionSet::SSE41 : InstructionSet::SCALAR;
+  #else
+  // Also checks that the OS saves the AVX registers
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return InstructionSet::AVX2;
+  return __builtin_cpu_supports("sse4.1") ? InstructionSet::SSE41 : InstructionSet::SCALAR;
+  #endif
+}
+#endif
+}; // namespace
+
+dsp::InstructionSet dsp::GetInstructionSet()
+{
+#if DSP_KERNELS_X86
+  static const InstructionSet instructionSet = DetectInstructionSet();
+  return instructionSet;
+#else
+  return InstructionSet::SCALAR;
+#endif
+}
+
+const char* dsp::GetName(const InstructionSet instructionSet)
+{
+  switch (instructionSet)
+  {
+    case InstructionSet::SSE41: return "SSE4.1";
+    case InstructionSet::AVX2: return "AVX2/FMA";
+    default: return "scalar";
+  }
+}
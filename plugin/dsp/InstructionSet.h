@@ -0,0 +1,24 @@
+//
+//  InstructionSet.h
+//
+// The x86 instruction sets that the hand-vectorized kernels (see
+// WaveNetKernels.h, ResamplingContainer/LanczosKernels.h) have versions for,
+// and the best one the CPU supports, detected once at run time.
+
+#pragma once
+
+namespace dsp
+{
+enum class InstructionSet
+{
+  SCALAR = 0,
+  SSE41,
+  // AVX2 with FMA
+  AVX2
+};
+
+// Best instruction set that the CPU and OS support. Always SCALAR on other
+// architectures, where the compiler's vectorization is used instead.
+InstructionSet GetInstructionSet();
+const char* GetName(const InstructionSet instructionSet);
+}; // namespace dsp
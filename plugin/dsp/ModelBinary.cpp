@@ -0,0 +1,83 @@
+//
+//  ModelBinary.cpp
+//
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include "ModelBinary.h"
+
+namespace
+{
+const char kMagic[4] = {'Q', 'N', 'A', 'M'};
+}; // namespace
+
+bool dsp::modelbinary::IsModelBinary(const void* data, const size_t size)
+{
+  return data != nullptr && size >= sizeof(Header) && std::memcmp(data, kMagic, sizeof(kMagic)) == 0;
+}
+
+std::vector<uint8_t> dsp::modelbinary::Write(const Model& model)
+{
+  const std::vector<uint8_t> config = nlohmann::json::to_cbor(model.mConfig);
+
+  Header header;
+  std::memcpy(header.mMagic, kMagic, sizeof(kMagic));
+  header.mFormatVersion = kFormatVersion;
+  header.mSampleRate = model.mSampleRate;
+  header.mVersionSize = (uint32_t)model.mVersion.size();
+  header.mArchitectureSize = (uint32_t)model.mArchitecture.size();
+  header.mConfigSize = (uint32_t)config.size();
+  header.mNumWeights = (uint32_t)model.mWeights.size();
+  const size_t stringsEnd = sizeof(Header) + model.mVersion.size() + model.mArchitecture.size() + config.size();
+  header.mWeightsOffset = (uint32_t)(((stringsEnd + kWeightAlignment - 1) / kWeightAlignment) * kWeightAlignment);
+  header.mReserved = 0;
+
+  std::vector<uint8_t> blob(header.mWeightsOffset + model.mWeights.size() * sizeof(float), 0);
+  uint8_t* p = blob.data();
+  std::memcpy(p, &header, sizeof(Header));
+  p += sizeof(Header);
+  std::memcpy(p, model.mVersion.data(), model.mVersion.size());
+  p += model.mVersion.size();
+  std::memcpy(p, model.mArchitecture.data(), model.mArchitecture.size());
+  p += model.mArchitecture.size();
+  std::memcpy(p, config.data(), config.size());
+  if (!model.mWeights.empty())
+    std::memcpy(blob.data() + header.mWeightsOffset, model.mWeights.data(), model.mWeights.size() * sizeof(float));
+  return blob;
+}
+
+dsp::modelbinary::Model dsp::modelbinary::Read(const void* data, const size_t size)
+{
+  if (!IsModelBinary(data, size))
+    throw std::runtime_error("Not a model binary");
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  Header header;
+  std::memcpy(&header, bytes, sizeof(Header));
+  if (header.mFormatVersion != kFormatVersion)
+  {
+    std::stringstream ss;
+    ss << "Unsupported model binary version " << header.mFormatVersion << " (expected " << kFormatVersion << ")";
+    throw std::runtime_error(ss.str());
+  }
+  const size_t stringsEnd =
+    sizeof(Header) + (size_t)header.mVersionSize + (size_t)header.mArchitectureSize + (size_t)header.mConfigSize;
+  if (stringsEnd > header.mWeightsOffset
+      || (size_t)header.mWeightsOffset + (size_t)header.mNumWeights * sizeof(float) > size)
+    throw std::runtime_error("Model binary is truncated");
+
+  Model model;
+  const char* p = reinterpret_cast<const char*>(bytes + sizeof(Header));
+  model.mVersion.assign(p, header.mVersionSize);
+  p += header.mVersionSize;
+  model.mArchitecture.assign(p, header.mArchitectureSize);
+  p += header.mArchitectureSize;
+  const uint8_t* config = reinterpret_cast<const uint8_t*>(p);
+  model.mConfig = nlohmann::json::from_cbor(config, config + header.mConfigSize);
+  model.mWeights.resize(header.mNumWeights);
+  if (header.mNumWeights > 0)
+    std::memcpy(model.mWeights.data(), bytes + header.mWeightsOffset, header.mNumWeights * sizeof(float));
+  model.mSampleRate = header.mSampleRate;
+  return model;
+}
@@ -0,0 +1,68 @@
+//
+//  ModelBinary.h
+//
+// Compact binary form of .nam model files, produced at build time by
+// tools/NamToBinary so that models can be loaded without parsing JSON.
+//
+// Layout (little-endian):
+//   Header
+//   version string      (mVersionSize bytes, no terminator)
+//   architecture string (mArchitectureSize bytes, no terminator)
+//   config              (mConfigSize bytes of CBOR)
+//   padding             (zeros, up to mWeightsOffset)
+//   weights             (mNumWeights float32s, at a multiple of kWeightAlignment)
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "json.hpp"
+
+namespace dsp
+{
+namespace modelbinary
+{
+const uint32_t kFormatVersion = 1;
+const size_t kWeightAlignment = 16;
+
+struct Header
+{
+  // "QNAM"
+  char mMagic[4];
+  uint32_t mFormatVersion;
+  // Sample rate the model was trained at, or -1 if unknown
+  double mSampleRate;
+  uint32_t mVersionSize;
+  uint32_t mArchitectureSize;
+  uint32_t mConfigSize;
+  uint32_t mNumWeights;
+  // From the start of the blob
+  uint32_t mWeightsOffset;
+  uint32_t mReserved;
+};
+
+// Contents of a model file
+struct Model
+{
+  std::string mVersion;
+  std::string mArchitecture;
+  nlohmann::json mConfig;
+  std::vector<float> mWeights;
+  double mSampleRate = -1.0;
+};
+
+// Returns true if data starts with a model binary header (of any format
+// version).
+bool IsModelBinary(const void* data, const size_t size);
+// Serialize a model.
+std::vector<uint8_t> Write(const Model& model);
+// Deserialize a model. The only "parsing" is of the small CBOR config; the
+// weights are copied out in one go.
+// Throws std::runtime_error if the blob is malformed or from a different
+// format version.
+Model Read(const void* data, const size_t size);
+}; // namespace modelbinary
+}; // namespace dsp
@@ -0,0 +1,342 @@
+//
+//  ModelHotSwap.cpp
+//
+
+#include <algorithm>
+
+#include "ModelHotSwap.h"
+#include "SharedWaveNet.h"
+
+namespace
+{
+// Samples replayed when the model type doesn't say how much it needs
+constexpr long kDefaultSettleSamples = 8192;
+// Replay chunk size for warm-ups
+constexpr long kWarmUpChunkSize = 1024;
+// A warm-up that can't get within reach of the live input after this many
+// passes (e.g. because the machine is overloaded) stops where it is.
+constexpr int kMaxWarmUpPasses = 8;
+
+// Run input through the model and throw away the output. numChannels is the
+// model's (see dsp::hotswap::GetNumChannels()).
+void Replay(nam::DSP& model, NAM_SAMPLE* const* inputs, NAM_SAMPLE* const* outputs, const int numChannels,
+            const long numFrames)
+{
+  if (numChannels > 1)
+    static_cast<dsp::wavenet::WaveNet&>(model).ProcessChannels(inputs, outputs, (int)numFrames);
+  else
+    model.process(inputs[0], outputs[0], (int)numFrames);
+  model.finalize_((int)numFrames);
+}
+
+// numChannels blocks of numFrames in buffer
+void Split(std::vector<NAM_SAMPLE>& buffer, const int numChannels, const long numFrames, NAM_SAMPLE** channels)
+{
+  for (int c = 0; c < numChannels; c++)
+    channels[c] = buffer.data() + c * numFrames;
+}
+
+// Run a block through the model into numChannels outputs: the inputs as they
+// are if the model has that many channels, otherwise their average (mono)
+// with the output copied to every channel.
+void Run(nam::DSP& model, NAM_SAMPLE* mono, NAM_SAMPLE* const* inputs, NAM_SAMPLE* const* outputs,
+         const int numChannels, const long numFrames)
+{
+  if (numChannels > 1 && dsp::hotswap::GetNumChannels(model) == numChannels)
+    static_cast<dsp::wavenet::WaveNet&>(model).ProcessChannels(inputs, outputs, (int)numFrames);
+  else
+  {
+    model.process(mono, outputs[0], (int)numFrames);
+    for (int c = 1; c < numChannels; c++)
+      std::copy(outputs[0], outputs[0] + numFrames, outputs[c]);
+  }
+  model.finalize_((int)numFrames);
+}
+}; // namespace
+
+dsp::hotswap::InputHistory::InputHistory()
+: mBuffer(kMaxChannels * kCapacity)
+, mPosition(0)
+{
+  for (auto& sample : this->mBuffer)
+    sample.store((NAM_SAMPLE)0.0, std::memory_order_relaxed);
+}
+
+void dsp::hotswap::InputHistory::Write(const NAM_SAMPLE* const* inputs, const int numChannels, const long numFrames)
+{
+  const NAM_SAMPLE* right = inputs[std::min(numChannels, kMaxChannels) - 1];
+  uint64_t position = this->mPosition.load(std::memory_order_relaxed);
+  for (long start = 0; start < numFrames; start += kMaxWrite)
+  {
+    const long count = std::min(kMaxWrite, numFrames - start);
+    // A reader that sees any of these samples sees the position published
+    // before them too (pairs with the fence in Read())
+    std::atomic_thread_fence(std::memory_order_release);
+    for (long i = 0; i < count; i++)
+    {
+      std::atomic<NAM_SAMPLE>* frame = &this->mBuffer[((position + i) % kCapacity) * kMaxChannels];
+      frame[0].store(inputs[0][start + i], std::memory_order_relaxed);
+      frame[1].store(right[start + i], std::memory_order_relaxed);
+    }
+    position += count;
+    this->mPosition.store(position, std::memory_order_release);
+  }
+}
+
+bool dsp::hotswap::InputHistory::Read(const uint64_t start, const long numFrames, const int numChannels,
+                                      NAM_SAMPLE* const* outputs) const
+{
+  const uint64_t end = start + numFrames;
+  if (end > this->GetPosition() || end > kCapacity + start)
+    return false;
+  for (long i = 0; i < numFrames; i++)
+  {
+    const std::atomic<NAM_SAMPLE>* frame = &this->mBuffer[((start + i) % kCapacity) * kMaxChannels];
+    const NAM_SAMPLE left = frame[0].load(std::memory_order_relaxed);
+    const NAM_SAMPLE right = frame[1].load(std::memory_order_relaxed);
+    // Same sum as the swapper's, so a mono model replays exactly what it
+    // would have played
+    if (numChannels == 1)
+      outputs[0][i] = (NAM_SAMPLE)0.5 * (left + right);
+    else
+    {
+      outputs[0][i] = left;
+      outputs[1][i] = right;
+    }
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  // The writer may have overwritten the oldest samples while they were being
+  // copied, up to kMaxWrite ahead of the position it has published.
+  const uint64_t written = this->mPosition.load(std::memory_order_relaxed) + kMaxWrite;
+  return written <= kCapacity || start >= written - kCapacity;
+}
+
+long dsp::hotswap::GetSettleSamples(const nam::DSP& model)
+{
+  if (auto* wavenet = dynamic_cast<const dsp::wavenet::WaveNet*>(&model))
+    return wavenet->GetWeights()->GetPrewarmSamples();
+  return kDefaultSettleSamples;
+}
+
+std::shared_ptr<nam::DSP> dsp::hotswap::NewInstance(const nam::DSP& model, const int numChannels)
+{
+  // A blend's weights belong to the instance; its owner has to make a new one.
+  if (dynamic_cast<const dsp::wavenet::BlendedWaveNet*>(&model) != nullptr)
+    return nullptr;
+  if (auto* wavenet = dynamic_cast<const dsp::wavenet::WaveNet*>(&model))
+  {
+    auto instance = std::make_shared<dsp::wavenet::WaveNet>(wavenet->GetWeights(), numChannels);
+    instance->SetActivationAccuracy(wavenet->GetActivationAccuracy());
+    return instance;
+  }
+  return nullptr;
+}
+
+int dsp::hotswap::GetNumChannels(const nam::DSP& model)
+{
+  if (auto* wavenet = dynamic_cast<const dsp::wavenet::WaveNet*>(&model))
+    return wavenet->GetNumChannels();
+  return 1;
+}
+
+uint64_t dsp::hotswap::WarmUp(nam::DSP& model, const InputHistory& history, const long maxLag)
+{
+  const long settleSamples = std::min(GetSettleSamples(model), InputHistory::kCapacity / 2);
+  const int numChannels = std::min(GetNumChannels(model), InputHistory::kMaxChannels);
+  std::vector<NAM_SAMPLE> input(numChannels * kWarmUpChunkSize, (NAM_SAMPLE)0.0);
+  std::vector<NAM_SAMPLE> output(numChannels * kWarmUpChunkSize);
+  NAM_SAMPLE* inputs[InputHistory::kMaxChannels];
+  NAM_SAMPLE* outputs[InputHistory::kMaxChannels];
+  Split(input, numChannels, kWarmUpChunkSize, inputs);
+  Split(output, numChannels, kWarmUpChunkSize, outputs);
+
+  // Start one settling time back. Before the start of the history, the
+  // input was silence.
+  const uint64_t end = history.GetPosition();
+  const uint64_t position = end - std::min(end, (uint64_t)settleSamples);
+  for (long silence = settleSamples - (long)(end - position); silence > 0; silence -= kWarmUpChunkSize)
+  {
+    const long numFrames = std::min(kWarmUpChunkSize, silence);
+    std::fill(input.begin(), input.end(), (NAM_SAMPLE)0.0);
+    Replay(model, inputs, outputs, numChannels, numFrames);
+  }
+  return CatchUp(model, history, position, maxLag);
+}
+
+uint64_t dsp::hotswap::CatchUp(nam::DSP& model, const InputHistory& history, uint64_t position, const long maxLag)
+{
+  const long settleSamples = std::min(GetSettleSamples(model), InputHistory::kCapacity / 2);
+  const int numChannels = std::min(GetNumChannels(model), InputHistory::kMaxChannels);
+  std::vector<NAM_SAMPLE> input(numChannels * kWarmUpChunkSize);
+  std::vector<NAM_SAMPLE> output(numChannels * kWarmUpChunkSize);
+  NAM_SAMPLE* inputs[InputHistory::kMaxChannels];
+  NAM_SAMPLE* outputs[InputHistory::kMaxChannels];
+  Split(input, numChannels, kWarmUpChunkSize, inputs);
+  Split(output, numChannels, kWarmUpChunkSize, outputs);
+  uint64_t end = history.GetPosition();
+
+  // Keep replaying until the model is close enough to the live input;
+  // each pass only has to cover what arrived during the previous one.
+  for (int pass = 0; pass < kMaxWarmUpPasses; pass++)
+  {
+    while (position < end)
+    {
+      const long numFrames = (long)std::min((uint64_t)kWarmUpChunkSize, end - position);
+      if (!history.Read(position, numFrames, numChannels, inputs))
+      {
+        // Fell too far behind: settle again on the newest input.
+        end = history.GetPosition();
+        position = end - std::min(end, (uint64_t)settleSamples);
+        continue;
+      }
+      Replay(model, inputs, outputs, numChannels, numFrames);
+      position += numFrames;
+    }
+    end = history.GetPosition();
+    if (end - position <= (uint64_t)maxLag)
+      break;
+  }
+  return position;
+}
+
+dsp::hotswap::Swapper::Swapper(const double sampleRate)
+: mFadeLength(std::max(1L, (long)(kFadeSeconds * sampleRate)))
+, mOfferPosition(0)
+, mNumSwaps(0)
+, mLastSwapPosition(0)
+, mFadePosition(0)
+, mScratchInput(kMaxChannels * kScratchSize)
+, mScratchOutput(kMaxChannels * kScratchSize)
+{
+}
+
+bool dsp::hotswap::Swapper::Offer(std::shared_ptr<nam::DSP> model, const uint64_t position)
+{
+  // Models dropped here are destroyed after the lock is released.
+  std::shared_ptr<nam::DSP> released;
+  std::shared_ptr<nam::DSP> retired;
+  {
+    std::lock_guard<std::mutex> lock(this->mMutex);
+    released = std::move(this->mOffer);
+    retired = std::move(this->mRetired);
+    this->mOffer = std::move(model);
+    this->mOfferPosition = position;
+  }
+  return released != nullptr;
+}
+
+void dsp::hotswap::Swapper::Cancel()
+{
+  std::shared_ptr<nam::DSP> released;
+  std::shared_ptr<nam::DSP> retired;
+  {
+    std::lock_guard<std::mutex> lock(this->mMutex);
+    released = std::move(this->mOffer);
+    retired = std::move(this->mRetired);
+  }
+}
+
+std::shared_ptr<nam::DSP> dsp::hotswap::Swapper::Withdraw(uint64_t& position)
+{
+  std::shared_ptr<nam::DSP> retired;
+  std::lock_guard<std::mutex> lock(this->mMutex);
+  retired = std::move(this->mRetired);
+  position = this->mOfferPosition;
+  return std::move(this->mOffer);
+}
+
+void dsp::hotswap::Swapper::Process(std::shared_ptr<nam::DSP>& current, NAM_SAMPLE* input, NAM_SAMPLE* output,
+                                    const int numFrames)
+{
+  this->Process(current, &input, &output, 1, numFrames);
+}
+
+void dsp::hotswap::Swapper::Process(std::shared_ptr<nam::DSP>& current, NAM_SAMPLE* const* inputs,
+                                    NAM_SAMPLE* const* outputs, const int numChannels, const int numFrames)
+{
+  // Never blocks: if another thread holds the lock, try again next block.
+  const bool fading = this->mFadeFrom != nullptr && this->mFadePosition < this->mFadeLength;
+  if (!fading)
+  {
+    std::unique_lock<std::mutex> lock(this->mMutex, std::try_to_lock);
+    if (lock.owns_lock())
+    {
+      if (this->mFadeFrom != nullptr && this->mRetired == nullptr)
+        this->mRetired = std::move(this->mFadeFrom);
+      if (this->mFadeFrom == nullptr && this->mOffer != nullptr)
+        this->_TakeOffer(current, kMaxCatchUp);
+    }
+  }
+
+  const int channels = std::min(numChannels, kMaxChannels);
+  for (long done = 0; done < numFrames; done += kScratchSize)
+  {
+    const long count = std::min(kScratchSize, numFrames - done);
+    NAM_SAMPLE* blockInputs[kMaxChannels];
+    NAM_SAMPLE* blockOutputs[kMaxChannels];
+    NAM_SAMPLE* fadeOutputs[kMaxChannels];
+    for (int c = 0; c < channels; c++)
+    {
+      blockInputs[c] = inputs[c] + done;
+      blockOutputs[c] = outputs[c] + done;
+      fadeOutputs[c] = this->mScratchOutput.data() + c * kScratchSize;
+    }
+    this->mHistory.Write(blockInputs, channels, count);
+    // What mono models play
+    NAM_SAMPLE* mono = blockInputs[0];
+    if (channels > 1)
+    {
+      for (long i = 0; i < count; i++)
+        this->mScratchInput[i] = (NAM_SAMPLE)0.5 * (blockInputs[0][i] + blockInputs[1][i]);
+      mono = this->mScratchInput.data();
+    }
+
+    if (this->mFadeFrom == nullptr || this->mFadePosition >= this->mFadeLength)
+    {
+      Run(*current, mono, blockInputs, blockOutputs, channels, count);
+      continue;
+    }
+    // Both models run while fading. Linear crossfade: the two models are
+    // close to each other and their outputs are in phase.
+    Run(*current, mono, blockInputs, blockOutputs, channels, count);
+    Run(*this->mFadeFrom, mono, blockInputs, fadeOutputs, channels, count);
+    const long fadeFrames = std::min(count, this->mFadeLength - this->mFadePosition);
+    for (int c = 0; c < channels; c++)
+      for (long i = 0; i < fadeFrames; i++)
+      {
+        const NAM_SAMPLE mix = (NAM_SAMPLE)(this->mFadePosition + i) / (NAM_SAMPLE)this->mFadeLength;
+        blockOutputs[c][i] = mix * blockOutputs[c][i] + ((NAM_SAMPLE)1.0 - mix) * fadeOutputs[c][i];
+      }
+    this->mFadePosition += fadeFrames;
+  }
+}
+
+void dsp::hotswap::Swapper::_TakeOffer(std::shared_ptr<nam::DSP>& current, const long maxCatchUp)
+{
+  // Replay what the playing model has heard since the warm-up finished, if
+  // that's little enough to do here.
+  const uint64_t end = this->mHistory.GetPosition();
+  if (end - this->mOfferPosition > (uint64_t)maxCatchUp)
+    return;
+  std::shared_ptr<nam::DSP> incoming = std::move(this->mOffer);
+  const int numChannels = std::min(GetNumChannels(*incoming), kMaxChannels);
+  NAM_SAMPLE* inputs[kMaxChannels];
+  NAM_SAMPLE* outputs[kMaxChannels];
+  Split(this->mScratchInput, numChannels, kScratchSize, inputs);
+  Split(this->mScratchOutput, numChannels, kScratchSize, outputs);
+  uint64_t position = this->mOfferPosition;
+  while (position < end)
+  {
+    const long count = (long)std::min((uint64_t)kScratchSize, end - position);
+    if (!this->mHistory.Read(position, count, numChannels, inputs))
+      break;
+    Replay(*incoming, inputs, outputs, numChannels, count);
+    position += count;
+  }
+
+  this->mFadeFrom = std::move(current);
+  this->mFadePosition = 0;
+  current = std::move(incoming);
+  this->mLastSwapPosition.store(end);
+  this->mNumSwaps++;
+}
@@ -0,0 +1,156 @@
+//
+//  ModelHotSwap.h
+//
+// Seamless model changes: a new model is brought up to date with the input
+// the playing model has seen (off the audio thread), then takes over with a
+// short crossfade, instead of both models running side by side for as long as
+// the new one takes to settle.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../NeuralAmpModelerCore/NAM/dsp.h"
+
+namespace dsp
+{
+namespace hotswap
+{
+// The most recent input of the playing model, at the model's sample rate, with
+// each side of a stereo input kept apart. Written by the audio thread; can be read from any other thread, lock-free:
+// a reader copies the samples, then checks (like a seqlock) that the writer
+// can't have overwritten them in the meantime. The samples are atomics so
+// that the copy itself isn't a data race.
+class InputHistory
+{
+public:
+  // Enough for the receptive field of any factory model, with plenty to spare
+  static constexpr long kCapacity = 1 << 15;
+  static constexpr int kMaxChannels = 2;
+
+  InputHistory();
+
+  // Audio thread only. inputs has numChannels (at most kMaxChannels)
+  // pointers; a single channel is recorded as both sides.
+  void Write(const NAM_SAMPLE* const* inputs, const int numChannels, const long numFrames);
+  // Number of frames written so far
+  uint64_t GetPosition() const { return this->mPosition.load(std::memory_order_acquire); };
+  // Copy frames [start, start + numFrames) to numChannels outputs: the average
+  // of the sides for one channel (what a mono model plays), otherwise one
+  // side per output. Returns false if they aren't all in the history (too
+  // old, or not written yet).
+  bool Read(const uint64_t start, const long numFrames, const int numChannels, NAM_SAMPLE* const* outputs) const;
+
+private:
+  // Longest stretch written before the position is published
+  static constexpr long kMaxWrite = 1024;
+
+  // kMaxChannels samples per frame, interleaved
+  std::vector<std::atomic<NAM_SAMPLE>> mBuffer;
+  std::atomic<uint64_t> mPosition;
+};
+
+// Samples of input after which the model's state no longer depends on what
+// came before
+long GetSettleSamples(const nam::DSP& model);
+
+// A new instance of model, with its own state, that can be warmed up while
+// model itself keeps playing, and the same settings (e.g. activation
+// accuracy). nullptr if the model can't be duplicated.
+// numChannels: signals the new instance runs at once, see
+// dsp::wavenet::WaveNet.
+std::shared_ptr<nam::DSP> NewInstance(const nam::DSP& model, const int numChannels = 1);
+
+// Signals model runs at once; 1 for anything but a multi-channel WaveNet
+int GetNumChannels(const nam::DSP& model);
+
+// Replay the input history into model until it's within maxLag samples of
+// the live input. Returns the history position the model is up to date with.
+// Takes a few milliseconds; never call it from the audio thread.
+uint64_t WarmUp(nam::DSP& model, const InputHistory& history, const long maxLag);
+// Same, for a model that's up to date with position already: only replays
+// what came after it (or warms it up again if that's no longer in the
+// history).
+uint64_t CatchUp(nam::DSP& model, const InputHistory& history, uint64_t position, const long maxLag);
+
+// Runs the playing model on the audio thread, records its input, and swaps
+// in warmed-up models as they're offered.
+class Swapper
+{
+public:
+  // Length of the crossfade between the outgoing and incoming models
+  static constexpr double kFadeSeconds = 0.02;
+  // Most input replayed on the audio thread to bring an offered model from
+  // its warm-up position up to the live input. An offer that's further
+  // behind (e.g. after a host block longer than this) is left for its owner
+  // to bring up to date (see Withdraw()).
+  static constexpr long kMaxCatchUp = 256;
+  static constexpr int kMaxChannels = InputHistory::kMaxChannels;
+
+  // Allocates; sampleRate is the models' sample rate.
+  Swapper(const double sampleRate);
+
+  const InputHistory& GetHistory() const { return this->mHistory; };
+
+  // Offer a model to take over from the playing one. It must have been
+  // warmed up to position with WarmUp(), and must not be used by anything
+  // else. Replaces an offer that hasn't been taken yet, and returns true if
+  // there was one. Not the audio thread.
+  bool Offer(std::shared_ptr<nam::DSP> model, const uint64_t position);
+  // Withdraw an offer that hasn't been taken yet. Not the audio thread.
+  void Cancel();
+  // Take back an offer that hasn't been taken yet, with the position it's
+  // up to date with; nullptr if there's none. Not the audio thread.
+  std::shared_ptr<nam::DSP> Withdraw(uint64_t& position);
+
+  // Number of offers taken so far
+  uint64_t GetNumSwaps() const { return this->mNumSwaps.load(); };
+  // History position at which the last offer was taken
+  uint64_t GetLastSwapPosition() const { return this->mLastSwapPosition.load(); };
+
+  // Audio thread: run a block through current (replacing it first if a
+  // model has been offered) and record the input. input and output must not
+  // overlap.
+  void Process(std::shared_ptr<nam::DSP>& current, NAM_SAMPLE* input, NAM_SAMPLE* output, const int numFrames);
+  // Same, for numChannels (at most kMaxChannels) inputs and outputs. A model
+  // with that many channels plays them as they are; any other model plays
+  // their average, and its output goes to every channel. The history records
+  // every channel, so a model warmed up on it has heard what it would have
+  // played.
+  void Process(std::shared_ptr<nam::DSP>& current, NAM_SAMPLE* const* inputs, NAM_SAMPLE* const* outputs,
+               const int numChannels, const int numFrames);
+
+private:
+  static constexpr long kScratchSize = 256;
+
+  // Take the offer if it's at most maxCatchUp samples behind the live input
+  void _TakeOffer(std::shared_ptr<nam::DSP>& current, const long maxCatchUp);
+
+  InputHistory mHistory;
+  const long mFadeLength;
+
+  // Shared with the other threads, under the mutex
+  std::mutex mMutex;
+  std::shared_ptr<nam::DSP> mOffer;
+  uint64_t mOfferPosition;
+  // Model that has been faded out, released by the next Offer() so that it
+  // isn't freed on the audio thread
+  std::shared_ptr<nam::DSP> mRetired;
+
+  // Written by the audio thread, readable from any thread
+  std::atomic<uint64_t> mNumSwaps;
+  std::atomic<uint64_t> mLastSwapPosition;
+
+  // Audio thread
+  std::shared_ptr<nam::DSP> mFadeFrom;
+  long mFadePosition;
+  // Both kMaxChannels blocks of kScratchSize
+  std::vector<NAM_SAMPLE> mScratchInput;
+  std::vector<NAM_SAMPLE> mScratchOutput;
+};
+}; // namespace hotswap
+}; // namespace dsp
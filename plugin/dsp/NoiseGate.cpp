@@ -22,7 +22,8 @@ double _DBToLevel(const double level)
   return pow(10.0, level / 10.0);
 }
 
-dsp::noise_gate::Trigger::Trigger()
+template <typename T>
+dsp::noise_gate::Trigger<T>::Trigger()
 : mParams(0.05, -60.0, 1.5, 0.002, 0.050, 0.050)
 , mSampleRate(0)
 {
@@ -33,10 +34,28 @@ double signum(const double val)
   return (0.0 < val) - (val < 0.0);
 }
 
-DSP_SAMPLE** dsp::noise_gate::Trigger::Process(DSP_SAMPLE** inputs, const size_t numChannels, const size_t numFrames)
+template <typename T>
+T** dsp::noise_gate::Trigger<T>::Process(T** inputs, const size_t numChannels, const size_t numFrames)
 {
   this->_PrepareBuffers(numChannels, numFrames);
+  this->_Process(inputs, numChannels, numFrames);
 
+  // Copy input to output
+  for (auto c = 0; c < numChannels; c++)
+    memcpy(this->mOutputs[c].data(), inputs[c], numFrames * sizeof(T));
+  return this->_GetPointers();
+}
+
+template <typename T>
+void dsp::noise_gate::Trigger<T>::ProcessInPlace(T* const* buffers, const size_t numChannels, const size_t numFrames)
+{
+  this->_PrepareBuffers(numChannels, numFrames);
+  this->_Process(buffers, numChannels, numFrames);
+}
+
+template <typename T>
+void dsp::noise_gate::Trigger<T>::_Process(const T* const* inputs, const size_t numChannels, const size_t numFrames)
+{
   // A bunch of numbers we'll use a few times.
   const double alpha = pow(0.5, 1.0 / (this->mParams.GetTime() * this->mSampleRate));
   const double beta = 1.0 - alpha;
@@ -56,7 +75,7 @@ DSP_SAMPLE** dsp::noise_gate::Trigger::Process(DSP_SAMPLE** inputs, const size_t
       this->mLevel[c] =
         std::clamp(alpha * this->mLevel[c] + beta * (inputs[c][s] * inputs[c][s]), MINIMUM_LOUDNESS_POWER, 1000.0);
       const double levelDB = _LevelToDB(this->mLevel[c]);
-      if (this->mState[c] == dsp::noise_gate::Trigger::State::HOLDING)
+      if (this->mState[c] == State::HOLDING)
       {
         this->mGainReductionDB[c][s] = 0.0;
         this->mLastGainReductionDB[c] = 0.0;
@@ -64,7 +83,7 @@ DSP_SAMPLE** dsp::noise_gate::Trigger::Process(DSP_SAMPLE** inputs, const size_t
         {
           this->mTimeHeld[c] += dt;
           if (this->mTimeHeld[c] >= maxHold)
-            this->mState[c] = dsp::noise_gate::Trigger::State::MOVING;
+            this->mState[c] = State::MOVING;
         }
         else
         {
@@ -81,7 +100,7 @@ DSP_SAMPLE** dsp::noise_gate::Trigger::Process(DSP_SAMPLE** inputs, const size_t
           if (this->mLastGainReductionDB[c] >= 0.0)
           {
             this->mLastGainReductionDB[c] = 0.0;
-            this->mState[c] = dsp::noise_gate::Trigger::State::HOLDING;
+            this->mState[c] = State::HOLDING;
             this->mTimeHeld[c] = 0.0;
           }
         }
@@ -102,18 +121,14 @@ DSP_SAMPLE** dsp::noise_gate::Trigger::Process(DSP_SAMPLE** inputs, const size_t
   // Share the results with gain objects that are listening to this trigger:
   for (auto gain = this->mGainListeners.begin(); gain != this->mGainListeners.end(); ++gain)
     (*gain)->SetGainReductionDB(this->mGainReductionDB);
-
-  // Copy input to output
-  for (auto c = 0; c < numChannels; c++)
-    memcpy(this->mOutputs[c].data(), inputs[c], numFrames * sizeof(DSP_SAMPLE));
-  return this->_GetPointers();
 }
 
-void dsp::noise_gate::Trigger::_PrepareBuffers(const size_t numChannels, const size_t numFrames)
+template <typename T>
+void dsp::noise_gate::Trigger<T>::_PrepareBuffers(const size_t numChannels, const size_t numFrames)
 {
   const size_t oldChannels = this->_GetNumChannels();
   const size_t oldFrames = this->_GetNumFrames();
-  this->DSP::_PrepareBuffers(numChannels, numFrames);
+  this->DSP<T>::_PrepareBuffers(numChannels, numFrames);
 
   const bool updateChannels = numChannels != oldChannels;
   const bool updateFrames = updateChannels || numFrames != oldFrames;
@@ -127,7 +142,7 @@ void dsp::noise_gate::Trigger::_PrepareBuffers(const size_t numChannels, const s
       this->mLastGainReductionDB.resize(numChannels);
       std::fill(this->mLastGainReductionDB.begin(), this->mLastGainReductionDB.end(), maxGainReduction);
       this->mState.resize(numChannels);
-      std::fill(this->mState.begin(), this->mState.end(), dsp::noise_gate::Trigger::State::MOVING);
+      std::fill(this->mState.begin(), this->mState.end(), State::MOVING);
       this->mLevel.resize(numChannels);
       std::fill(this->mLevel.begin(), this->mLevel.end(), MINIMUM_LOUDNESS_POWER);
       this->mTimeHeld.resize(numChannels);
@@ -146,11 +161,27 @@ void dsp::noise_gate::Trigger::_PrepareBuffers(const size_t numChannels, const s
 
 // Gain========================================================================
 
-DSP_SAMPLE** dsp::noise_gate::Gain:: Process(DSP_SAMPLE** inputs, const size_t numChannels, const size_t numFrames)
+template <typename T>
+T** dsp::noise_gate::Gain<T>::Process(T** inputs, const size_t numChannels, const size_t numFrames)
+{
+  this->_PrepareBuffers(numChannels, numFrames);
+  T** outputs = this->_GetPointers();
+  this->_Process(inputs, outputs, numChannels, numFrames);
+  return outputs;
+}
+
+template <typename T>
+void dsp::noise_gate::Gain<T>::ProcessInPlace(T* const* buffers, const size_t numChannels, const size_t numFrames)
+{
+  this->_Process(buffers, buffers, numChannels, numFrames);
+}
+
+template <typename T>
+void dsp::noise_gate::Gain<T>::_Process(const T* const* inputs, T* const* outputs, const size_t numChannels,
+                                        const size_t numFrames)
 {
   // Assume that SetGainReductionDB() was just called to get data from a
   // trigger. Could use listeners...
-  this->_PrepareBuffers(numChannels, numFrames);
 
   if (this->mGainReductionDB.size() != numChannels)
   {
@@ -176,7 +207,10 @@ DSP_SAMPLE** dsp::noise_gate::Gain:: Process(DSP_SAMPLE** inputs, const size_t n
   // Apply gain!
   for (auto c = 0; c < numChannels; c++)
     for (auto s = 0; s < numFrames; s++)
-      this->mOutputs[c][s] = _DBToLevel(this->mGainReductionDB[c][s]) * inputs[c][s];
-
-  return this->_GetPointers();
+      outputs[c][s] = (T)(_DBToLevel(this->mGainReductionDB[c][s]) * inputs[c][s]);
 }
+
+template class dsp::noise_gate::Trigger<float>;
+template class dsp::noise_gate::Trigger<double>;
+template class dsp::noise_gate::Gain<float>;
+template class dsp::noise_gate::Gain<double>;
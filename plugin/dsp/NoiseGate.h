@@ -31,19 +31,34 @@ const double MINIMUM_LOUDNESS_POWER = pow(10.0, MINIMUM_LOUDNESS_DB / 10.0);
 // It's declared first so that the trigger can define listeners without a
 // forward declaration.
 
+// What a trigger shares its gain reductions with. The gain reductions are
+// always in double, so that a trigger can drive gains of another sample type.
+class GainListener
+{
+public:
+  virtual ~GainListener() = default;
+  virtual void SetGainReductionDB(std::vector<std::vector<double>>& gainReductionDB) = 0;
+};
+
 // The class that applies the gain reductions calculated by a trigger instance.
-class Gain : public DSP
+template <typename T = DSP_SAMPLE>
+class Gain : public DSP<T>, public GainListener
 {
 public:
-  DSP_SAMPLE** Process(DSP_SAMPLE** inputs, const size_t numChannels, const size_t numFrames) override;
+  T** Process(T** inputs, const size_t numChannels, const size_t numFrames) override;
+  void ProcessInPlace(T* const* buffers, const size_t numChannels, const size_t numFrames) override;
 
-  void SetGainReductionDB(std::vector<std::vector<DSP_SAMPLE>>& gainReductionDB)
+  void SetGainReductionDB(std::vector<std::vector<double>>& gainReductionDB) override
   {
     this->mGainReductionDB = gainReductionDB;
   }
 
 private:
-  std::vector<std::vector<DSP_SAMPLE>> mGainReductionDB;
+  // Apply the gain reductions to inputs, into outputs (which may be the
+  // inputs).
+  void _Process(const T* const* inputs, T* const* outputs, const size_t numChannels, const size_t numFrames);
+
+  std::vector<std::vector<double>> mGainReductionDB;
 };
 
 // Part 1 of the noise gate: the trigger.
@@ -84,18 +99,21 @@ private:
   double mCloseTime;
 };
 
-class Trigger : public DSP
+// The output is the input, unchanged: in place, the trigger only listens.
+template <typename T = DSP_SAMPLE>
+class Trigger : public DSP<T>
 {
 public:
   Trigger();
 
-  DSP_SAMPLE** Process(DSP_SAMPLE** inputs, const size_t numChannels, const size_t numFrames) override;
-  std::vector<std::vector<DSP_SAMPLE>> GetGainReduction() const { return this->mGainReductionDB; };
+  T** Process(T** inputs, const size_t numChannels, const size_t numFrames) override;
+  void ProcessInPlace(T* const* buffers, const size_t numChannels, const size_t numFrames) override;
+  std::vector<std::vector<double>> GetGainReduction() const { return this->mGainReductionDB; };
   void SetParams(const TriggerParams& params) { this->mParams = params; };
   void SetSampleRate(const double sampleRate) { this->mSampleRate = sampleRate; }
-  std::vector<std::vector<DSP_SAMPLE>> GetGainReductionDB() const { return this->mGainReductionDB; };
+  std::vector<std::vector<double>> GetGainReductionDB() const { return this->mGainReductionDB; };
 
-  void AddListener(Gain* gain)
+  void AddListener(GainListener* gain)
   {
     // This might be risky dropping a raw pointer, but I don't think that the
     // gain would be destructed, so probably ok.
@@ -116,6 +134,9 @@ private:
     return levelDB < threshold ? -(this->mParams.GetRatio()) * (levelDB - threshold) * (levelDB - threshold) : 0.0;
   }
   double _GetMaxGainReduction() const { return this->_GetGainReduction(MINIMUM_LOUDNESS_DB); }
+  // Compute the gain reductions for the inputs and share them with the
+  // listeners.
+  void _Process(const T* const* inputs, const size_t numChannels, const size_t numFrames);
   virtual void _PrepareBuffers(const size_t numChannels, const size_t numFrames) override;
 
   TriggerParams mParams;
@@ -131,7 +152,7 @@ private:
   // How long we've been holding
   std::vector<double> mTimeHeld;
 
-  std::unordered_set<Gain*> mGainListeners;
+  std::unordered_set<GainListener*> mGainListeners;
 };
 
 }; // namespace noise_gate
@@ -0,0 +1,532 @@
+//
+//  PartitionedConvolution.cpp
+//
+
+#include <algorithm> // std::fill, std::min
+#include <atomic>
+#include <condition_variable>
+#include <cstring> // memcpy
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "PartitionedConvolution.h"
+
+dsp::convolution::UniformPartitioned::UniformPartitioned(const size_t partitionSize)
+: mPartitionSize(partitionSize)
+, mNumBins(partitionSize + 1)
+, mNumPartitions(0)
+, mDelayPartitions(0)
+, mNumSlots(0)
+, mFFT(2 * partitionSize)
+, mFDLIndex(0)
+, mBlockPosition(0)
+{
+  if (!fft::IsPowerOfTwo(partitionSize))
+  {
+    std::stringstream ss;
+    ss << "Partition size must be a power of two; got " << partitionSize;
+    throw std::runtime_error(ss.str());
+  }
+  this->mInputWindow.resize(2 * partitionSize);
+  this->mOutputBlock.resize(partitionSize);
+  this->mAccumulatorReal.resize(this->mNumBins);
+  this->mAccumulatorImag.resize(this->mNumBins);
+  this->mTimeScratch.resize(2 * partitionSize);
+  this->Reset();
+}
+
+void dsp::convolution::UniformPartitioned::SetImpulseResponse(const float* impulseResponse, const size_t length,
+                                                              const size_t delayPartitions)
+{
+  const size_t partitionSize = this->mPartitionSize;
+  this->mNumPartitions = (length + partitionSize - 1) / partitionSize;
+  this->mDelayPartitions = delayPartitions;
+  this->mNumSlots = this->mNumPartitions + delayPartitions;
+  this->mIRReal.resize(this->mNumPartitions * this->mNumBins);
+  this->mIRImag.resize(this->mNumPartitions * this->mNumBins);
+  this->mFDLReal.resize(this->mNumSlots * this->mNumBins);
+  this->mFDLImag.resize(this->mNumSlots * this->mNumBins);
+
+  // Each partition is zero-padded to twice its length so that the circular
+  // convolution in overlap-save yields a valid (linear) second half.
+  for (size_t p = 0; p < this->mNumPartitions; p++)
+  {
+    std::fill(this->mTimeScratch.begin(), this->mTimeScratch.end(), 0.0f);
+    const size_t start = p * partitionSize;
+    const size_t count = std::min(partitionSize, length - start);
+    memcpy(this->mTimeScratch.data(), impulseResponse + start, count * sizeof(float));
+    this->mFFT.Forward(this->mTimeScratch.data(), &this->mIRReal[p * this->mNumBins], &this->mIRImag[p * this->mNumBins]);
+  }
+  this->Reset();
+}
+
+void dsp::convolution::UniformPartitioned::Reset()
+{
+  std::fill(this->mFDLReal.begin(), this->mFDLReal.end(), 0.0f);
+  std::fill(this->mFDLImag.begin(), this->mFDLImag.end(), 0.0f);
+  std::fill(this->mInputWindow.begin(), this->mInputWindow.end(), 0.0f);
+  std::fill(this->mOutputBlock.begin(), this->mOutputBlock.end(), 0.0f);
+  this->mFDLIndex = 0;
+  this->mBlockPosition = 0;
+}
+
+void dsp::convolution::UniformPartitioned::Process(const float* input, float* output, const size_t numFrames)
+{
+  if (this->mNumPartitions == 0)
+  {
+    std::fill(output, output + numFrames, 0.0f);
+    return;
+  }
+  size_t done = 0;
+  while (done < numFrames)
+  {
+    const size_t count = std::min(numFrames - done, this->mPartitionSize - this->mBlockPosition);
+    // New input goes into the second half of the window; the output for those
+    // same positions was computed when the previous block completed.
+    memcpy(&this->mInputWindow[this->mPartitionSize + this->mBlockPosition], input + done, count * sizeof(float));
+    memcpy(output + done, &this->mOutputBlock[this->mBlockPosition], count * sizeof(float));
+    this->mBlockPosition += count;
+    done += count;
+    if (this->mBlockPosition == this->mPartitionSize)
+    {
+      // The input is already in place.
+      this->ProcessBlock(&this->mInputWindow[this->mPartitionSize], this->mOutputBlock.data());
+      this->mBlockPosition = 0;
+    }
+  }
+}
+
+void dsp::convolution::UniformPartitioned::ProcessBlock(const float* input, float* output)
+{
+  const size_t partitionSize = this->mPartitionSize;
+  if (this->mNumPartitions == 0)
+  {
+    std::fill(output, output + partitionSize, 0.0f);
+    return;
+  }
+  const size_t numBins = this->mNumBins;
+  const size_t numSlots = this->mNumSlots;
+
+  float* window = this->mInputWindow.data();
+  if (input != window + partitionSize)
+    memcpy(window + partitionSize, input, partitionSize * sizeof(float));
+
+  // Newest spectrum goes into the slot before the last one so that, walking
+  // forward from mFDLIndex, slot (mFDLIndex + p) holds X_{n-p}.
+  this->mFDLIndex = (this->mFDLIndex + numSlots - 1) % numSlots;
+  this->mFFT.Forward(window, &this->mFDLReal[this->mFDLIndex * numBins], &this->mFDLImag[this->mFDLIndex * numBins]);
+
+  float* accReal = this->mAccumulatorReal.data();
+  float* accImag = this->mAccumulatorImag.data();
+  std::fill(accReal, accReal + numBins, 0.0f);
+  std::fill(accImag, accImag + numBins, 0.0f);
+  for (size_t p = 0; p < this->mNumPartitions; p++)
+  {
+    size_t slot = this->mFDLIndex + this->mDelayPartitions + p;
+    if (slot >= numSlots)
+      slot -= numSlots;
+    const float* hr = &this->mIRReal[p * numBins];
+    const float* hi = &this->mIRImag[p * numBins];
+    const float* xr = &this->mFDLReal[slot * numBins];
+    const float* xi = &this->mFDLImag[slot * numBins];
+    for (size_t k = 0; k < numBins; k++)
+    {
+      accReal[k] += hr[k] * xr[k] - hi[k] * xi[k];
+      accImag[k] += hr[k] * xi[k] + hi[k] * xr[k];
+    }
+  }
+  this->mFFT.Inverse(accReal, accImag, this->mTimeScratch.data());
+
+  // Overlap-save: the first half is circular junk, the second half is valid.
+  memcpy(output, &this->mTimeScratch[partitionSize], partitionSize * sizeof(float));
+  // Slide the window along for the next block.
+  memcpy(window, window + partitionSize, partitionSize * sizeof(float));
+}
+
+// Background work ============================================================
+
+namespace dsp
+{
+namespace convolution
+{
+// A unit of work that the background thread can pick up.
+class BackgroundJob
+{
+public:
+  virtual ~BackgroundJob() = default;
+  // Run whatever is pending, in order. Only ever called by the worker.
+  virtual void Run() = 0;
+};
+
+// One thread shared by every convolver in the process. It sleeps until it's
+// notified that a job is pending and runs whatever's pending.
+// The audio thread only ever touches the atomics and notify_one(), never the
+// mutex. The worker holds the mutex only to pick the next job, not while it
+// runs it; Remove() waits for a job that's running, so a job is never
+// destroyed while it's running.
+// A notification can be missed if it comes just as the worker goes to sleep;
+// it then runs the job on the next one. The lookahead of the background
+// stages (see NonUniformPartitioned) leaves time for that.
+class BackgroundWorker
+{
+public:
+  static BackgroundWorker& Get()
+  {
+    static BackgroundWorker worker;
+    return worker;
+  }
+
+  ~BackgroundWorker()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mMutex);
+      this->mExit = true;
+    }
+    this->mCondition.notify_all();
+    if (this->mThread.joinable())
+      this->mThread.join();
+  }
+
+  void Add(BackgroundJob* job)
+  {
+    std::lock_guard<std::mutex> lock(this->mMutex);
+    if (!this->mThread.joinable())
+      this->mThread = std::thread([this]() { this->_Run(); });
+    this->mJobs.push_back(job);
+  }
+
+  void Remove(BackgroundJob* job)
+  {
+    std::unique_lock<std::mutex> lock(this->mMutex);
+    this->mJobs.erase(std::remove(this->mJobs.begin(), this->mJobs.end(), job), this->mJobs.end());
+    this->mIdle.wait(lock, [this, job]() { return this->mRunning != job; });
+  }
+
+  void Notify()
+  {
+    this->mPending.store(true, std::memory_order_release);
+    this->mCondition.notify_one();
+  }
+
+private:
+  BackgroundWorker() = default;
+
+  void _Run()
+  {
+    std::unique_lock<std::mutex> lock(this->mMutex);
+    while (!this->mExit)
+    {
+      this->mCondition.wait(lock, [this]() {
+        return this->mExit || this->mPending.exchange(false, std::memory_order_acq_rel);
+      });
+      // Jobs may be added or removed while one runs
+      for (size_t i = 0; i < this->mJobs.size() && !this->mExit; i++)
+      {
+        this->mRunning = this->mJobs[i];
+        lock.unlock();
+        this->mRunning->Run();
+        lock.lock();
+        this->mRunning = nullptr;
+        this->mIdle.notify_all();
+      }
+    }
+  }
+
+  std::mutex mMutex;
+  std::condition_variable mCondition;
+  // Signalled when a job has finished running
+  std::condition_variable mIdle;
+  std::vector<BackgroundJob*> mJobs;
+  BackgroundJob* mRunning = nullptr;
+  std::atomic<bool> mPending{false};
+  bool mExit = false;
+  std::thread mThread;
+};
+}; // namespace convolution
+}; // namespace dsp
+
+// NonUniformPartitioned ======================================================
+
+struct dsp::convolution::NonUniformPartitioned::Stage : public dsp::convolution::BackgroundJob
+{
+  enum State
+  {
+    FREE = 0,
+    PENDING,
+    RUNNING,
+    DONE
+  };
+
+  // A block handed to the worker, and the output it makes of it
+  struct Slot
+  {
+    std::vector<float> mInput;
+    std::vector<float> mOutput;
+    // Handoff that it was handed off at, so that the worker takes them in
+    // order
+    size_t mHandOff = 0;
+    // Clear mConvolution before this block (see _HandOff())
+    bool mReset = false;
+    std::atomic<int> mState{FREE};
+  };
+
+  Stage(const size_t partitionSize, const bool background)
+  : mConvolution(partitionSize)
+  , mBackground(background)
+  {
+    if (background)
+    {
+      this->mInputBlock.resize(partitionSize);
+      this->mOutputBlock.resize(partitionSize);
+      for (auto& slot : this->mSlots)
+      {
+        slot.mInput.resize(partitionSize);
+        slot.mOutput.resize(partitionSize);
+      }
+    }
+  }
+
+  void Run() override
+  {
+    // Take the pending blocks oldest first: mConvolution has to see them in
+    // order
+    while (true)
+    {
+      // The audio thread is computing the oldest block itself (see
+      // _HandOff()); it notifies the worker again when it hands off the next
+      if (this->mComputing.exchange(true, std::memory_order_acquire))
+        return;
+      Slot* next = nullptr;
+      for (auto& slot : this->mSlots)
+        if (slot.mState.load(std::memory_order_acquire) == PENDING
+            && (next == nullptr || slot.mHandOff < next->mHandOff))
+          next = &slot;
+      // The audio thread may have given up on it since
+      if (next != nullptr)
+        this->_RunSlot(*next);
+      this->mComputing.store(false, std::memory_order_release);
+      if (next == nullptr)
+        return;
+    }
+  }
+
+  void Process(const float* input, float* output, const size_t numFrames)
+  {
+    if (!this->mBackground)
+    {
+      this->mConvolution.Process(input, output, numFrames);
+      return;
+    }
+    const size_t partitionSize = this->mConvolution.GetPartitionSize();
+    size_t done = 0;
+    while (done < numFrames)
+    {
+      const size_t count = std::min(numFrames - done, partitionSize - this->mPosition);
+      memcpy(&this->mInputBlock[this->mPosition], input + done, count * sizeof(float));
+      memcpy(output + done, &this->mOutputBlock[this->mPosition], count * sizeof(float));
+      this->mPosition += count;
+      done += count;
+      if (this->mPosition == partitionSize)
+      {
+        this->_HandOff();
+        this->mPosition = 0;
+      }
+    }
+  }
+
+  // Not for the audio thread: waits for a block that's being computed.
+  void Reset()
+  {
+    this->_Lock();
+    for (auto& slot : this->mSlots)
+      slot.mState.store(FREE, std::memory_order_release);
+    this->mConvolution.Reset();
+    this->mComputing.store(false, std::memory_order_release);
+    std::fill(this->mInputBlock.begin(), this->mInputBlock.end(), 0.0f);
+    std::fill(this->mOutputBlock.begin(), this->mOutputBlock.end(), 0.0f);
+    this->mPosition = 0;
+    this->mNumHandOffs = 0;
+    this->mResync = false;
+  }
+
+  UniformPartitioned mConvolution;
+  const bool mBackground;
+  // See NonUniformPartitioned::SetNonRealtime()
+  bool mNonRealtime = false;
+
+private:
+  // Collect the block handed off kBackgroundLookahead partitions ago (it
+  // plays out over the next partition) and hand off the one that was just
+  // filled, in the slot it frees. Never waits: if the worker is late, that
+  // block is played as silence and the next one clears mConvolution, so the
+  // stage drops out for a while rather than holding up the audio thread.
+  void _HandOff()
+  {
+    Slot& slot = this->mSlots[this->mNumHandOffs % kBackgroundLookahead];
+    this->mNumHandOffs++;
+    if (this->mNonRealtime)
+    {
+      // Nobody's listening, so wait for it: it's the oldest block in flight,
+      // so once the worker is done with mConvolution it can be computed here
+      // if need be.
+      this->_Lock();
+      this->_RunSlot(slot);
+      this->mComputing.store(false, std::memory_order_release);
+    }
+    int state = PENDING;
+    // If the worker hasn't picked it up yet, it won't now
+    if (slot.mState.compare_exchange_strong(state, FREE, std::memory_order_acq_rel))
+      state = FREE;
+    if (state == DONE && slot.mHandOff + kBackgroundLookahead == this->mNumHandOffs)
+      std::swap(this->mOutputBlock, slot.mOutput);
+    else
+    {
+      std::fill(this->mOutputBlock.begin(), this->mOutputBlock.end(), 0.0f);
+      // A miss, unless nothing was due: during the first partitions, or
+      // after a block was dropped below
+      if (state != DONE && this->mNumHandOffs > kBackgroundLookahead)
+        this->mResync = true;
+    }
+    // Still running: this block is dropped
+    if (state == RUNNING)
+      return;
+    std::swap(slot.mInput, this->mInputBlock);
+    slot.mHandOff = this->mNumHandOffs;
+    slot.mReset = this->mResync;
+    this->mResync = false;
+    slot.mState.store(PENDING, std::memory_order_release);
+    BackgroundWorker::Get().Notify();
+  }
+
+  // Wait until nobody else is computing a block, and take mComputing
+  void _Lock()
+  {
+    while (this->mComputing.exchange(true, std::memory_order_acquire))
+      std::this_thread::yield();
+  }
+
+  // Compute the slot's block, unless it's not pending (anymore). Only with
+  // mComputing held.
+  void _RunSlot(Slot& slot)
+  {
+    int expected = PENDING;
+    if (!slot.mState.compare_exchange_strong(expected, RUNNING, std::memory_order_acq_rel))
+      return;
+    if (slot.mReset)
+      this->mConvolution.Reset();
+    this->mConvolution.ProcessBlock(slot.mInput.data(), slot.mOutput.data());
+    slot.mState.store(DONE, std::memory_order_release);
+  }
+
+  // Background stages buffer around mConvolution.ProcessBlock() themselves:
+  // the block being filled, the block being played out, and the blocks in
+  // flight with the worker. Swapping vectors only swaps pointers.
+  std::vector<float> mInputBlock;
+  std::vector<float> mOutputBlock;
+  Slot mSlots[kBackgroundLookahead];
+  size_t mPosition = 0;
+  size_t mNumHandOffs = 0;
+  // The worker missed a block, so mConvolution has to start over
+  bool mResync = false;
+  // Held by whoever is running mConvolution: the worker, or the audio
+  // thread in non-realtime mode. Blocks that overlap, or run out of order,
+  // would corrupt its delay line.
+  std::atomic<bool> mComputing{false};
+};
+
+dsp::convolution::NonUniformPartitioned::NonUniformPartitioned(const size_t firstPartitionSize)
+: mFirstPartitionSize(firstPartitionSize)
+{
+  if (!fft::IsPowerOfTwo(firstPartitionSize))
+  {
+    std::stringstream ss;
+    ss << "Partition size must be a power of two; got " << firstPartitionSize;
+    throw std::runtime_error(ss.str());
+  }
+  this->mStageOutput.resize(firstPartitionSize);
+}
+
+dsp::convolution::NonUniformPartitioned::~NonUniformPartitioned()
+{
+  this->_ClearStages();
+}
+
+void dsp::convolution::NonUniformPartitioned::SetImpulseResponse(const float* impulseResponse, const size_t length)
+{
+  this->_ClearStages();
+  // Latency of a stage with the given partition size. The first stage always
+  // runs in line so that it can start right after the caller's direct-form
+  // head.
+  auto latency = [](const size_t partitionSize, const bool isFirst) {
+    return (!isFirst && partitionSize >= kBackgroundPartitionSize ? 1 + kBackgroundLookahead : 1) * partitionSize;
+  };
+
+  size_t offset = this->mFirstPartitionSize;
+  size_t partitionSize = std::min(this->mFirstPartitionSize, kMaxPartitionSize);
+  while (offset < length)
+  {
+    const bool isFirst = this->mStages.empty();
+    const bool background = !isFirst && partitionSize >= kBackgroundPartitionSize;
+    size_t end = length;
+    if (partitionSize < kMaxPartitionSize)
+    {
+      // Hand over to the next (bigger) stage as soon as it can hide its
+      // latency, at a multiple of its partition size.
+      const size_t nextSize = std::min(partitionSize * kGrowthFactor, kMaxPartitionSize);
+      size_t nextOffset = std::max(latency(nextSize, false), offset + partitionSize);
+      nextOffset = ((nextOffset + nextSize - 1) / nextSize) * nextSize;
+      end = std::min(end, nextOffset);
+    }
+    // offset is a multiple of partitionSize and at least the stage's latency;
+    // whatever's left over is made up with FDL delay.
+    const size_t delayPartitions = (offset - latency(partitionSize, isFirst)) / partitionSize;
+    auto stage = std::make_unique<Stage>(partitionSize, background);
+    stage->mNonRealtime = this->mNonRealtime;
+    stage->mConvolution.SetImpulseResponse(impulseResponse + offset, end - offset, delayPartitions);
+    if (background)
+      BackgroundWorker::Get().Add(stage.get());
+    this->mStages.push_back(std::move(stage));
+
+    offset = end;
+    partitionSize = std::min(partitionSize * kGrowthFactor, kMaxPartitionSize);
+  }
+}
+
+void dsp::convolution::NonUniformPartitioned::Reset()
+{
+  for (auto& stage : this->mStages)
+    stage->Reset();
+}
+
+void dsp::convolution::NonUniformPartitioned::SetNonRealtime(const bool nonRealtime)
+{
+  this->mNonRealtime = nonRealtime;
+  for (auto& stage : this->mStages)
+    stage->mNonRealtime = nonRealtime;
+}
+
+void dsp::convolution::NonUniformPartitioned::Process(const float* input, float* output, const size_t numFrames)
+{
+  std::fill(output, output + numFrames, 0.0f);
+  for (size_t done = 0; done < numFrames;)
+  {
+    const size_t count = std::min(numFrames - done, this->mStageOutput.size());
+    for (auto& stage : this->mStages)
+    {
+      stage->Process(input + done, this->mStageOutput.data(), count);
+      for (size_t i = 0; i < count; i++)
+        output[done + i] += this->mStageOutput[i];
+    }
+    done += count;
+  }
+}
+
+void dsp::convolution::NonUniformPartitioned::_ClearStages()
+{
+  for (auto& stage : this->mStages)
+    if (stage->mBackground)
+      BackgroundWorker::Get().Remove(stage.get());
+  this->mStages.clear();
+}
@@ -0,0 +1,149 @@
+//
+//  PartitionedConvolution.h
+//
+// Frequency-domain (FFT) convolution for long impulse responses.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "FFT.h"
+
+namespace dsp
+{
+namespace convolution
+{
+// Uniformly-partitioned overlap-save convolution.
+//
+// The impulse response is cut into partitions of mPartitionSize samples, and
+// the spectrum of each partition is precomputed. Incoming audio is gathered
+// into blocks of the same size; each block is transformed once and pushed
+// into a frequency-domain delay line (FDL), and the output block is the
+// inverse transform of sum_p(H_p * X_{n-p}).
+// Per sample, that's one complex multiply-accumulate per partition plus the
+// amortized cost of two FFTs of size 2 * mPartitionSize, instead of one
+// multiply-accumulate per tap for direct-form convolution.
+//
+// Output lags the input by exactly GetLatency() samples: one partition, plus
+// any extra delay requested in SetImpulseResponse().
+class UniformPartitioned
+{
+public:
+  // :param partitionSize: Must be a power of two.
+  UniformPartitioned(const size_t partitionSize);
+
+  // Set the impulse response to convolve with. Allocates; don't call from the
+  // audio thread.
+  // :param delayPartitions: Extra delay, in whole partitions, applied to the
+  //     impulse response. Costs FDL memory but no extra arithmetic.
+  void SetImpulseResponse(const float* impulseResponse, const size_t length, const size_t delayPartitions = 0);
+  // Clear the audio state (input block, FDL, pending output).
+  void Reset();
+  // Convolve numFrames samples of input into output.
+  // Any block size is fine; work is done each time a full partition's worth of
+  // input has arrived.
+  void Process(const float* input, float* output, const size_t numFrames);
+  // Lower-level interface for callers that do their own buffering: take
+  // exactly one partition of input and produce the matching partition of
+  // output.
+  void ProcessBlock(const float* input, float* output);
+
+  size_t GetLatency() const { return (1 + this->mDelayPartitions) * this->mPartitionSize; };
+  size_t GetNumPartitions() const { return this->mNumPartitions; };
+  size_t GetPartitionSize() const { return this->mPartitionSize; };
+
+private:
+  const size_t mPartitionSize;
+  // Bins per spectrum
+  const size_t mNumBins;
+  size_t mNumPartitions;
+  size_t mDelayPartitions;
+  // Number of slots in the FDL (mNumPartitions + mDelayPartitions)
+  size_t mNumSlots;
+  fft::RealFFT mFFT;
+
+  // Spectra of the IR partitions, partition-major, [mNumPartitions * mNumBins]
+  std::vector<float> mIRReal;
+  std::vector<float> mIRImag;
+  // Spectra of the past input blocks (the FDL), used as a ring buffer.
+  std::vector<float> mFDLReal;
+  std::vector<float> mFDLImag;
+  // Slot in the FDL holding the most recent input spectrum
+  size_t mFDLIndex;
+  // The previous and current input blocks, back-to-back (overlap-save window)
+  std::vector<float> mInputWindow;
+  // Output of the last completed block, handed out as the next block comes in
+  std::vector<float> mOutputBlock;
+  // Position within the current block
+  size_t mBlockPosition;
+  // Scratch for the accumulated spectrum and the inverse transform
+  std::vector<float> mAccumulatorReal;
+  std::vector<float> mAccumulatorImag;
+  std::vector<float> mTimeScratch;
+};
+
+// Zero-latency non-uniformly-partitioned convolution, for long (multi-second)
+// impulse responses.
+//
+// The taps are covered by a chain of uniformly-partitioned stages whose
+// partition size grows along the IR (e.g. 128, 512, 2048, 8192 samples). Each
+// stage starts far enough into the IR to hide its own latency, so the sum is
+// exact with no added delay, while the bulk of the IR is handled by big
+// partitions with few complex multiplies per sample.
+//
+// The first firstPartitionSize taps are *not* convolved here: the caller is
+// expected to handle them directly in the time domain (see ImpulseResponse).
+//
+// Stages with partitions of kBackgroundPartitionSize or more are computed on a
+// shared background thread. They're given kBackgroundLookahead extra
+// partitions of latency (and start correspondingly later in the IR), so that
+// the worker has that many partitions' worth of time to deliver each block.
+// The audio thread never computes or waits for them: should the worker still
+// be late, the stage drops out and starts over rather than hold it up.
+class NonUniformPartitioned
+{
+public:
+  // Partition sizes grow by this factor from one stage to the next
+  static constexpr size_t kGrowthFactor = 4;
+  // Largest partition size; the last stage is uniform at this size
+  static constexpr size_t kMaxPartitionSize = 8192;
+  // Stages at or above this size run on the background thread
+  static constexpr size_t kBackgroundPartitionSize = 2048;
+  // Extra latency of the background stages, in partitions
+  static constexpr size_t kBackgroundLookahead = 2;
+
+  // :param firstPartitionSize: Size of the smallest partition, and the number
+  //     of leading taps left for the caller. Must be a power of two.
+  NonUniformPartitioned(const size_t firstPartitionSize);
+  ~NonUniformPartitioned();
+
+  // Allocates and (un)registers background work; don't call from the audio
+  // thread.
+  void SetImpulseResponse(const float* impulseResponse, const size_t length);
+  // Waits for blocks that are being computed in the background; don't call
+  // from the audio thread.
+  void Reset();
+  // When rendering faster than real time (e.g. an offline bounce), the
+  // worker can't keep up, so the audio thread waits for the background
+  // stages instead of letting them drop out. Cheap; may be called from the
+  // audio thread.
+  void SetNonRealtime(const bool nonRealtime);
+  // Output is overwritten with the convolution of the input with taps
+  // [firstPartitionSize, length) of the impulse response, with no latency.
+  void Process(const float* input, float* output, const size_t numFrames);
+
+  size_t GetNumStages() const { return this->mStages.size(); };
+
+private:
+  struct Stage;
+  void _ClearStages();
+
+  const size_t mFirstPartitionSize;
+  bool mNonRealtime = false;
+  std::vector<std::unique_ptr<Stage>> mStages;
+  // Scratch for each stage's output before it's summed in
+  std::vector<float> mStageOutput;
+};
+}; // namespace convolution
+}; // namespace dsp
@@ -12,8 +12,9 @@
 
 #include "RecursiveLinearFilter.h"
 
-recursive_linear_filter::Base::Base(const size_t inputDegree, const size_t outputDegree)
-: dsp::DSP()
+template <typename T>
+recursive_linear_filter::Base<T>::Base(const size_t inputDegree, const size_t outputDegree)
+: dsp::DSP<T>()
 , mInputStart(inputDegree)
 , // 1 is subtracted before first use
 mOutputStart(outputDegree)
@@ -22,10 +23,27 @@ mOutputStart(outputDegree)
   this->mOutputCoefficients.resize(outputDegree);
 }
 
-DSP_SAMPLE** recursive_linear_filter::Base::Process(DSP_SAMPLE** inputs, const size_t numChannels,
-                                                    const size_t numFrames)
+template <typename T>
+T** recursive_linear_filter::Base<T>::Process(T** inputs, const size_t numChannels, const size_t numFrames)
 {
   this->_PrepareBuffers(numChannels, numFrames);
+  T** outputs = this->_GetPointers();
+  this->_Process(inputs, outputs, numChannels, numFrames);
+  return outputs;
+}
+
+template <typename T>
+void recursive_linear_filter::Base<T>::ProcessInPlace(T* const* buffers, const size_t numChannels,
+                                                      const size_t numFrames)
+{
+  this->_PrepareBuffers(numChannels, numFrames);
+  this->_Process(buffers, buffers, numChannels, numFrames);
+}
+
+template <typename T>
+void recursive_linear_filter::Base<T>::_Process(const T* const* inputs, T* const* outputs, const size_t numChannels,
+                                                const size_t numFrames)
+{
   long inputStart = 0;
   long outputStart = 0;
   // Degree = longest history
@@ -41,7 +59,7 @@ DSP_SAMPLE** recursive_linear_filter::Base::Process(DSP_SAMPLE** inputs, const s
     outputStart = this->mOutputStart;
     for (auto s = 0; s < numFrames; s++)
     {
-      DSP_SAMPLE out = 0.0;
+      T out = 0.0;
       // Compute input terms
       inputStart -= 1;
       if (inputStart < 0)
@@ -62,20 +80,20 @@ DSP_SAMPLE** recursive_linear_filter::Base::Process(DSP_SAMPLE** inputs, const s
       // Store the output!
       if (outputDegree >= 1)
         this->mOutputHistory[c][outputStart] = out;
-      this->mOutputs[c][s] = out;
+      outputs[c][s] = out;
     }
   }
   this->mInputStart = inputStart;
   this->mOutputStart = outputStart;
-  return this->_GetPointers();
 }
 
-void recursive_linear_filter::Base::_PrepareBuffers(const size_t numChannels, const size_t numFrames)
+template <typename T>
+void recursive_linear_filter::Base<T>::_PrepareBuffers(const size_t numChannels, const size_t numFrames)
 {
   // Check for new channel count *before* parent class ensures they match!
   const bool newChannels = this->_GetNumChannels() != numChannels;
   // Parent implementation takes care of mOutputs and mOutputPointers
-  this->dsp::DSP::_PrepareBuffers(numChannels, numFrames);
+  this->dsp::DSP<T>::_PrepareBuffers(numChannels, numFrames);
   if (newChannels)
   {
     this->mInputHistory.resize(numChannels);
@@ -92,7 +110,8 @@ void recursive_linear_filter::Base::_PrepareBuffers(const size_t numChannels, co
   }
 }
 
-void recursive_linear_filter::Biquad::_AssignCoefficients(const double a0, const double a1, const double a2,
+template <typename T>
+void recursive_linear_filter::Biquad<T>::_AssignCoefficients(const double a0, const double a1, const double a2,
                                                           const double b0, const double b1, const double b2)
 {
   this->mInputCoefficients[0] = b0 / a0;
@@ -104,7 +123,8 @@ void recursive_linear_filter::Biquad::_AssignCoefficients(const double a0, const
   this->mOutputCoefficients[2] = -a2 / a0;
 }
 
-void recursive_linear_filter::LowShelf::SetParams(const recursive_linear_filter::BiquadParams& params)
+template <typename T>
+void recursive_linear_filter::LowShelf<T>::SetParams(const recursive_linear_filter::BiquadParams& params)
 {
   const double a = params.GetA();
   const double omega_0 = params.GetOmega0();
@@ -125,7 +145,8 @@ void recursive_linear_filter::LowShelf::SetParams(const recursive_linear_filter:
   this->_AssignCoefficients(a0, a1, a2, b0, b1, b2);
 }
 
-void recursive_linear_filter::Peaking::SetParams(const recursive_linear_filter::BiquadParams& params)
+template <typename T>
+void recursive_linear_filter::Peaking<T>::SetParams(const recursive_linear_filter::BiquadParams& params)
 {
   const double a = params.GetA();
   const double omega_0 = params.GetOmega0();
@@ -142,7 +163,8 @@ void recursive_linear_filter::Peaking::SetParams(const recursive_linear_filter::
   this->_AssignCoefficients(a0, a1, a2, b0, b1, b2);
 }
 
-void recursive_linear_filter::HighShelf::SetParams(const recursive_linear_filter::BiquadParams& params)
+template <typename T>
+void recursive_linear_filter::HighShelf<T>::SetParams(const recursive_linear_filter::BiquadParams& params)
 {
   const double a = params.GetA();
   const double omega_0 = params.GetOmega0();
@@ -162,3 +184,14 @@ void recursive_linear_filter::HighShelf::SetParams(const recursive_linear_filter
 
   this->_AssignCoefficients(a0, a1, a2, b0, b1, b2);
 }
+
+template class recursive_linear_filter::Base<float>;
+template class recursive_linear_filter::Base<double>;
+template class recursive_linear_filter::Biquad<float>;
+template class recursive_linear_filter::Biquad<double>;
+template class recursive_linear_filter::LowShelf<float>;
+template class recursive_linear_filter::LowShelf<double>;
+template class recursive_linear_filter::Peaking<float>;
+template class recursive_linear_filter::Peaking<double>;
+template class recursive_linear_filter::HighShelf<float>;
+template class recursive_linear_filter::HighShelf<double>;
@@ -18,11 +18,13 @@
 
 namespace recursive_linear_filter
 {
-class Base : public dsp::DSP
+template <typename T = DSP_SAMPLE>
+class Base : public dsp::DSP<T>
 {
 public:
   Base(const size_t inputDegree, const size_t outputDegree);
-  DSP_SAMPLE** Process(DSP_SAMPLE** inputs, const size_t numChannels, const size_t numFrames) override;
+  T** Process(T** inputs, const size_t numChannels, const size_t numFrames) override;
+  void ProcessInPlace(T* const* buffers, const size_t numChannels, const size_t numFrames) override;
 
 protected:
   // Methods
@@ -30,6 +32,8 @@ protected:
   size_t _GetOutputDegree() const { return this->mOutputCoefficients.size(); };
   // Additionally prepares mInputHistory and mOutputHistory.
   void _PrepareBuffers(const size_t numChannels, const size_t numFrames) override;
+  // Filter inputs into outputs (which may be the inputs).
+  void _Process(const T* const* inputs, T* const* outputs, const size_t numChannels, const size_t numFrames);
 
   // Coefficients for the DSP filter
   // [0] is for the current sample
@@ -43,8 +47,8 @@ protected:
   // First index is channel
   // Second index, [0] is the current input/output, [1] is the previous, [2] is
   // before that, etc.
-  std::vector<std::vector<DSP_SAMPLE>> mInputHistory;
-  std::vector<std::vector<DSP_SAMPLE>> mOutputHistory;
+  std::vector<std::vector<T>> mInputHistory;
+  std::vector<std::vector<T>> mOutputHistory;
   // Indices for history.
   // Designates which index is currently "0". Use modulus to wrap around.
   long mInputStart;
@@ -64,11 +68,12 @@ private:
   double mGain;
 };
 
-class Level : public Base
+template <typename T = DSP_SAMPLE>
+class Level : public Base<T>
 {
 public:
   Level()
-  : Base(1, 0){};
+  : Base<T>(1, 0){};
   // Invalid usage: require a pointer to recursive_linear_filter::Params so
   // that SetCoefficients() is defined.
   void SetParams(const LevelParams& params) { this->mInputCoefficients[0] = params.GetGain(); };
@@ -101,11 +106,12 @@ private:
   double mSampleRate;
 };
 
-class Biquad : public Base
+template <typename T = DSP_SAMPLE>
+class Biquad : public Base<T>
 {
 public:
   Biquad()
-  : Base(3, 3){};
+  : Base<T>(3, 3){};
   virtual void SetParams(const BiquadParams& params) = 0;
 
 protected:
@@ -113,19 +119,22 @@ protected:
                            const double b2);
 };
 
-class LowShelf : public Biquad
+template <typename T = DSP_SAMPLE>
+class LowShelf : public Biquad<T>
 {
 public:
   void SetParams(const BiquadParams& params) override;
 };
 
-class Peaking : public Biquad
+template <typename T = DSP_SAMPLE>
+class Peaking : public Biquad<T>
 {
 public:
   void SetParams(const BiquadParams& params) override;
 };
 
-class HighShelf : public Biquad
+template <typename T = DSP_SAMPLE>
+class HighShelf : public Biquad<T>
 {
 public:
   void SetParams(const BiquadParams& params) override;
@@ -152,19 +161,20 @@ private:
   double mSampleRate;
 };
 
-class HighPass : public Base
+template <typename T = DSP_SAMPLE>
+class HighPass : public Base<T>
 {
 public:
   HighPass()
-  : Base(2, 2){};
+  : Base<T>(2, 2){};
   void SetParams(const HighPassParams& params)
   {
     const double alpha = params.GetAlpha();
     // y[i] = alpha * y[i-1] + alpha * (x[i]-x[i-1])
-    mInputCoefficients[0] = alpha;
-    mInputCoefficients[1] = -alpha;
-    mOutputCoefficients[0] = 0.0;
-    mOutputCoefficients[1] = alpha;
+    this->mInputCoefficients[0] = alpha;
+    this->mInputCoefficients[1] = -alpha;
+    this->mOutputCoefficients[0] = 0.0;
+    this->mOutputCoefficients[1] = alpha;
   }
 };
 
@@ -187,18 +197,19 @@ private:
   double mSampleRate;
 };
 
-class LowPass : public Base
+template <typename T = DSP_SAMPLE>
+class LowPass : public Base<T>
 {
 public:
   LowPass()
-  : Base(1, 2){};
+  : Base<T>(1, 2){};
   void SetParams(const LowPassParams& params)
   {
     const double alpha = params.GetAlpha();
     // y[i] = alpha * x[i] + (1-alpha) * y[i-1]
-    mInputCoefficients[0] = alpha;
-    mOutputCoefficients[0] = 0.0;
-    mOutputCoefficients[1] = 1.0 - alpha;
+    this->mInputCoefficients[0] = alpha;
+    this->mOutputCoefficients[0] = 0.0;
+    this->mOutputCoefficients[1] = 1.0 - alpha;
   }
 };
 
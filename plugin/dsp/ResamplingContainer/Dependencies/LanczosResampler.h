@@ -93,14 +93,7 @@ iPlug 2 includes the following 3rd party libraries (see each license info):
 #include <cmath>
 #include <cstring>
 
-#if defined AUDIODSPTOOLS_SIMDE
-  #if defined(__arm64__)
-    #define SIMDE_ENABLE_NATIVE_ALIASES
-    #include "simde/x86/sse2.h"
-  #else
-    #include <emmintrin.h>
-  #endif
-#endif
+#include "../LanczosKernels.h"
 
 // #include "IPlugConstants.h"
 
@@ -108,10 +101,9 @@ namespace dsp
 {
 /* LanczosResampler
  *
- * A class that implement Lanczos resampling, optionally using SIMD instructions.
- * Define AUDIODSPTOOLS_SIMDE at project level in order to use SIMD and if on non-x86_64
- * include the SIMDE library in your search paths in order to translate intel
- * intrinsics to e.g. arm64
+ * A class that implement Lanczos resampling, using SIMD instructions. The filter is
+ * applied by the best version for the CPU of dsp::lanczos's kernels (SSE or AVX2, for
+ * float or double), picked at run time; without either, by the plain loop, inlined.
  *
  * See https://en.wikipedia.org/wiki/Lanczos_resampling
  *
@@ -125,11 +117,6 @@ template <typename T = double, int NCHANS = 2, size_t A = 12>
 class LanczosResampler
 {
 private:
-#if AUDIODSPTOOLS_SIMDE
-  static_assert(std::is_same<T, float>::value, "LanczosResampler requires T to be float when using SIMD instructions");
-  static_assert(false, "SIMD version has not been checked! You need to remove this to use it at your own risk!");
-#endif
-
   // The buffer size. This needs to be at least as large as the largest block of samples
   // that the input side will see.
   // WARNING: hard-coded to accommodate 8192 samples, from 44.1 to 192k!
@@ -146,10 +133,13 @@ public:
   /** Constructor
    * @param inputRate The input sample rate
    * @param outputRate The output sample rate
+   * @param instructionSet The instruction set to use; the CPU must support it
    */
-  LanczosResampler(float inputRate, float outputRate)
+  LanczosResampler(float inputRate, float outputRate,
+                   InstructionSet instructionSet = GetInstructionSet())
   : mInputSampleRate(inputRate)
   , mOutputSampleRate(outputRate)
+  , mApplyFilter(instructionSet == InstructionSet::SCALAR ? nullptr : lanczos::GetApplyFilter<T>(instructionSet))
   {
     SetPhases();
     ClearBuffer();
@@ -246,64 +236,6 @@ public:
   void ClearBuffer() { memset(mInputBuffer, 0, NCHANS * kBufferSize * 2 * sizeof(T)); }
 
 private:
-#ifdef IPLUG_SIMDE
-  inline void ReadSamples(double xBack, T** outputs, int s) const
-  {
-    float bufferReadPosition = static_cast<float>(mWritePos - xBack);
-    int bufferReadIndex = static_cast<int>(std::floor(bufferReadPosition));
-    float bufferFracPosition = 1.0f - (bufferReadPosition - static_cast<float>(bufferReadIndex));
-
-    bufferReadIndex = (bufferReadIndex + kBufferSize) & (kBufferSize - 1);
-    bufferReadIndex += (bufferReadIndex <= static_cast<int>(A)) * kBufferSize;
-
-    float tablePosition = bufferFracPosition * kTablePoints;
-    int tableIndex = static_cast<int>(tablePosition);
-    float tableFracPosition = (tablePosition - tableIndex);
-
-    __m128 sum[NCHANS];
-    for (auto& v : sum)
-    {
-      v = _mm_setzero_ps(); // Initialize sum vectors to zero
-    }
-
-    for (int i = 0; i < A; i += 4) // Process four samples at a time
-    {
-      // Load filter coefficients and input samples into SSE registers
-      __m128 f0 = _mm_load_ps(&sTable[tableIndex][i]);
-      __m128 df0 = _mm_load_ps(&sDeltaTable[tableIndex][i]);
-      __m128 f1 = _mm_load_ps(&sTable[tableIndex][A + i]);
-      __m128 df1 = _mm_load_ps(&sDeltaTable[tableIndex][A + i]);
-
-      // Interpolate filter coefficients
-      __m128 tfp = _mm_set1_ps(tableFracPosition);
-      f0 = _mm_add_ps(f0, _mm_mul_ps(df0, tfp));
-      f1 = _mm_add_ps(f1, _mm_mul_ps(df1, tfp));
-
-      for (int c = 0; c < NCHANS; c++)
-      {
-        // Load input data
-        __m128 d0 =
-          _mm_set_ps(mInputBuffer[c][bufferReadIndex - A + i + 3], mInputBuffer[c][bufferReadIndex - A + i + 2],
-                     mInputBuffer[c][bufferReadIndex - A + i + 1], mInputBuffer[c][bufferReadIndex - A + i]);
-        __m128 d1 = _mm_set_ps(mInputBuffer[c][bufferReadIndex + i + 3], mInputBuffer[c][bufferReadIndex + i + 2],
-                               mInputBuffer[c][bufferReadIndex + i + 1], mInputBuffer[c][bufferReadIndex + i]);
-
-        // Perform multiplication and accumulate
-        __m128 result0 = _mm_mul_ps(f0, d0);
-        __m128 result1 = _mm_mul_ps(f1, d1);
-        sum[c] = _mm_add_ps(sum[c], _mm_add_ps(result0, result1));
-      }
-    }
-
-    // Extract the final sums and store them in the output
-    for (int c = 0; c < NCHANS; c++)
-    {
-      float sumArray[4];
-      _mm_store_ps(sumArray, sum[c]);
-      outputs[c][s] = sumArray[0] + sumArray[1] + sumArray[2] + sumArray[3];
-    }
-  }
-#else // scalar
   inline void ReadSamples(double xBack, T** outputs, int s) const
   {
     double bufferReadPosition = mWritePos - xBack;
@@ -317,24 +249,27 @@ private:
     int tableIndex = static_cast<int>(tablePosition);
     double tableFracPosition = (tablePosition - tableIndex);
 
-    T sum[NCHANS] = {0.0};
-
-    for (auto i = 0; i < A; i++)
+    // The 2A samples around the read position are contiguous, thanks to the mirrored buffer
+    const T* windows[NCHANS];
+    for (auto c = 0; c < NCHANS; c++)
     {
-      auto f0 = sTable[tableIndex][i];
-      const auto df0 = sDeltaTable[tableIndex][i];
-      f0 += df0 * tableFracPosition;
-
-      auto f1 = sTable[tableIndex][A + i];
-      const auto df1 = sDeltaTable[tableIndex][A + i];
-      f1 += df1 * tableFracPosition;
-
+      windows[c] = &mInputBuffer[c][bufferReadIndex - A];
+    }
+    T sum[NCHANS];
+    if (mApplyFilter != nullptr)
+    {
+      mApplyFilter(sTable[tableIndex], sDeltaTable[tableIndex], T(tableFracPosition), windows, NCHANS, kFilterWidth, sum);
+    }
+    else
+    {
+      const T tableFrac = T(tableFracPosition);
       for (auto c = 0; c < NCHANS; c++)
       {
-        const auto d0 = mInputBuffer[c][bufferReadIndex - A + i];
-        const auto d1 = mInputBuffer[c][bufferReadIndex + i];
-        const auto rv = (f0 * d0) + (f1 * d1);
-        sum[c] += rv;
+        sum[c] = 0.0;
+        for (size_t i = 0; i < kFilterWidth; i++)
+        {
+          sum[c] += (sTable[tableIndex][i] + sDeltaTable[tableIndex][i] * tableFrac) * windows[c][i];
+        }
       }
     }
 
@@ -343,7 +278,6 @@ private:
       outputs[c][s] = sum[c];
     }
   }
-#endif
   void SetPhases()
   {
     // This is going to assume I can treat the sample rates as longs...
@@ -388,6 +322,9 @@ private:
   int mWritePos = 0;
   const float mInputSampleRate;
   const float mOutputSampleRate;
+  // Applies the filter to the input window; nullptr for the scalar version, which
+  // ReadSamples() runs inline rather than through a call per sample
+  const lanczos::ApplyFilterFunc<T> mApplyFilter;
   // Phase is treated as rational numbers to ensure floating point errors don't accumulate and we stay exactly on.
   // (Issue 15)
   long mPhaseInNumerator = 0;
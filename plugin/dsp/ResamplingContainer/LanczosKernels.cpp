@@ -0,0 +1,156 @@
+// File: LanczosKernels.cpp
+
+#include "../SimdTargets.h"
+#include "LanczosKernels.h"
+
+namespace
+{
+template <typename T>
+void ApplyFilterScalar(const T* table, const T* deltaTable, const T tableFrac, const T* const* windows,
+                       const int numChannels, const size_t width, T* sums)
+{
+  for (int c = 0; c < numChannels; c++)
+  {
+    T sum = 0.0;
+    for (size_t i = 0; i < width; i++)
+    {
+      sum += (table[i] + deltaTable[i] * tableFrac) * windows[c][i];
+    }
+    sums[c] = sum;
+  }
+}
+
+#if DSP_KERNELS_X86
+
+// SSE: 4 floats or 2 doubles a vector, no FMA. The windows start anywhere, so all loads are unaligned (as fast as
+// aligned ones on anything with SSE4.1).
+
+DSP_TARGET_SSE41 void ApplyFilterSSE41(const float* table, const float* deltaTable, const float tableFrac,
+                                       const float* const* windows, const int numChannels, const size_t width,
+                                       float* sums)
+{
+  const __m128 frac = _mm_set1_ps(tableFrac);
+  for (int c = 0; c < numChannels; c++)
+  {
+    __m128 acc = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= width; i += 4)
+    {
+      const __m128 f = _mm_add_ps(_mm_loadu_ps(table + i), _mm_mul_ps(_mm_loadu_ps(deltaTable + i), frac));
+      acc = _mm_add_ps(acc, _mm_mul_ps(f, _mm_loadu_ps(windows[c] + i)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    float sum = _mm_cvtss_f32(acc);
+    for (; i < width; i++)
+    {
+      sum += (table[i] + deltaTable[i] * tableFrac) * windows[c][i];
+    }
+    sums[c] = sum;
+  }
+}
+
+DSP_TARGET_SSE41 void ApplyFilterSSE41(const double* table, const double* deltaTable, const double tableFrac,
+                                       const double* const* windows, const int numChannels, const size_t width,
+                                       double* sums)
+{
+  const __m128d frac = _mm_set1_pd(tableFrac);
+  for (int c = 0; c < numChannels; c++)
+  {
+    __m128d acc = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 2 <= width; i += 2)
+    {
+      const __m128d f = _mm_add_pd(_mm_loadu_pd(table + i), _mm_mul_pd(_mm_loadu_pd(deltaTable + i), frac));
+      acc = _mm_add_pd(acc, _mm_mul_pd(f, _mm_loadu_pd(windows[c] + i)));
+    }
+    double sum = _mm_cvtsd_f64(_mm_add_sd(acc, _mm_unpackhi_pd(acc, acc)));
+    for (; i < width; i++)
+    {
+      sum += (table[i] + deltaTable[i] * tableFrac) * windows[c][i];
+    }
+    sums[c] = sum;
+  }
+}
+
+// AVX2 with FMA: 8 floats or 4 doubles a vector
+
+DSP_TARGET_AVX2 void ApplyFilterAVX2(const float* table, const float* deltaTable, const float tableFrac,
+                                     const float* const* windows, const int numChannels, const size_t width,
+                                     float* sums)
+{
+  const __m256 frac = _mm256_set1_ps(tableFrac);
+  for (int c = 0; c < numChannels; c++)
+  {
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= width; i += 8)
+    {
+      const __m256 f = _mm256_fmadd_ps(_mm256_loadu_ps(deltaTable + i), frac, _mm256_loadu_ps(table + i));
+      acc = _mm256_fmadd_ps(f, _mm256_loadu_ps(windows[c] + i), acc);
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    float sum = _mm_cvtss_f32(half);
+    for (; i < width; i++)
+    {
+      sum += (table[i] + deltaTable[i] * tableFrac) * windows[c][i];
+    }
+    sums[c] = sum;
+  }
+}
+
+DSP_TARGET_AVX2 void ApplyFilterAVX2(const double* table, const double* deltaTable, const double tableFrac,
+                                     const double* const* windows, const int numChannels, const size_t width,
+                                     double* sums)
+{
+  const __m256d frac = _mm256_set1_pd(tableFrac);
+  for (int c = 0; c < numChannels; c++)
+  {
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= width; i += 4)
+    {
+      const __m256d f = _mm256_fmadd_pd(_mm256_loadu_pd(deltaTable + i), frac, _mm256_loadu_pd(table + i));
+      acc = _mm256_fmadd_pd(f, _mm256_loadu_pd(windows[c] + i), acc);
+    }
+    const __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; i < width; i++)
+    {
+      sum += (table[i] + deltaTable[i] * tableFrac) * windows[c][i];
+    }
+    sums[c] = sum;
+  }
+}
+
+#endif
+
+template <typename T>
+dsp::lanczos::ApplyFilterFunc<T> GetApplyFilterFor(const dsp::lanczos::InstructionSet instructionSet)
+{
+#if DSP_KERNELS_X86
+  switch (instructionSet)
+  {
+    case dsp::lanczos::InstructionSet::SSE41: return ApplyFilterSSE41;
+    case dsp::lanczos::InstructionSet::AVX2: return ApplyFilterAVX2;
+    default: return ApplyFilterScalar<T>;
+  }
+#else
+  return ApplyFilterScalar<T>;
+#endif
+}
+} // namespace
+
+template <>
+dsp::lanczos::ApplyFilterFunc<float> dsp::lanczos::GetApplyFilter<float>(const InstructionSet instructionSet)
+{
+  return GetApplyFilterFor<float>(instructionSet);
+}
+
+template <>
+dsp::lanczos::ApplyFilterFunc<double> dsp::lanczos::GetApplyFilter<double>(const InstructionSet instructionSet)
+{
+  return GetApplyFilterFor<double>(instructionSet);
+}
@@ -0,0 +1,33 @@
+// File: LanczosKernels.h
+
+// Hand-vectorized versions of LanczosResampler's inner loop, for each x86 instruction set worth having a version for
+// (see dsp::GetInstructionSet(), which picks the one to use).
+
+#pragma once
+
+#include <cstddef>
+
+#include "../InstructionSet.h"
+
+namespace dsp
+{
+namespace lanczos
+{
+using dsp::InstructionSet;
+
+// For each of numChannels windows of width contiguous input samples, the sum over i of
+// (table[i] + deltaTable[i] * tableFrac) * windows[c][i], into sums[c]: the filter interpolated from its table, applied
+// to the input.
+template <typename T>
+using ApplyFilterFunc = void (*)(const T* table, const T* deltaTable, const T tableFrac, const T* const* windows,
+                                 const int numChannels, const size_t width, T* sums);
+
+// The version for an instruction set, which must be supported (see dsp::GetInstructionSet())
+template <typename T>
+ApplyFilterFunc<T> GetApplyFilter(const InstructionSet instructionSet);
+template <>
+ApplyFilterFunc<float> GetApplyFilter<float>(const InstructionSet instructionSet);
+template <>
+ApplyFilterFunc<double> GetApplyFilter<double>(const InstructionSet instructionSet);
+} // namespace lanczos
+} // namespace dsp
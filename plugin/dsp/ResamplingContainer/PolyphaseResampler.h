@@ -0,0 +1,219 @@
+// File: PolyphaseResampler.h
+
+// A fixed-ratio polyphase FIR resampler for sample rates in a small rational ratio, such as 44.1k or 96k to and from
+// 48k.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <Eigen/Dense>
+
+namespace dsp
+{
+/* PolyphaseResampler
+ *
+ * Resamples by L/M, where inputRate * L == outputRate * M, as upsampling by L, low-pass filtering, then downsampling
+ * by M, without computing the samples that are thrown away: each output sample is one dot product of KTAPS input
+ * samples with one of L precomputed sets of coefficients (the "phases" of the filter). Unlike LanczosResampler, no
+ * coefficients are interpolated at run time, and the dot products are vectorized (by Eigen).
+ *
+ * The filter is a Kaiser-windowed sinc that cuts off below the lower of the two Nyquist frequencies, so it
+ * anti-aliases when downsampling too. It's centered on each output sample, so like LanczosResampler it waits for
+ * KTAPS/2 input samples past it, and otherwise adds no delay.
+ *
+ * Same interface as LanczosResampler.
+ *
+ * @tparam T the sampletype
+ * @tparam NCHANS the number of channels
+ * @tparam KTAPS the number of input samples each output sample is computed from
+ */
+template <typename T = double, int NCHANS = 2, int KTAPS = 24>
+class PolyphaseResampler
+{
+private:
+  static_assert(KTAPS % 2 == 0, "PolyphaseResampler needs an even number of taps");
+  // The buffer size, as for LanczosResampler: enough for 8192 samples, from 44.1 to 192k
+  static constexpr size_t kBufferSize = 131072;
+  // Kaiser window parameter: about 70dB of stop band attenuation
+  static constexpr double kBeta = 7.0;
+  // Cutoff, relative to the lower Nyquist frequency
+  static constexpr double kCutoff = 0.92;
+
+public:
+  // The most phases (L) that are worth precomputing; covers 44.1k, 88.2k, 96k, 176.4k, 192k... to and from 48k
+  static constexpr long kMaxPhases = 160;
+
+  // Whether the ratio between the two rates is small enough for this resampler
+  static bool Supports(double inputRate, double outputRate)
+  {
+    long l, m;
+    return GetRatio(inputRate, outputRate, l, m) && l <= kMaxPhases;
+  }
+
+  /** Constructor
+   * @param inputRate The input sample rate
+   * @param outputRate The output sample rate, such that Supports(inputRate, outputRate)
+   */
+  PolyphaseResampler(double inputRate, double outputRate)
+  {
+    if (!GetRatio(inputRate, outputRate, mUp, mDown) || mUp > kMaxPhases)
+    {
+      throw std::runtime_error("Unsupported ratio for the polyphase resampler!");
+    }
+    // Up sampled samples from the start of the filter to its center, where the output sample is
+    mCenter = mUp * KTAPS / 2;
+    SetCoefficients();
+    ClearBuffer();
+  }
+
+  inline size_t GetNumSamplesRequiredFor(size_t nOutputSamples) const
+  {
+    if (nOutputSamples == 0)
+    {
+      return 0;
+    }
+    // The last output sample reads up to this input sample
+    const long lastInput = (mPhaseOut + (long)(nOutputSamples - 1) * mDown + mCenter) / mUp;
+    return (size_t)std::max(lastInput + 1 - mNumInputs, 0L);
+  }
+
+  inline void PushBlock(T** inputs, size_t nFrames)
+  {
+    for (size_t s = 0; s < nFrames; s++)
+    {
+      for (int c = 0; c < NCHANS; c++)
+      {
+        mInputBuffer[c][mWritePos] = inputs[c][s];
+        mInputBuffer[c][mWritePos + kBufferSize] = inputs[c][s]; // this way every window is contiguous
+      }
+      mWritePos = (mWritePos + 1) & (kBufferSize - 1);
+    }
+    mNumInputs += (long)nFrames;
+  }
+
+  size_t PopBlock(T** outputs, size_t max)
+  {
+    using Window = Eigen::Map<const Eigen::Matrix<T, KTAPS, 1>>;
+    using Coefficients = Eigen::Map<const Eigen::Matrix<T, KTAPS, 1>, Eigen::Aligned16>;
+
+    size_t populated = 0;
+    while (populated < max)
+    {
+      const long position = mPhaseOut + mCenter;
+      const long lastInput = position / mUp;
+      if (lastInput >= mNumInputs)
+      {
+        break;
+      }
+      const Coefficients coefficients(mCoefficients.data() + (position % mUp) * KTAPS);
+      // The window is the KTAPS samples up to and including lastInput
+      const long windowStart =
+        ((long)mWritePos - (mNumInputs - lastInput) - (KTAPS - 1) + 2 * (long)kBufferSize) & (kBufferSize - 1);
+      for (int c = 0; c < NCHANS; c++)
+      {
+        outputs[c][populated] = coefficients.dot(Window(mInputBuffer[c] + windowStart));
+      }
+      mPhaseOut += mDown;
+      populated++;
+    }
+    return populated;
+  }
+
+  inline void RenormalizePhases()
+  {
+    const long consumed = mPhaseOut / mUp;
+    mPhaseOut -= consumed * mUp;
+    mNumInputs -= consumed;
+  }
+
+  void Reset() { ClearBuffer(); }
+
+  void ClearBuffer() { memset(mInputBuffer, 0, NCHANS * kBufferSize * 2 * sizeof(T)); }
+
+private:
+  // The ratio L/M in lowest terms if both rates are whole numbers
+  static bool GetRatio(double inputRate, double outputRate, long& up, long& down)
+  {
+    if (inputRate <= 0.0 || outputRate <= 0.0 || std::floor(inputRate) != inputRate
+        || std::floor(outputRate) != outputRate)
+    {
+      return false;
+    }
+    long a = (long)outputRate, b = (long)inputRate;
+    while (b != 0)
+    {
+      const long temp = b;
+      b = a % b;
+      a = temp;
+    }
+    up = (long)outputRate / a;
+    down = (long)inputRate / a;
+    return true;
+  }
+
+  static double BesselI0(double x)
+  {
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; k < 50; k++)
+    {
+      term *= (x / (2.0 * k)) * (x / (2.0 * k));
+      sum += term;
+    }
+    return sum;
+  }
+
+  // Designs the filter at the up sampled rate and splits it into its phases. Phase p's coefficients are stored in
+  // the order of the input window they multiply (oldest sample first), each set aligned for vector loads.
+  void SetCoefficients()
+  {
+    const long length = mUp * KTAPS;
+    // Cutoff in cycles per up sampled sample
+    const double cutoff = 0.5 * kCutoff / (double)std::max(mUp, mDown);
+    std::vector<double> filter(length);
+    for (long k = 0; k < length; k++)
+    {
+      const double x = (double)(k - mCenter);
+      const double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * M_PI * cutoff * x) / (2.0 * M_PI * cutoff * x);
+      const double r = x / (double)mCenter;
+      const double window = r * r < 1.0 ? BesselI0(kBeta * std::sqrt(1.0 - r * r)) / BesselI0(kBeta) : 0.0;
+      filter[k] = sinc * window;
+    }
+
+    mCoefficients.assign(mUp * KTAPS, T(0));
+    for (long p = 0; p < mUp; p++)
+    {
+      // Input sample lastInput - j is multiplied by filter[p + j * L]; normalize each phase to unity gain so that DC
+      // passes unchanged whatever the phase.
+      double sum = 0.0;
+      for (int j = 0; j < KTAPS; j++)
+      {
+        sum += filter[p + j * mUp];
+      }
+      for (int j = 0; j < KTAPS; j++)
+      {
+        mCoefficients[p * KTAPS + (KTAPS - 1 - j)] = T(filter[p + j * mUp] / sum);
+      }
+    }
+  }
+
+  T mInputBuffer[NCHANS][kBufferSize * 2];
+  size_t mWritePos = 0;
+  // The coefficients of each phase, KTAPS apart
+  std::vector<T, Eigen::aligned_allocator<T>> mCoefficients;
+  // Up and down sampling factors (L and M)
+  long mUp = 1;
+  long mDown = 1;
+  long mCenter = 0;
+  // Input samples pushed, and the position of the next output sample at the up sampled rate, both since the last
+  // RenormalizePhases(). Integers, so that the phase stays exact.
+  long mNumInputs = 0;
+  long mPhaseOut = 0;
+};
+
+} // namespace dsp
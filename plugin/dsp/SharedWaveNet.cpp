@@ -0,0 +1,892 @@
+//
+//  SharedWaveNet.cpp
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include "SharedWaveNet.h"
+
+namespace
+{
+// Fast tanh, see dsp::wavenet::ActivationAccuracy::FAST
+struct FastTanhOp
+{
+  float operator()(const float value) const
+  {
+    using namespace dsp::wavenet::kernels;
+    const float x = std::min(std::max(value, -kFastTanhClamp), kFastTanhClamp);
+    const float x2 = x * x;
+    const float p = ((kFastTanhP[3] * x2 + kFastTanhP[2]) * x2 + kFastTanhP[1]) * x2 + kFastTanhP[0];
+    const float q = ((kFastTanhQ[3] * x2 + kFastTanhQ[2]) * x2 + kFastTanhQ[1]) * x2 + kFastTanhQ[0];
+    return x * p / q;
+  };
+  template <typename Packet>
+  Packet packetOp(const Packet& value) const
+  {
+    using namespace dsp::wavenet::kernels;
+    using namespace Eigen::internal;
+    const Packet x = pmax(pmin(value, pset1<Packet>(kFastTanhClamp)), pset1<Packet>(-kFastTanhClamp));
+    const Packet x2 = pmul(x, x);
+    Packet p = pset1<Packet>(kFastTanhP[3]);
+    Packet q = pset1<Packet>(kFastTanhQ[3]);
+    for (int k = 2; k >= 0; k--)
+    {
+      p = pmadd(p, x2, pset1<Packet>(kFastTanhP[k]));
+      q = pmadd(q, x2, pset1<Packet>(kFastTanhQ[k]));
+    }
+    return pdiv(pmul(x, p), q);
+  };
+};
+}; // namespace
+
+namespace Eigen
+{
+namespace internal
+{
+// Lets Eigen vectorize FastTanhOp
+template <>
+struct functor_traits<FastTanhOp>
+{
+  enum
+  {
+    Cost = 10 * NumTraits<float>::MulCost,
+    PacketAccess = packet_traits<float>::HasDiv
+  };
+};
+}; // namespace internal
+}; // namespace Eigen
+
+namespace
+{
+dsp::wavenet::Activation ParseActivation(const std::string& name)
+{
+  if (name == "Tanh")
+    return dsp::wavenet::Activation::TANH;
+  if (name == "Fasttanh")
+    return dsp::wavenet::Activation::FAST_TANH;
+  if (name == "Hardtanh")
+    return dsp::wavenet::Activation::HARD_TANH;
+  if (name == "ReLU")
+    return dsp::wavenet::Activation::RELU;
+  if (name == "Sigmoid")
+    return dsp::wavenet::Activation::SIGMOID;
+  std::stringstream ss;
+  ss << "Unsupported WaveNet activation " << name;
+  throw std::runtime_error(ss.str());
+}
+
+// Same approximation as nam::activations::fast_tanh
+inline float FastTanh(const float x)
+{
+  const float ax = std::fabs(x);
+  const float x2 = x * x;
+  return (x * (2.45550750702956f + 2.45550750702956f * ax + (0.893229853513558f + 0.821226666969744f * ax) * x2)
+          / (2.44506634652299f + (2.44506634652299f + x2) * std::fabs(x + 0.814642734961073f * x * ax)));
+}
+
+template <typename Derived>
+void ApplyActivation(const dsp::wavenet::Activation activation, const dsp::wavenet::ActivationAccuracy accuracy,
+                     Eigen::MatrixBase<Derived>& x)
+{
+  if (accuracy == dsp::wavenet::ActivationAccuracy::FAST)
+  {
+    if (activation == dsp::wavenet::Activation::TANH)
+    {
+      x = x.unaryExpr(FastTanhOp());
+      return;
+    }
+    if (activation == dsp::wavenet::Activation::SIGMOID)
+    {
+      // sigmoid(x) = (1 + tanh(x / 2)) / 2
+      x = (0.5f * x).unaryExpr(FastTanhOp());
+      x.array() = 0.5f * x.array() + 0.5f;
+      return;
+    }
+  }
+  switch (activation)
+  {
+    case dsp::wavenet::Activation::TANH: x = x.array().tanh().matrix(); break;
+    case dsp::wavenet::Activation::FAST_TANH: x = x.unaryExpr([](const float v) { return FastTanh(v); }); break;
+    case dsp::wavenet::Activation::HARD_TANH: x = x.array().max(-1.0f).min(1.0f).matrix(); break;
+    case dsp::wavenet::Activation::RELU: x = x.array().max(0.0f).matrix(); break;
+    case dsp::wavenet::Activation::SIGMOID: x = (1.0f + (-x.array()).exp()).inverse().matrix(); break;
+  }
+}
+
+// Reads weights off the flat vector in order, with bounds checking.
+class WeightReader
+{
+public:
+  WeightReader(const std::vector<float>& weights)
+  : mWeights(weights)
+  , mPosition(0){};
+
+  float Next()
+  {
+    if (this->mPosition >= this->mWeights.size())
+      throw std::runtime_error("Model has fewer weights than its config requires");
+    return this->mWeights[this->mPosition++];
+  };
+  // Row-major, like nam::Conv1x1
+  void Read(Eigen::MatrixXf& matrix)
+  {
+    for (long i = 0; i < matrix.rows(); i++)
+      for (long j = 0; j < matrix.cols(); j++)
+        matrix(i, j) = this->Next();
+  };
+  void Read(Eigen::VectorXf& vector)
+  {
+    for (long i = 0; i < vector.size(); i++)
+      vector(i) = this->Next();
+  };
+  void Read(dsp::wavenet::Weights::Matrix& matrix, const long rows, const long cols)
+  {
+    matrix.mRows = rows;
+    matrix.mCols = cols;
+    matrix.mFloat.resize(rows, cols);
+    this->Read(matrix.mFloat);
+  };
+  bool AtEnd() const { return this->mPosition == this->mWeights.size(); };
+
+private:
+  const std::vector<float>& mWeights;
+  size_t mPosition;
+};
+
+// Call f on every weight matrix of the layer arrays
+template <typename LayerArrays, typename Function>
+void ForEachMatrix(LayerArrays& layerArrays, Function f)
+{
+  for (auto& layerArray : layerArrays)
+  {
+    f(layerArray.mRechannel);
+    for (auto& layer : layerArray.mLayers)
+    {
+      for (auto& conv : layer.mConv)
+        f(conv);
+      f(layer.mInputMixin);
+      f(layer.mOneByOne);
+    }
+    f(layerArray.mHeadRechannel);
+  }
+}
+
+// Symmetric per-row quantization: each row (output channel) gets the scale
+// that maps its largest weight to +-127.
+void Quantize(dsp::wavenet::Weights::Matrix& matrix)
+{
+  if (!matrix.mQuantized.empty())
+    return;
+  matrix.mScales.resize(matrix.mRows);
+  matrix.mQuantized.resize(matrix.mRows * matrix.mCols);
+  for (long i = 0; i < matrix.mRows; i++)
+  {
+    const float maxAbs = matrix.mCols > 0 ? matrix.mFloat.row(i).cwiseAbs().maxCoeff() : 0.0f;
+    const float scale = maxAbs > 0.0f ? maxAbs / 127.0f : 1.0f;
+    matrix.mScales(i) = scale;
+    for (long j = 0; j < matrix.mCols; j++)
+      matrix.mQuantized[j * matrix.mRows + i] = (int8_t)std::clamp(std::lround(matrix.mFloat(i, j) / scale), -127L, 127L);
+  }
+  matrix.mFloat.resize(0, 0);
+}
+
+float GetElement(const dsp::wavenet::Weights::Matrix& matrix, const long i, const long j)
+{
+  if (matrix.mQuantized.empty())
+    return matrix.mFloat(i, j);
+  return matrix.mScales(i) * (float)matrix.mQuantized[j * matrix.mRows + i];
+}
+
+void Dequantize(dsp::wavenet::Weights::Matrix& matrix)
+{
+  if (matrix.mQuantized.empty())
+    return;
+  matrix.mFloat.resize(matrix.mRows, matrix.mCols);
+  for (long i = 0; i < matrix.mRows; i++)
+    for (long j = 0; j < matrix.mCols; j++)
+      matrix.mFloat(i, j) = GetElement(matrix, i, j);
+  std::vector<int8_t>().swap(matrix.mQuantized);
+  matrix.mScales.resize(0);
+}
+}; // namespace
+
+dsp::wavenet::Weights::Weights(const nlohmann::json& config, const std::vector<float>& weights,
+                               const double expectedSampleRate)
+: mHeadScale(1.0f)
+, mExpectedSampleRate(expectedSampleRate)
+, mPrecision(Precision::FLOAT32)
+{
+  if (config.find("head") != config.end() && !config["head"].is_null())
+    throw std::runtime_error("WaveNet head is not supported");
+  const nlohmann::json& layerArrays = config.at("layers");
+  WeightReader reader(weights);
+  for (size_t a = 0; a < layerArrays.size(); a++)
+  {
+    const nlohmann::json& params = layerArrays[a];
+    LayerArray layerArray;
+    layerArray.mInputSize = params.at("input_size");
+    layerArray.mConditionSize = params.at("condition_size");
+    layerArray.mHeadSize = params.at("head_size");
+    layerArray.mChannels = params.at("channels");
+    layerArray.mKernelSize = params.at("kernel_size");
+    layerArray.mActivation = ParseActivation(params.at("activation").get<std::string>());
+    layerArray.mGated = params.at("gated");
+    const bool headBias = params.at("head_bias");
+    const std::vector<int> dilations = params.at("dilations").get<std::vector<int>>();
+    if (layerArray.mConditionSize != 1)
+      throw std::runtime_error("Only mono-conditioned WaveNets are supported");
+    if (a == 0 && layerArray.mInputSize != 1)
+      throw std::runtime_error("First WaveNet layer array must take a single input channel");
+    if (a > 0)
+    {
+      const LayerArray& previous = this->mLayerArrays.back();
+      if (layerArray.mInputSize != previous.mChannels || layerArray.mChannels != previous.mHeadSize)
+      {
+        std::stringstream ss;
+        ss << "Layer array " << a << " doesn't fit the output of layer array " << a - 1;
+        throw std::runtime_error(ss.str());
+      }
+    }
+
+    const int channels = layerArray.mChannels;
+    const int convChannels = layerArray.mGated ? 2 * channels : channels;
+    reader.Read(layerArray.mRechannel, channels, layerArray.mInputSize);
+    layerArray.mMaxLookback = 0;
+    layerArray.mReceptiveField = 0;
+    for (const int dilation : dilations)
+    {
+      Layer layer;
+      layer.mDilation = dilation;
+      layer.mConv.resize(layerArray.mKernelSize);
+      for (Matrix& conv : layer.mConv)
+      {
+        conv.mRows = convChannels;
+        conv.mCols = channels;
+        conv.mFloat.resize(convChannels, channels);
+      }
+      // Same ordering as nam::Conv1D::set_weights_: (out, in, tap)
+      for (int i = 0; i < convChannels; i++)
+        for (int j = 0; j < channels; j++)
+          for (int k = 0; k < layerArray.mKernelSize; k++)
+            layer.mConv[k].mFloat(i, j) = reader.Next();
+      layer.mConvBias.resize(convChannels);
+      reader.Read(layer.mConvBias);
+      reader.Read(layer.mInputMixin, convChannels, layerArray.mConditionSize);
+      reader.Read(layer.mOneByOne, channels, channels);
+      layer.mOneByOneBias.resize(channels);
+      reader.Read(layer.mOneByOneBias);
+
+      const long lookback = (long)(layerArray.mKernelSize - 1) * dilation;
+      layerArray.mMaxLookback = std::max(layerArray.mMaxLookback, lookback);
+      layerArray.mReceptiveField += lookback;
+      layerArray.mLayers.push_back(std::move(layer));
+    }
+    if (layerArray.mLayers.empty())
+      throw std::runtime_error("WaveNet layer array has no layers");
+    reader.Read(layerArray.mHeadRechannel, layerArray.mHeadSize, channels);
+    if (headBias)
+    {
+      layerArray.mHeadRechannelBias.resize(layerArray.mHeadSize);
+      reader.Read(layerArray.mHeadRechannelBias);
+    }
+    this->mLayerArrays.push_back(std::move(layerArray));
+  }
+  if (this->mLayerArrays.empty() || this->mLayerArrays.back().mHeadSize != 1)
+    throw std::runtime_error("WaveNet must end in a single output channel");
+  this->mHeadScale = reader.Next();
+  if (!reader.AtEnd())
+    throw std::runtime_error("Model has more weights than its config requires");
+}
+
+dsp::wavenet::Weights::Weights(const Weights& other, const Precision precision)
+: Weights(other)
+{
+  this->mPrecision = precision;
+  if (precision == Precision::INT8)
+    ForEachMatrix(this->mLayerArrays, Quantize);
+  else
+    ForEachMatrix(this->mLayerArrays, Dequantize);
+}
+
+long dsp::wavenet::Weights::GetPrewarmSamples() const
+{
+  long result = 1;
+  for (const LayerArray& layerArray : this->mLayerArrays)
+    result += layerArray.mReceptiveField;
+  return result;
+}
+
+size_t dsp::wavenet::Weights::GetSizeInBytes() const
+{
+  size_t result = 0;
+  ForEachMatrix(this->mLayerArrays, [&result](const Matrix& matrix) {
+    result += matrix.mFloat.size() * sizeof(float) + matrix.mQuantized.size() * sizeof(int8_t)
+              + matrix.mScales.size() * sizeof(float);
+  });
+  for (const LayerArray& layerArray : this->mLayerArrays)
+  {
+    for (const Layer& layer : layerArray.mLayers)
+      result += (layer.mConvBias.size() + layer.mOneByOneBias.size()) * sizeof(float);
+    result += layerArray.mHeadRechannelBias.size() * sizeof(float);
+  }
+  return result;
+}
+
+namespace
+{
+template <typename Derived>
+void Lerp(Eigen::PlainObjectBase<Derived>& dst, const Eigen::PlainObjectBase<Derived>& a,
+          const Eigen::PlainObjectBase<Derived>& b, const float t)
+{
+  dst = a + t * (b - a);
+}
+
+void Lerp(dsp::wavenet::Weights::Matrix& dst, const dsp::wavenet::Weights::Matrix& a,
+          const dsp::wavenet::Weights::Matrix& b, const float t)
+{
+  if (a.mQuantized.empty() && b.mQuantized.empty())
+  {
+    Lerp(dst.mFloat, a.mFloat, b.mFloat, t);
+    return;
+  }
+  for (long j = 0; j < dst.mCols; j++)
+    for (long i = 0; i < dst.mRows; i++)
+    {
+      const float x = GetElement(a, i, j);
+      dst.mFloat(i, j) = x + t * (GetElement(b, i, j) - x);
+    }
+}
+}; // namespace
+
+bool dsp::wavenet::Weights::HasSameTopology(const Weights& other) const
+{
+  if (this->mLayerArrays.size() != other.mLayerArrays.size())
+    return false;
+  for (size_t a = 0; a < this->mLayerArrays.size(); a++)
+  {
+    const LayerArray& x = this->mLayerArrays[a];
+    const LayerArray& y = other.mLayerArrays[a];
+    if (x.mInputSize != y.mInputSize || x.mConditionSize != y.mConditionSize || x.mHeadSize != y.mHeadSize
+        || x.mChannels != y.mChannels || x.mKernelSize != y.mKernelSize || x.mActivation != y.mActivation
+        || x.mGated != y.mGated || x.mLayers.size() != y.mLayers.size()
+        || x.mHeadRechannelBias.size() != y.mHeadRechannelBias.size())
+      return false;
+    for (size_t l = 0; l < x.mLayers.size(); l++)
+      if (x.mLayers[l].mDilation != y.mLayers[l].mDilation)
+        return false;
+  }
+  return this->mExpectedSampleRate == other.mExpectedSampleRate;
+}
+
+void dsp::wavenet::Weights::Interpolate(const Weights& a, const Weights& b, const float t)
+{
+  for (size_t i = 0; i < this->mLayerArrays.size(); i++)
+  {
+    LayerArray& dst = this->mLayerArrays[i];
+    const LayerArray& x = a.mLayerArrays[i];
+    const LayerArray& y = b.mLayerArrays[i];
+    Lerp(dst.mRechannel, x.mRechannel, y.mRechannel, t);
+    for (size_t l = 0; l < dst.mLayers.size(); l++)
+    {
+      Layer& layer = dst.mLayers[l];
+      for (size_t k = 0; k < layer.mConv.size(); k++)
+        Lerp(layer.mConv[k], x.mLayers[l].mConv[k], y.mLayers[l].mConv[k], t);
+      Lerp(layer.mConvBias, x.mLayers[l].mConvBias, y.mLayers[l].mConvBias, t);
+      Lerp(layer.mInputMixin, x.mLayers[l].mInputMixin, y.mLayers[l].mInputMixin, t);
+      Lerp(layer.mOneByOne, x.mLayers[l].mOneByOne, y.mLayers[l].mOneByOne, t);
+      Lerp(layer.mOneByOneBias, x.mLayers[l].mOneByOneBias, y.mLayers[l].mOneByOneBias, t);
+    }
+    Lerp(dst.mHeadRechannel, x.mHeadRechannel, y.mHeadRechannel, t);
+    if (dst.mHeadRechannelBias.size() > 0)
+      Lerp(dst.mHeadRechannelBias, x.mHeadRechannelBias, y.mHeadRechannelBias, t);
+  }
+  this->mHeadScale = a.mHeadScale + t * (b.mHeadScale - a.mHeadScale);
+}
+
+dsp::wavenet::WaveNet::WaveNet(std::shared_ptr<const Weights> weights, const int numChannels)
+: nam::DSP(weights->GetExpectedSampleRate())
+, mWeights(std::move(weights))
+, mNumChannels(numChannels)
+, mActivationAccuracy(ActivationAccuracy::EXACT)
+, mKernels(kernels::GetKernels(kernels::GetInstructionSet()))
+{
+  if (numChannels < 1 || numChannels > kMaxChannels)
+  {
+    std::stringstream ss;
+    ss << "WaveNet can run 1 to " << kMaxChannels << " channels, not " << numChannels;
+    throw std::runtime_error(ss.str());
+  }
+  const long maxBlockColumns = kMaxBlockSize * this->mNumChannels;
+  long maxConvChannels = 0;
+  long maxKernelSize = 0;
+  for (const Weights::LayerArray& layerArray : this->mWeights->GetLayerArrays())
+  {
+    LayerArrayState state;
+    for (size_t i = 0; i < layerArray.mLayers.size(); i++)
+      state.mLayerBuffers.push_back(Eigen::MatrixXf::Zero(
+        layerArray.mChannels, (layerArray.mMaxLookback + kBufferSize) * this->mNumChannels));
+    state.mBufferStart = layerArray.mMaxLookback;
+    state.mOutput.resize(layerArray.mChannels, maxBlockColumns);
+    state.mHeadOutput.resize(layerArray.mHeadSize, maxBlockColumns);
+    state.mProcessLayer = &WaveNet::_ProcessLayer;
+    if (this->mWeights->GetPrecision() == Precision::INT8
+        || (kernels::GetInstructionSet() != kernels::InstructionSet::SCALAR && !layerArray.mGated
+            && layerArray.mActivation == Activation::TANH && layerArray.mChannels % this->mKernels.mRowMultiple == 0))
+      state.mProcessLayer = &WaveNet::_ProcessLayerKernels;
+    else if (!layerArray.mGated && layerArray.mKernelSize == 3)
+    {
+      if (layerArray.mChannels == 16)
+        state.mProcessLayer = &WaveNet::_ProcessLayerFixed<16, 3>;
+      else if (layerArray.mChannels == 8)
+        state.mProcessLayer = &WaveNet::_ProcessLayerFixed<8, 3>;
+    }
+    this->mLayerArrayStates.push_back(std::move(state));
+    maxConvChannels = std::max(maxConvChannels, (long)(layerArray.mGated ? 2 : 1) * layerArray.mChannels);
+    maxKernelSize = std::max(maxKernelSize, (long)layerArray.mKernelSize);
+  }
+  this->mCondition.resize(1, maxBlockColumns);
+  this->mHeadInput.resize(this->mWeights->GetLayerArrays().front().mChannels, maxBlockColumns);
+  this->mZ.resize(maxConvChannels, maxBlockColumns);
+  // The dilated convolution's terms: the kernel taps and the input mixin
+  this->mTerms.resize(maxKernelSize + 1);
+}
+
+void dsp::wavenet::WaveNet::process(NAM_SAMPLE* input, NAM_SAMPLE* output, const int num_frames)
+{
+  this->_BeginProcess(num_frames);
+  for (long start = 0; start < num_frames; start += kMaxBlockSize)
+  {
+    const NAM_SAMPLE* inputs[kMaxChannels];
+    std::fill(inputs, inputs + kMaxChannels, input + start);
+    NAM_SAMPLE* outputs[kMaxChannels] = {output + start};
+    this->_ProcessBlock(inputs, outputs, std::min(kMaxBlockSize, (long)num_frames - start));
+  }
+}
+
+void dsp::wavenet::WaveNet::ProcessChannels(NAM_SAMPLE* const* inputs, NAM_SAMPLE* const* outputs,
+                                            const int numFrames)
+{
+  this->_BeginProcess(numFrames);
+  const NAM_SAMPLE* blockInputs[kMaxChannels];
+  NAM_SAMPLE* blockOutputs[kMaxChannels];
+  for (long start = 0; start < numFrames; start += kMaxBlockSize)
+  {
+    for (long c = 0; c < this->mNumChannels; c++)
+    {
+      blockInputs[c] = inputs[c] + start;
+      blockOutputs[c] = outputs[c] + start;
+    }
+    this->_ProcessBlock(blockInputs, blockOutputs, std::min(kMaxBlockSize, (long)numFrames - start));
+  }
+}
+
+void dsp::wavenet::WaveNet::finalize_(const int num_frames)
+{
+  this->nam::DSP::finalize_(num_frames);
+}
+
+void dsp::wavenet::WaveNet::Prewarm()
+{
+  std::vector<NAM_SAMPLE> silence(kMaxBlockSize, (NAM_SAMPLE)0.0);
+  for (long remaining = this->mWeights->GetPrewarmSamples(); remaining > 0; remaining -= kMaxBlockSize)
+  {
+    const int numFrames = (int)std::min(kMaxBlockSize, remaining);
+    this->process(silence.data(), silence.data(), numFrames);
+    this->finalize_(numFrames);
+    std::fill(silence.begin(), silence.end(), (NAM_SAMPLE)0.0);
+  }
+}
+
+void dsp::wavenet::WaveNet::_ProcessBlock(const NAM_SAMPLE* const* inputs, NAM_SAMPLE* const* outputs,
+                                          const long numFrames)
+{
+  const std::vector<Weights::LayerArray>& layerArrays = this->mWeights->GetLayerArrays();
+  const long numChannels = this->mNumChannels;
+  const long columns = numFrames * numChannels;
+  // INT8 weights only go through the kernels
+  const bool quantized = this->mWeights->GetPrecision() == Precision::INT8;
+  for (long c = 0; c < numChannels; c++)
+    for (long s = 0; s < numFrames; s++)
+      this->mCondition(0, s * numChannels + c) = (float)inputs[c][s];
+  this->mHeadInput.leftCols(columns).setZero();
+
+  for (size_t a = 0; a < layerArrays.size(); a++)
+  {
+    const Weights::LayerArray& layerArray = layerArrays[a];
+    LayerArrayState& state = this->mLayerArrayStates[a];
+    if ((state.mBufferStart + numFrames) * numChannels > state.mLayerBuffers[0].cols())
+      this->_RewindBuffers(a);
+    auto layerInput = state.mLayerBuffers[0].middleCols(state.mBufferStart * numChannels, columns);
+    const Eigen::MatrixXf& rechannelInput = a == 0 ? this->mCondition : this->mLayerArrayStates[a - 1].mOutput;
+    if (quantized)
+    {
+      const kernels::Term term = _Term(layerArray.mRechannel, rechannelInput.data(), rechannelInput.rows());
+      this->_Linear(&term, 1, nullptr, nullptr, layerArray.mChannels, columns, layerInput.data(), layerArray.mChannels);
+    }
+    else
+      layerInput.noalias() = layerArray.mRechannel.mFloat * rechannelInput.leftCols(columns);
+
+    for (size_t l = 0; l < layerArray.mLayers.size(); l++)
+      this->_RunLayer(a, l, numFrames);
+
+    const Eigen::MatrixXf& headInput = a == 0 ? this->mHeadInput : this->mLayerArrayStates[a - 1].mHeadOutput;
+    const float* headBias = layerArray.mHeadRechannelBias.size() > 0 ? layerArray.mHeadRechannelBias.data() : nullptr;
+    if (quantized)
+    {
+      const kernels::Term term = _Term(layerArray.mHeadRechannel, headInput.data(), headInput.rows());
+      this->_Linear(
+        &term, 1, headBias, nullptr, layerArray.mHeadSize, columns, state.mHeadOutput.data(), state.mHeadOutput.rows());
+    }
+    else
+    {
+      auto headOutput = state.mHeadOutput.leftCols(columns);
+      headOutput.noalias() = layerArray.mHeadRechannel.mFloat * headInput.leftCols(columns);
+      if (headBias != nullptr)
+        headOutput.colwise() += layerArray.mHeadRechannelBias;
+    }
+    state.mBufferStart += numFrames;
+  }
+
+  const float headScale = this->mWeights->GetHeadScale();
+  const Eigen::MatrixXf& head = this->mLayerArrayStates.back().mHeadOutput;
+  for (long c = 0; c < numChannels; c++)
+  {
+    if (outputs[c] == nullptr)
+      continue;
+    for (long s = 0; s < numFrames; s++)
+      outputs[c][s] = (NAM_SAMPLE)(headScale * head(0, s * numChannels + c));
+  }
+}
+
+void dsp::wavenet::WaveNet::_ProcessLayer(const size_t a, const size_t l, const long numFrames)
+{
+  const std::vector<Weights::LayerArray>& layerArrays = this->mWeights->GetLayerArrays();
+  const Weights::LayerArray& layerArray = layerArrays[a];
+  const Weights::Layer& layer = layerArray.mLayers[l];
+  LayerArrayState& state = this->mLayerArrayStates[a];
+  // Signals are interleaved, so a frame is mNumChannels columns and every
+  // product covers all of them.
+  const long start = state.mBufferStart * this->mNumChannels;
+  const long columns = numFrames * this->mNumChannels;
+  const long channels = layerArray.mChannels;
+  const long convChannels = layerArray.mGated ? 2 * channels : channels;
+  auto headInput =
+    a == 0 ? this->mHeadInput.leftCols(columns) : this->mLayerArrayStates[a - 1].mHeadOutput.leftCols(columns);
+
+  const Eigen::MatrixXf& layerInput = state.mLayerBuffers[l];
+  auto z = this->mZ.topLeftCorner(convChannels, columns);
+  const long kernelSize = (long)layer.mConv.size();
+  z.noalias() = layer.mConv[kernelSize - 1].mFloat * layerInput.middleCols(start, columns);
+  for (long k = 0; k < kernelSize - 1; k++)
+    z.noalias() += layer.mConv[k].mFloat
+                   * layerInput.middleCols(start + layer.mDilation * (k + 1 - kernelSize) * this->mNumChannels, columns);
+  z.colwise() += layer.mConvBias;
+  z.noalias() += layer.mInputMixin.mFloat * this->mCondition.leftCols(columns);
+  // Gated: the activation on the top half, times the sigmoid of the bottom
+  // half (the gate)
+  auto activations = z.topRows(channels);
+  ApplyActivation(layerArray.mActivation, this->mActivationAccuracy, activations);
+  if (layerArray.mGated)
+  {
+    auto gate = z.bottomRows(channels);
+    ApplyActivation(Activation::SIGMOID, this->mActivationAccuracy, gate);
+    z.topRows(channels).array() *= z.bottomRows(channels).array();
+  }
+  headInput += z.topRows(channels);
+
+  const bool lastLayer = l + 1 == layerArray.mLayers.size();
+  // The residual output of the very last layer isn't used by anything.
+  if (lastLayer && a + 1 == layerArrays.size())
+    return;
+  auto layerOutput =
+    lastLayer ? state.mOutput.leftCols(columns) : state.mLayerBuffers[l + 1].middleCols(start, columns);
+  layerOutput = layerInput.middleCols(start, columns);
+  layerOutput.noalias() += layer.mOneByOne.mFloat * z.topRows(channels);
+  layerOutput.colwise() += layer.mOneByOneBias;
+}
+
+template <int Channels, int KernelSize>
+void dsp::wavenet::WaveNet::_ProcessLayerFixed(const size_t a, const size_t l, const long numFrames)
+{
+  using WeightMatrix = Eigen::Map<const Eigen::Matrix<float, Channels, Channels>>;
+  using WeightVector = Eigen::Map<const Eigen::Matrix<float, Channels, 1>>;
+  using ConstBlock = Eigen::Map<const Eigen::Matrix<float, Channels, Eigen::Dynamic>>;
+  using Block = Eigen::Map<Eigen::Matrix<float, Channels, Eigen::Dynamic>, 0, Eigen::OuterStride<>>;
+
+  const std::vector<Weights::LayerArray>& layerArrays = this->mWeights->GetLayerArrays();
+  const Weights::LayerArray& layerArray = layerArrays[a];
+  const Weights::Layer& layer = layerArray.mLayers[l];
+  LayerArrayState& state = this->mLayerArrayStates[a];
+  const long start = state.mBufferStart * this->mNumChannels;
+  const long columns = numFrames * this->mNumChannels;
+  auto headInput =
+    a == 0 ? this->mHeadInput.leftCols(columns) : this->mLayerArrayStates[a - 1].mHeadOutput.leftCols(columns);
+
+  const float* layerInput = state.mLayerBuffers[l].data();
+  auto tap = [&](const long k) {
+    return ConstBlock(layerInput + (start + layer.mDilation * (k + 1 - KernelSize) * this->mNumChannels) * Channels,
+                      Channels, columns);
+  };
+  Block z(this->mZ.data(), Channels, columns, Eigen::OuterStride<>(this->mZ.rows()));
+  z.noalias() = WeightMatrix(layer.mConv[KernelSize - 1].mFloat.data()).lazyProduct(tap(KernelSize - 1));
+  for (long k = 0; k < KernelSize - 1; k++)
+    z.noalias() += WeightMatrix(layer.mConv[k].mFloat.data()).lazyProduct(tap(k));
+  z.colwise() += WeightVector(layer.mConvBias.data());
+  // Condition size 1: the mixin is a column
+  z.noalias() += WeightVector(layer.mInputMixin.mFloat.data()) * this->mCondition.leftCols(columns);
+  ApplyActivation(layerArray.mActivation, this->mActivationAccuracy, z);
+  headInput += z;
+
+  const bool lastLayer = l + 1 == layerArray.mLayers.size();
+  if (lastLayer && a + 1 == layerArrays.size())
+    return;
+  float* output = lastLayer ? state.mOutput.data() : state.mLayerBuffers[l + 1].data() + start * Channels;
+  Eigen::Map<Eigen::Matrix<float, Channels, Eigen::Dynamic>> layerOutput(output, Channels, columns);
+  layerOutput = tap(KernelSize - 1);
+  layerOutput.noalias() += WeightMatrix(layer.mOneByOne.mFloat.data()).lazyProduct(z);
+  layerOutput.colwise() += WeightVector(layer.mOneByOneBias.data());
+}
+
+void dsp::wavenet::WaveNet::_ProcessLayerKernels(const size_t a, const size_t l, const long numFrames)
+{
+  const std::vector<Weights::LayerArray>& layerArrays = this->mWeights->GetLayerArrays();
+  const Weights::LayerArray& layerArray = layerArrays[a];
+  const Weights::Layer& layer = layerArray.mLayers[l];
+  LayerArrayState& state = this->mLayerArrayStates[a];
+  const long start = state.mBufferStart * this->mNumChannels;
+  const long columns = numFrames * this->mNumChannels;
+  const long channels = layerArray.mChannels;
+  const long convChannels = layerArray.mGated ? 2 * channels : channels;
+  const long kernelSize = (long)layer.mConv.size();
+  const float* layerInput = state.mLayerBuffers[l].data();
+
+  // Dilated convolution and input mixin in one pass, then the activation
+  for (long k = 0; k < kernelSize; k++)
+  {
+    const long column = start + layer.mDilation * (k + 1 - kernelSize) * this->mNumChannels;
+    this->mTerms[k] = _Term(layer.mConv[k], layerInput + column * channels, channels);
+  }
+  this->mTerms[kernelSize] = _Term(layer.mInputMixin, this->mCondition.data(), 1);
+  float* z = this->mZ.data();
+  const long zStride = this->mZ.rows();
+  this->_Linear(
+    this->mTerms.data(), (int)kernelSize + 1, layer.mConvBias.data(), nullptr, convChannels, columns, z, zStride);
+  if (!layerArray.mGated && layerArray.mActivation == Activation::TANH
+      && channels % this->mKernels.mRowMultiple == 0)
+  {
+    if (this->mActivationAccuracy == ActivationAccuracy::FAST)
+      this->mKernels.mFastTanh(z, channels, columns, zStride);
+    else
+      this->mKernels.mTanh(z, channels, columns, zStride);
+  }
+  else
+  {
+    auto activations = this->mZ.topLeftCorner(channels, columns);
+    ApplyActivation(layerArray.mActivation, this->mActivationAccuracy, activations);
+    if (layerArray.mGated)
+    {
+      auto gate = this->mZ.block(channels, 0, channels, columns);
+      ApplyActivation(Activation::SIGMOID, this->mActivationAccuracy, gate);
+      activations.array() *= gate.array();
+    }
+  }
+  auto headInput =
+    a == 0 ? this->mHeadInput.leftCols(columns) : this->mLayerArrayStates[a - 1].mHeadOutput.leftCols(columns);
+  headInput += this->mZ.topLeftCorner(channels, columns);
+
+  const bool lastLayer = l + 1 == layerArray.mLayers.size();
+  if (lastLayer && a + 1 == layerArrays.size())
+    return;
+  // 1x1 mixer on top of the residual
+  float* output = lastLayer ? state.mOutput.data() : state.mLayerBuffers[l + 1].data() + start * channels;
+  const kernels::Term mixer = _Term(layer.mOneByOne, z, zStride);
+  this->_Linear(
+    &mixer, 1, layer.mOneByOneBias.data(), layerInput + start * channels, channels, columns, output, channels);
+}
+
+dsp::wavenet::kernels::Term dsp::wavenet::WaveNet::_Term(const Weights::Matrix& matrix, const float* input,
+                                                         const long inputStride)
+{
+  kernels::Term term{matrix.mFloat.data(), matrix.mCols, input, inputStride};
+  if (!matrix.mQuantized.empty())
+  {
+    term.mWeights = nullptr;
+    term.mQuantized = matrix.mQuantized.data();
+    term.mScales = matrix.mScales.data();
+  }
+  return term;
+}
+
+void dsp::wavenet::WaveNet::_Linear(const kernels::Term* terms, const int numTerms, const float* bias,
+                                    const float* residual, const long rows, const long numColumns, float* output,
+                                    const long outputStride) const
+{
+  const kernels::Kernels& fitting = rows % this->mKernels.mRowMultiple == 0
+                                      ? this->mKernels
+                                      : kernels::GetKernels(kernels::InstructionSet::SCALAR);
+  fitting.mLinear(terms, numTerms, bias, residual, rows, numColumns, output, outputStride);
+}
+
+void dsp::wavenet::WaveNet::_RewindBuffers(const size_t layerArrayIndex)
+{
+  // Move each layer's history back to just before the start of the buffer.
+  // Columns are contiguous, so this is one move per layer.
+  const Weights::LayerArray& layerArray = this->mWeights->GetLayerArrays()[layerArrayIndex];
+  LayerArrayState& state = this->mLayerArrayStates[layerArrayIndex];
+  const long newStart = layerArray.mMaxLookback;
+  for (size_t l = 0; l < layerArray.mLayers.size(); l++)
+  {
+    Eigen::MatrixXf& buffer = state.mLayerBuffers[l];
+    const long lookback = (long)(layerArray.mKernelSize - 1) * layerArray.mLayers[l].mDilation;
+    const long frameSize = buffer.rows() * this->mNumChannels;
+    std::memmove(buffer.data() + (newStart - lookback) * frameSize,
+                 buffer.data() + (state.mBufferStart - lookback) * frameSize, lookback * frameSize * sizeof(float));
+  }
+  state.mBufferStart = newStart;
+}
+
+namespace
+{
+// A quarter second of a decaying sweep over a bed of quiet noise: covers the
+// level and frequency range a guitar puts through the model.
+std::vector<NAM_SAMPLE> MakeProbe(const dsp::wavenet::Weights& weights)
+{
+  const double sampleRate = weights.GetExpectedSampleRate() > 0.0 ? weights.GetExpectedSampleRate() : 48000.0;
+  const size_t numSamples = (size_t)(0.25 * sampleRate);
+  std::vector<NAM_SAMPLE> probe(numSamples);
+  uint32_t noise = 22222;
+  double phase = 0.0;
+  for (size_t i = 0; i < numSamples; i++)
+  {
+    const double position = (double)i / (double)numSamples;
+    const double frequency = 80.0 * std::pow(4000.0 / 80.0, position);
+    phase += 2.0 * M_PI * frequency / sampleRate;
+    noise = noise * 1664525u + 1013904223u;
+    const double n = (double)noise / 4294967296.0 - 0.5;
+    probe[i] = (NAM_SAMPLE)(0.8 * std::exp(-3.0 * position) * std::sin(phase) + 0.01 * n);
+  }
+  return probe;
+}
+
+// Output of a fresh instance of the model on the probe signal
+std::vector<NAM_SAMPLE> RunProbe(
+  std::shared_ptr<const dsp::wavenet::Weights> weights, const std::vector<NAM_SAMPLE>& probe,
+  const dsp::wavenet::ActivationAccuracy accuracy = dsp::wavenet::ActivationAccuracy::EXACT)
+{
+  dsp::wavenet::WaveNet model(std::move(weights));
+  model.SetActivationAccuracy(accuracy);
+  model.Prewarm();
+  std::vector<NAM_SAMPLE> input(probe);
+  std::vector<NAM_SAMPLE> output(probe.size());
+  model.process(input.data(), output.data(), (int)probe.size());
+  model.finalize_((int)probe.size());
+  return output;
+}
+
+// Error-to-signal ratio of x against the reference y
+double ESR(const std::vector<NAM_SAMPLE>& x, const std::vector<NAM_SAMPLE>& y)
+{
+  double error = 0.0;
+  double signal = 1.0e-12;
+  for (size_t i = 0; i < x.size(); i++)
+  {
+    error += ((double)x[i] - (double)y[i]) * ((double)x[i] - (double)y[i]);
+    signal += (double)y[i] * (double)y[i];
+  }
+  return error / signal;
+}
+}; // namespace
+
+bool dsp::wavenet::BlendsCleanly(const std::shared_ptr<const Weights>& a, const std::shared_ptr<const Weights>& b)
+{
+  if (!a->HasSameTopology(*b))
+    return false;
+
+  const std::vector<NAM_SAMPLE> probe = MakeProbe(*a);
+  const size_t numSamples = probe.size();
+  auto blend = std::make_shared<Weights>(*a, Precision::FLOAT32);
+  blend->Interpolate(*a, *b, 0.5f);
+  const std::vector<NAM_SAMPLE> outputA = RunProbe(a, probe);
+  const std::vector<NAM_SAMPLE> outputB = RunProbe(b, probe);
+  const std::vector<NAM_SAMPLE> outputBlend = RunProbe(blend, probe);
+  std::vector<NAM_SAMPLE> average(numSamples);
+  for (size_t i = 0; i < numSamples; i++)
+    average[i] = (NAM_SAMPLE)(0.5 * ((double)outputA[i] + (double)outputB[i]));
+  return ESR(outputBlend, average) <= ESR(outputA, outputB);
+}
+
+double dsp::wavenet::GetESR(const std::shared_ptr<const Weights>& model, const std::shared_ptr<const Weights>& reference,
+                            const ActivationAccuracy accuracy)
+{
+  const std::vector<NAM_SAMPLE> probe = MakeProbe(*reference);
+  return ESR(RunProbe(model, probe, accuracy), RunProbe(reference, probe));
+}
+
+dsp::wavenet::BlendedWaveNet::BlendedWaveNet(std::shared_ptr<const Weights> a, std::shared_ptr<const Weights> b,
+                                             const float t, const int numChannels)
+: WaveNet(std::make_shared<Weights>(*a, Precision::FLOAT32), numChannels)
+, mBlend(std::const_pointer_cast<Weights>(this->mWeights))
+, mHasPendingTarget(false)
+, mTarget{std::move(a), std::move(b), t, true}
+, mCurrentT(t)
+{
+  this->mBlend->Interpolate(*this->mTarget.mA, *this->mTarget.mB, t);
+}
+
+void dsp::wavenet::BlendedWaveNet::SetTarget(std::shared_ptr<const Weights> a, std::shared_ptr<const Weights> b,
+                                             const float t, const bool jump)
+{
+  std::lock_guard<std::mutex> lock(this->mTargetMutex);
+  // A jump that hasn't been picked up yet still has to happen.
+  const bool pendingJump = this->mHasPendingTarget && this->mPendingTarget.mJump;
+  this->mPendingTarget = Target{std::move(a), std::move(b), std::clamp(t, 0.0f, 1.0f), jump || pendingJump};
+  this->mHasPendingTarget = true;
+}
+
+void dsp::wavenet::BlendedWaveNet::_BeginProcess(const int numFrames)
+{
+  bool jump = false;
+  bool changed = false;
+  {
+    std::unique_lock<std::mutex> lock(this->mTargetMutex, std::try_to_lock);
+    if (lock.owns_lock() && this->mHasPendingTarget)
+    {
+      // Swap rather than copy so that the old captures are released on the
+      // next SetTarget() call, not here.
+      std::swap(this->mTarget, this->mPendingTarget);
+      this->mHasPendingTarget = false;
+      const Target& previous = this->mPendingTarget;
+      if (this->mTarget.mJump)
+        jump = true;
+      // Moving on to the next pair of captures: start from the capture the
+      // two pairs share, which is the nearest point of the new pair.
+      else if (this->mTarget.mA == previous.mB && this->mTarget.mB != previous.mB)
+        this->mCurrentT = 0.0f;
+      else if (this->mTarget.mB == previous.mA && this->mTarget.mA != previous.mA)
+        this->mCurrentT = 1.0f;
+      else
+        jump = this->mTarget.mA != previous.mA || this->mTarget.mB != previous.mB;
+      changed = this->mTarget.mA != previous.mA || this->mTarget.mB != previous.mB;
+    }
+  }
+
+  const float previousT = this->mCurrentT;
+  if (jump)
+    this->mCurrentT = this->mTarget.mT;
+  else if (this->mCurrentT != this->mTarget.mT)
+  {
+    const double sampleRate =
+      this->mBlend->GetExpectedSampleRate() > 0.0 ? this->mBlend->GetExpectedSampleRate() : 48000.0;
+    const float step = (float)numFrames / (float)(kGlideSeconds * sampleRate);
+    if (this->mCurrentT < this->mTarget.mT)
+      this->mCurrentT = std::min(this->mCurrentT + step, this->mTarget.mT);
+    else
+      this->mCurrentT = std::max(this->mCurrentT - step, this->mTarget.mT);
+  }
+  if (jump || changed || this->mCurrentT != previousT)
+    this->mBlend->Interpolate(*this->mTarget.mA, *this->mTarget.mB, this->mCurrentT);
+}
@@ -0,0 +1,305 @@
+//
+//  SharedWaveNet.h
+//
+// WaveNet inference with the weights split from the per-instance state, so
+// that one copy of a model's weights can serve any number of plugin instances.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Eigen/Dense>
+
+#include "../NeuralAmpModelerCore/NAM/dsp.h"
+#include "WaveNetKernels.h"
+
+namespace dsp
+{
+namespace wavenet
+{
+enum class Activation
+{
+  TANH = 0,
+  FAST_TANH,
+  HARD_TANH,
+  RELU,
+  SIGMOID
+};
+
+// How closely tanh and sigmoid activations are computed
+enum class ActivationAccuracy
+{
+  // Eigen's float approximations, accurate to a few units in the last place
+  EXACT = 0,
+  // Lower-order rational approximation (see kernels::kFastTanhP): absolute
+  // error at most 1.0e-4 for tanh and 5.0e-5 for sigmoid
+  FAST
+};
+
+// How the weight matrices are stored
+enum class Precision
+{
+  FLOAT32 = 0,
+  // 8-bit weights with a float scale per output channel: about a quarter of
+  // the memory, at a small loss of accuracy (see GetESR())
+  INT8
+};
+
+// Immutable weights of a NAM WaveNet.
+// Parsed once from a model's config and flat weight vector (same layout as
+// nam::wavenet::WaveNet::set_weights_()), and never modified afterwards, so a
+// single instance can be shared between threads and plugin instances.
+class Weights
+{
+public:
+  // An (out, in) weight matrix, stored at the precision of the weights
+  struct Matrix
+  {
+    long mRows;
+    long mCols;
+    // FLOAT32: the weights. Empty for INT8.
+    Eigen::MatrixXf mFloat;
+    // INT8: the quantized weights, column-major, and the scale of each row
+    // (output channel). Empty for FLOAT32.
+    std::vector<int8_t> mQuantized;
+    Eigen::VectorXf mScales;
+  };
+  struct Layer
+  {
+    int mDilation;
+    // Dilated convolution, one matrix per kernel tap, oldest first
+    std::vector<Matrix> mConv;
+    Eigen::VectorXf mConvBias;
+    // Condition -> conv channels, no bias
+    Matrix mInputMixin;
+    // Activations -> residual, with bias
+    Matrix mOneByOne;
+    Eigen::VectorXf mOneByOneBias;
+  };
+  struct LayerArray
+  {
+    int mInputSize;
+    int mConditionSize;
+    int mHeadSize;
+    int mChannels;
+    int mKernelSize;
+    Activation mActivation;
+    bool mGated;
+    Matrix mRechannel;
+    std::vector<Layer> mLayers;
+    Matrix mHeadRechannel;
+    // Empty if the layer array has no head bias
+    Eigen::VectorXf mHeadRechannelBias;
+    // Longest look-back of any layer, (kernel size - 1) * dilation
+    long mMaxLookback;
+    // Sum of the look-backs of all layers
+    long mReceptiveField;
+  };
+
+  // Throws std::runtime_error if the config isn't a WaveNet this engine
+  // supports, or if the weights don't match it.
+  Weights(const nlohmann::json& config, const std::vector<float>& weights, const double expectedSampleRate);
+  // Copy of other, stored at the given precision. Biases stay in float.
+  Weights(const Weights& other, const Precision precision);
+
+  const std::vector<LayerArray>& GetLayerArrays() const { return this->mLayerArrays; };
+  float GetHeadScale() const { return this->mHeadScale; };
+  double GetExpectedSampleRate() const { return this->mExpectedSampleRate; };
+  Precision GetPrecision() const { return this->mPrecision; };
+  // Memory taken by the weight matrices and biases
+  size_t GetSizeInBytes() const;
+  // Number of samples of silence needed to settle a fresh instance
+  long GetPrewarmSamples() const;
+  // True if other has the same architecture, so that the two can be blended.
+  bool HasSameTopology(const Weights& other) const;
+  // Set these weights to (1 - t) * a + t * b. All three must have the same
+  // topology, and these weights must be FLOAT32 (a and b can be either).
+  // Doesn't allocate.
+  // Only for a private copy: never call this on weights that are shared.
+  void Interpolate(const Weights& a, const Weights& b, const float t);
+
+private:
+  std::vector<LayerArray> mLayerArrays;
+  float mHeadScale;
+  double mExpectedSampleRate;
+  Precision mPrecision;
+};
+
+// One running instance of a WaveNet.
+// Holds a reference to the shared weights and only owns the state of the
+// model: the layer buffers (dilated-convolution history) and scratch space.
+// Drop-in replacement for nam::wavenet::WaveNet.
+// An instance can also run several signals (e.g. the two sides of a stereo
+// input) through the weights: the signals are interleaved column by column in
+// the layer buffers, so each weight matrix is applied to all of them in a
+// single product. The products are compute-bound, so this costs about as much
+// as an instance per signal; it only saves the per-call overhead.
+class WaveNet : public nam::DSP
+{
+public:
+  // Longer calls to process() are split into blocks of at most this size.
+  static constexpr long kMaxBlockSize = 256;
+  // Frames that fit in the layer buffers ahead of the history before they
+  // need to be rewound
+  static constexpr long kBufferSize = 4 * kMaxBlockSize;
+  static constexpr int kMaxChannels = 2;
+
+  // Throws std::runtime_error if numChannels isn't between 1 and
+  // kMaxChannels.
+  WaveNet(std::shared_ptr<const Weights> weights, const int numChannels = 1);
+
+  // Layer buffers are advanced at the end of process(); finalize_() is kept
+  // for compatibility with the nam::DSP interface.
+  // On an instance with several channels, input is played on all of them and
+  // output is the first one.
+  void process(NAM_SAMPLE* input, NAM_SAMPLE* output, const int num_frames) override;
+  void finalize_(const int num_frames) override;
+  // Run one signal per channel: inputs and outputs hold GetNumChannels()
+  // pointers each.
+  void ProcessChannels(NAM_SAMPLE* const* inputs, NAM_SAMPLE* const* outputs, const int numFrames);
+  // Run silence through the model to settle its initial state.
+  void Prewarm();
+  const std::shared_ptr<const Weights>& GetWeights() const { return this->mWeights; };
+  int GetNumChannels() const { return (int)this->mNumChannels; };
+  // EXACT by default. Set it before the instance is first run.
+  void SetActivationAccuracy(const ActivationAccuracy accuracy) { this->mActivationAccuracy = accuracy; };
+  ActivationAccuracy GetActivationAccuracy() const { return this->mActivationAccuracy; };
+
+protected:
+  // Called before every process() or ProcessChannels() run
+  virtual void _BeginProcess(const int numFrames){};
+
+  std::shared_ptr<const Weights> mWeights;
+
+private:
+  struct LayerArrayState
+  {
+    // Input to each layer, (channels, (max look-back + kBufferSize) * number
+    // of signals)
+    std::vector<Eigen::MatrixXf> mLayerBuffers;
+    // Frame of the layer buffers where the current block goes
+    long mBufferStart;
+    // Output of the last layer, input to the next layer array
+    Eigen::MatrixXf mOutput;
+    // Head rechannel output, head input of the next layer array
+    Eigen::MatrixXf mHeadOutput;
+    // Runs a layer: _ProcessLayerKernels() for INT8 weights, or if the CPU
+    // has vector kernels that fit the layer array, otherwise a
+    // _ProcessLayerFixed() instance if there's one for its shape, otherwise
+    // _ProcessLayer()
+    void (WaveNet::*mProcessLayer)(const size_t a, const size_t l, const long numFrames);
+  };
+
+  // A block of at most kMaxBlockSize frames. inputs and outputs have one
+  // pointer per channel; null outputs are skipped.
+  void _ProcessBlock(const NAM_SAMPLE* const* inputs, NAM_SAMPLE* const* outputs, const long numFrames);
+  // FLOAT32 weights only
+  void _ProcessLayer(const size_t a, const size_t l, const long numFrames);
+  // Same as _ProcessLayer() for an ungated layer array of Channels channels
+  // and KernelSize taps (the shape of the factory models), with fixed-size
+  // products that Eigen unrolls instead of its general matrix product.
+  template <int Channels, int KernelSize>
+  void _ProcessLayerFixed(const size_t a, const size_t l, const long numFrames);
+  // Same as _ProcessLayer() with the products done by mKernels, which is
+  // also what runs INT8 weights. Ungated tanh layer arrays get the kernels'
+  // activation too.
+  void _ProcessLayerKernels(const size_t a, const size_t l, const long numFrames);
+  void _RunLayer(const size_t a, const size_t l, const long numFrames)
+  {
+    (this->*this->mLayerArrayStates[a].mProcessLayer)(a, l, numFrames);
+  };
+  void _RewindBuffers(const size_t layerArrayIndex);
+  // The kernel term for matrix times columns of input inputStride apart, at
+  // the precision the matrix is stored in
+  static kernels::Term _Term(const Weights::Matrix& matrix, const float* input, const long inputStride);
+  // mKernels.mLinear(), or the scalar one if rows isn't a multiple of
+  // mKernels.mRowMultiple
+  void _Linear(const kernels::Term* terms, const int numTerms, const float* bias, const float* residual,
+               const long rows, const long numColumns, float* output, const long outputStride) const;
+
+  // Number of signals run together; every block has this many columns per
+  // frame
+  const long mNumChannels;
+  ActivationAccuracy mActivationAccuracy;
+  std::vector<LayerArrayState> mLayerArrayStates;
+  // Model input, which is also the condition of every layer
+  Eigen::MatrixXf mCondition;
+  // Head input of the first layer array
+  Eigen::MatrixXf mHeadInput;
+  // Conv/activation scratch, sized for the widest layer
+  Eigen::MatrixXf mZ;
+  // Kernels for this CPU, and the terms of a layer's dilated convolution
+  const kernels::Kernels& mKernels;
+  std::vector<kernels::Term> mTerms;
+};
+
+// Returns true if blending the weights of two captures gives a model whose
+// output lies between theirs.
+// Captures of the same amp at neighbouring settings are often (but not
+// always) close enough in weight space for this to hold. It's checked by
+// running both captures and their midpoint blend on a short test signal and
+// comparing the blend's error against the average of the two outputs with
+// the error between the outputs themselves. Takes around a tenth of a second;
+// don't call it from the audio thread.
+bool BlendsCleanly(const std::shared_ptr<const Weights>& a, const std::shared_ptr<const Weights>& b);
+
+// Error-to-signal ratio of a model run with the given activation accuracy
+// against a reference run with EXACT activations (typically a quantized copy
+// against the float original, or the same weights), on the same test signal
+// as BlendsCleanly(). Takes a few tens of milliseconds.
+double GetESR(const std::shared_ptr<const Weights>& model, const std::shared_ptr<const Weights>& reference,
+              const ActivationAccuracy accuracy = ActivationAccuracy::EXACT);
+
+// A WaveNet whose weights are a blend of two captures with the same
+// topology, for settings in between captured ones.
+// The blend lives in a private float copy of the weights and is updated in
+// place at the start of each run, gliding to new targets over kGlideSeconds,
+// so a moving control costs one model's inference and never steps.
+class BlendedWaveNet : public WaveNet
+{
+public:
+  static constexpr float kGlideSeconds = 0.05f;
+
+  // Allocates; don't call from the audio thread.
+  BlendedWaveNet(std::shared_ptr<const Weights> a, std::shared_ptr<const Weights> b, const float t,
+                 const int numChannels = 1);
+
+  // Set the captures to blend and the position between them (0 = a, 1 = b).
+  // Picked up at the start of the next run of the model. Moving on to an
+  // adjacent pair (one that shares a capture with the current one) glides
+  // from the shared capture; any other change of captures, or jump = true,
+  // moves straight to the new blend.
+  // a and b must have the same topology as the ones given at construction.
+  // Captures that are no longer used are released by the next call, so
+  // never on the audio thread.
+  void SetTarget(std::shared_ptr<const Weights> a, std::shared_ptr<const Weights> b, const float t,
+                 const bool jump = false);
+
+protected:
+  void _BeginProcess(const int numFrames) override;
+
+private:
+  struct Target
+  {
+    std::shared_ptr<const Weights> mA;
+    std::shared_ptr<const Weights> mB;
+    float mT;
+    bool mJump;
+  };
+
+  // Same object as mWeights, which this instance alone owns
+  std::shared_ptr<Weights> mBlend;
+  // Written by SetTarget(); read at the start of each run if the lock is free
+  std::mutex mTargetMutex;
+  Target mPendingTarget;
+  bool mHasPendingTarget;
+  // Audio-thread copy of the current target, and where the blend is now
+  Target mTarget;
+  float mCurrentT;
+};
+}; // namespace wavenet
+}; // namespace dsp
@@ -0,0 +1,24 @@
+//
+//  SimdTargets.h
+//
+// What the hand-vectorized kernels (WaveNetKernels.cpp, LanczosKernels.cpp)
+// need to compile a version of a function for an instruction set that the
+// rest of the build doesn't assume. Only for .cpp files.
+
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  #define DSP_KERNELS_X86 1
+  #include <immintrin.h>
+  #if defined(_MSC_VER) && !defined(__clang__)
+    #include <intrin.h>
+    // MSVC allows any intrinsic in any function
+    #define DSP_TARGET_SSE41
+    #define DSP_TARGET_AVX2
+  #else
+    #define DSP_TARGET_SSE41 __attribute__((target("sse4.1")))
+    #define DSP_TARGET_AVX2 __attribute__((target("avx2,fma")))
+  #endif
+#else
+  #define DSP_KERNELS_X86 0
+#endif
@@ -0,0 +1,377 @@
+//
+//  WaveNetKernels.cpp
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "SimdTargets.h"
+#include "WaveNetKernels.h"
+
+namespace
+{
+using dsp::wavenet::kernels::kFastTanhClamp;
+using dsp::wavenet::kernels::kFastTanhP;
+using dsp::wavenet::kernels::kFastTanhQ;
+using dsp::wavenet::kernels::Term;
+
+// Eigen's float tanh: a 13/6 rational approximation on a clamped input,
+// passing tiny inputs through. The clamp depends on whether FMA is used.
+constexpr float kTanhClamp = 7.90531110763549805f;
+constexpr float kTanhClampFMA = 7.99881172180175781f;
+constexpr float kTanhTiny = 0.0004f;
+constexpr float kTanhAlpha[7] = {4.89352455891786e-03f, 6.37261928875436e-04f, 1.48572235717979e-05f,
+                                 5.12229709037114e-08f, -8.60467152213735e-11f, 2.00018790482477e-13f,
+                                 -2.76076847742355e-16f};
+constexpr float kTanhBeta[4] = {4.89352518554385e-03f, 2.26843463243900e-03f, 1.18534705686654e-04f,
+                                1.19825839466702e-06f};
+
+// Scalar
+
+void LinearScalar(const Term* terms, const int numTerms, const float* bias, const float* residual, const long rows,
+                  const long numColumns, float* output, const long outputStride)
+{
+  for (long j = 0; j < numColumns; j++)
+  {
+    float* out = output + j * outputStride;
+    for (long i = 0; i < rows; i++)
+      out[i] = (bias != nullptr ? bias[i] : 0.0f) + (residual != nullptr ? residual[j * outputStride + i] : 0.0f);
+    for (int t = 0; t < numTerms; t++)
+    {
+      const Term& term = terms[t];
+      const float* input = term.mInput + j * term.mInputStride;
+      for (long d = 0; d < term.mDepth; d++)
+      {
+        if (term.mQuantized == nullptr)
+        {
+          const float* weights = term.mWeights + d * rows;
+          for (long i = 0; i < rows; i++)
+            out[i] += weights[i] * input[d];
+        }
+        else
+        {
+          const int8_t* weights = term.mQuantized + d * rows;
+          for (long i = 0; i < rows; i++)
+            out[i] += term.mScales[i] * (float)weights[i] * input[d];
+        }
+      }
+    }
+  }
+}
+
+float TanhScalar(const float value)
+{
+  if (std::fabs(value) < kTanhTiny)
+    return value;
+  const float x = std::min(std::max(value, -kTanhClamp), kTanhClamp);
+  const float x2 = x * x;
+  float p = kTanhAlpha[6];
+  for (int i = 5; i >= 0; i--)
+    p = p * x2 + kTanhAlpha[i];
+  float q = kTanhBeta[3];
+  for (int i = 2; i >= 0; i--)
+    q = q * x2 + kTanhBeta[i];
+  return x * p / q;
+}
+
+void TanhScalar(float* x, const long rows, const long numColumns, const long stride)
+{
+  for (long j = 0; j < numColumns; j++)
+    for (long i = 0; i < rows; i++)
+      x[j * stride + i] = TanhScalar(x[j * stride + i]);
+}
+
+float FastTanhScalar(const float value)
+{
+  const float x = std::min(std::max(value, -kFastTanhClamp), kFastTanhClamp);
+  const float x2 = x * x;
+  const float p = ((kFastTanhP[3] * x2 + kFastTanhP[2]) * x2 + kFastTanhP[1]) * x2 + kFastTanhP[0];
+  const float q = ((kFastTanhQ[3] * x2 + kFastTanhQ[2]) * x2 + kFastTanhQ[1]) * x2 + kFastTanhQ[0];
+  return x * p / q;
+}
+
+void FastTanhScalar(float* x, const long rows, const long numColumns, const long stride)
+{
+  for (long j = 0; j < numColumns; j++)
+    for (long i = 0; i < rows; i++)
+      x[j * stride + i] = FastTanhScalar(x[j * stride + i]);
+}
+
+#if DSP_KERNELS_X86
+
+// SSE4.1: 4 floats a vector, no FMA
+
+// acc += w times Columns inputs, inputStride apart
+template <int RowVectors, int Columns>
+DSP_TARGET_SSE41 inline void AccumulateSSE41(__m128 (&acc)[Columns][RowVectors], const __m128 (&w)[RowVectors],
+                                             const float* input, const long inputStride)
+{
+  for (int c = 0; c < Columns; c++)
+  {
+    const __m128 x = _mm_set1_ps(input[c * inputStride]);
+    for (int v = 0; v < RowVectors; v++)
+      acc[c][v] = _mm_add_ps(acc[c][v], _mm_mul_ps(w[v], x));
+  }
+}
+
+// Rows [row, row + 4 * RowVectors) of Columns columns from column on
+template <int RowVectors, int Columns>
+DSP_TARGET_SSE41 inline void LinearBlockSSE41(const Term* terms, const int numTerms, const float* bias,
+                                              const float* residual, const long rows, const long row,
+                                              const long column, float* output, const long outputStride)
+{
+  __m128 acc[Columns][RowVectors];
+  for (int c = 0; c < Columns; c++)
+    for (int v = 0; v < RowVectors; v++)
+    {
+      acc[c][v] = bias != nullptr ? _mm_loadu_ps(bias + row + 4 * v) : _mm_setzero_ps();
+      if (residual != nullptr)
+        acc[c][v] = _mm_add_ps(acc[c][v], _mm_loadu_ps(residual + (column + c) * outputStride + row + 4 * v));
+    }
+  for (int t = 0; t < numTerms; t++)
+  {
+    const Term& term = terms[t];
+    const float* input = term.mInput + column * term.mInputStride;
+    __m128 w[RowVectors];
+    if (term.mQuantized == nullptr)
+    {
+      const float* weights = term.mWeights + row;
+      for (long d = 0; d < term.mDepth; d++, weights += rows)
+      {
+        for (int v = 0; v < RowVectors; v++)
+          w[v] = _mm_loadu_ps(weights + 4 * v);
+        AccumulateSSE41<RowVectors, Columns>(acc, w, input + d, term.mInputStride);
+      }
+      continue;
+    }
+    __m128 scales[RowVectors];
+    for (int v = 0; v < RowVectors; v++)
+      scales[v] = _mm_loadu_ps(term.mScales + row + 4 * v);
+    const int8_t* weights = term.mQuantized + row;
+    for (long d = 0; d < term.mDepth; d++, weights += rows)
+    {
+      for (int v = 0; v < RowVectors; v++)
+      {
+        int32_t bytes;
+        std::memcpy(&bytes, weights + 4 * v, sizeof(bytes));
+        w[v] = _mm_mul_ps(scales[v], _mm_cvtepi32_ps(_mm_cvtepi8_epi32(_mm_cvtsi32_si128(bytes))));
+      }
+      AccumulateSSE41<RowVectors, Columns>(acc, w, input + d, term.mInputStride);
+    }
+  }
+  for (int c = 0; c < Columns; c++)
+    for (int v = 0; v < RowVectors; v++)
+      _mm_storeu_ps(output + (column + c) * outputStride + row + 4 * v, acc[c][v]);
+}
+
+template <int RowVectors>
+DSP_TARGET_SSE41 inline void LinearRowsSSE41(const Term* terms, const int numTerms, const float* bias,
+                                             const float* residual, const long rows, const long row,
+                                             const long numColumns, float* output, const long outputStride)
+{
+  long column = 0;
+  for (; column + 4 <= numColumns; column += 4)
+    LinearBlockSSE41<RowVectors, 4>(terms, numTerms, bias, residual, rows, row, column, output, outputStride);
+  for (; column < numColumns; column++)
+    LinearBlockSSE41<RowVectors, 1>(terms, numTerms, bias, residual, rows, row, column, output, outputStride);
+}
+
+DSP_TARGET_SSE41 void LinearSSE41(const Term* terms, const int numTerms, const float* bias, const float* residual,
+                                  const long rows, const long numColumns, float* output, const long outputStride)
+{
+  long row = 0;
+  for (; row + 8 <= rows; row += 8)
+    LinearRowsSSE41<2>(terms, numTerms, bias, residual, rows, row, numColumns, output, outputStride);
+  for (; row < rows; row += 4)
+    LinearRowsSSE41<1>(terms, numTerms, bias, residual, rows, row, numColumns, output, outputStride);
+}
+
+DSP_TARGET_SSE41 void TanhSSE41(float* x, const long rows, const long numColumns, const long stride)
+{
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  for (long j = 0; j < numColumns; j++)
+    for (long i = 0; i < rows; i += 4)
+    {
+      float* data = x + j * stride + i;
+      const __m128 value = _mm_loadu_ps(data);
+      const __m128 tiny = _mm_cmplt_ps(_mm_andnot_ps(signMask, value), _mm_set1_ps(kTanhTiny));
+      const __m128 clamped = _mm_max_ps(_mm_min_ps(value, _mm_set1_ps(kTanhClamp)), _mm_set1_ps(-kTanhClamp));
+      const __m128 x2 = _mm_mul_ps(clamped, clamped);
+      __m128 p = _mm_set1_ps(kTanhAlpha[6]);
+      for (int k = 5; k >= 0; k--)
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(kTanhAlpha[k]));
+      __m128 q = _mm_set1_ps(kTanhBeta[3]);
+      for (int k = 2; k >= 0; k--)
+        q = _mm_add_ps(_mm_mul_ps(q, x2), _mm_set1_ps(kTanhBeta[k]));
+      const __m128 result = _mm_div_ps(_mm_mul_ps(clamped, p), q);
+      _mm_storeu_ps(data, _mm_blendv_ps(result, value, tiny));
+    }
+}
+
+DSP_TARGET_SSE41 void FastTanhSSE41(float* x, const long rows, const long numColumns, const long stride)
+{
+  for (long j = 0; j < numColumns; j++)
+    for (long i = 0; i < rows; i += 4)
+    {
+      float* data = x + j * stride + i;
+      const __m128 clamped =
+        _mm_max_ps(_mm_min_ps(_mm_loadu_ps(data), _mm_set1_ps(kFastTanhClamp)), _mm_set1_ps(-kFastTanhClamp));
+      const __m128 x2 = _mm_mul_ps(clamped, clamped);
+      __m128 p = _mm_set1_ps(kFastTanhP[3]);
+      __m128 q = _mm_set1_ps(kFastTanhQ[3]);
+      for (int k = 2; k >= 0; k--)
+      {
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(kFastTanhP[k]));
+        q = _mm_add_ps(_mm_mul_ps(q, x2), _mm_set1_ps(kFastTanhQ[k]));
+      }
+      _mm_storeu_ps(data, _mm_div_ps(_mm_mul_ps(clamped, p), q));
+    }
+}
+
+// AVX2 with FMA: 8 floats a vector
+
+template <int RowVectors, int Columns>
+DSP_TARGET_AVX2 inline void AccumulateAVX2(__m256 (&acc)[Columns][RowVectors], const __m256 (&w)[RowVectors],
+                                           const float* input, const long inputStride)
+{
+  for (int c = 0; c < Columns; c++)
+  {
+    const __m256 x = _mm256_broadcast_ss(input + c * inputStride);
+    for (int v = 0; v < RowVectors; v++)
+      acc[c][v] = _mm256_fmadd_ps(w[v], x, acc[c][v]);
+  }
+}
+
+template <int RowVectors, int Columns>
+DSP_TARGET_AVX2 inline void LinearBlockAVX2(const Term* terms, const int numTerms, const float* bias,
+                                            const float* residual, const long rows, const long row,
+                                            const long column, float* output, const long outputStride)
+{
+  __m256 acc[Columns][RowVectors];
+  for (int c = 0; c < Columns; c++)
+    for (int v = 0; v < RowVectors; v++)
+    {
+      acc[c][v] = bias != nullptr ? _mm256_loadu_ps(bias + row + 8 * v) : _mm256_setzero_ps();
+      if (residual != nullptr)
+        acc[c][v] = _mm256_add_ps(acc[c][v], _mm256_loadu_ps(residual + (column + c) * outputStride + row + 8 * v));
+    }
+  for (int t = 0; t < numTerms; t++)
+  {
+    const Term& term = terms[t];
+    const float* input = term.mInput + column * term.mInputStride;
+    __m256 w[RowVectors];
+    if (term.mQuantized == nullptr)
+    {
+      const float* weights = term.mWeights + row;
+      for (long d = 0; d < term.mDepth; d++, weights += rows)
+      {
+        for (int v = 0; v < RowVectors; v++)
+          w[v] = _mm256_loadu_ps(weights + 8 * v);
+        AccumulateAVX2<RowVectors, Columns>(acc, w, input + d, term.mInputStride);
+      }
+      continue;
+    }
+    __m256 scales[RowVectors];
+    for (int v = 0; v < RowVectors; v++)
+      scales[v] = _mm256_loadu_ps(term.mScales + row + 8 * v);
+    const int8_t* weights = term.mQuantized + row;
+    for (long d = 0; d < term.mDepth; d++, weights += rows)
+    {
+      for (int v = 0; v < RowVectors; v++)
+      {
+        const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights + 8 * v));
+        w[v] = _mm256_mul_ps(scales[v], _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes)));
+      }
+      AccumulateAVX2<RowVectors, Columns>(acc, w, input + d, term.mInputStride);
+    }
+  }
+  for (int c = 0; c < Columns; c++)
+    for (int v = 0; v < RowVectors; v++)
+      _mm256_storeu_ps(output + (column + c) * outputStride + row + 8 * v, acc[c][v]);
+}
+
+template <int RowVectors>
+DSP_TARGET_AVX2 inline void LinearRowsAVX2(const Term* terms, const int numTerms, const float* bias,
+                                           const float* residual, const long rows, const long row,
+                                           const long numColumns, float* output, const long outputStride)
+{
+  long column = 0;
+  for (; column + 4 <= numColumns; column += 4)
+    LinearBlockAVX2<RowVectors, 4>(terms, numTerms, bias, residual, rows, row, column, output, outputStride);
+  for (; column < numColumns; column++)
+    LinearBlockAVX2<RowVectors, 1>(terms, numTerms, bias, residual, rows, row, column, output, outputStride);
+}
+
+DSP_TARGET_AVX2 void LinearAVX2(const Term* terms, const int numTerms, const float* bias, const float* residual,
+                                const long rows, const long numColumns, float* output, const long outputStride)
+{
+  long row = 0;
+  for (; row + 16 <= rows; row += 16)
+    LinearRowsAVX2<2>(terms, numTerms, bias, residual, rows, row, numColumns, output, outputStride);
+  for (; row < rows; row += 8)
+    LinearRowsAVX2<1>(terms, numTerms, bias, residual, rows, row, numColumns, output, outputStride);
+}
+
+DSP_TARGET_AVX2 void TanhAVX2(float* x, const long rows, const long numColumns, const long stride)
+{
+  const __m256 signMask = _mm256_set1_ps(-0.0f);
+  for (long j = 0; j < numColumns; j++)
+    for (long i = 0; i < rows; i += 8)
+    {
+      float* data = x + j * stride + i;
+      const __m256 value = _mm256_loadu_ps(data);
+      const __m256 tiny = _mm256_cmp_ps(_mm256_andnot_ps(signMask, value), _mm256_set1_ps(kTanhTiny), _CMP_LT_OQ);
+      const __m256 clamped =
+        _mm256_max_ps(_mm256_min_ps(value, _mm256_set1_ps(kTanhClampFMA)), _mm256_set1_ps(-kTanhClampFMA));
+      const __m256 x2 = _mm256_mul_ps(clamped, clamped);
+      __m256 p = _mm256_set1_ps(kTanhAlpha[6]);
+      for (int k = 5; k >= 0; k--)
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(kTanhAlpha[k]));
+      __m256 q = _mm256_set1_ps(kTanhBeta[3]);
+      for (int k = 2; k >= 0; k--)
+        q = _mm256_fmadd_ps(q, x2, _mm256_set1_ps(kTanhBeta[k]));
+      const __m256 result = _mm256_div_ps(_mm256_mul_ps(clamped, p), q);
+      _mm256_storeu_ps(data, _mm256_blendv_ps(result, value, tiny));
+    }
+}
+
+DSP_TARGET_AVX2 void FastTanhAVX2(float* x, const long rows, const long numColumns, const long stride)
+{
+  for (long j = 0; j < numColumns; j++)
+    for (long i = 0; i < rows; i += 8)
+    {
+      float* data = x + j * stride + i;
+      const __m256 clamped = _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(data), _mm256_set1_ps(kFastTanhClamp)),
+                                           _mm256_set1_ps(-kFastTanhClamp));
+      const __m256 x2 = _mm256_mul_ps(clamped, clamped);
+      __m256 p = _mm256_set1_ps(kFastTanhP[3]);
+      __m256 q = _mm256_set1_ps(kFastTanhQ[3]);
+      for (int k = 2; k >= 0; k--)
+      {
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(kFastTanhP[k]));
+        q = _mm256_fmadd_ps(q, x2, _mm256_set1_ps(kFastTanhQ[k]));
+      }
+      _mm256_storeu_ps(data, _mm256_div_ps(_mm256_mul_ps(clamped, p), q));
+    }
+}
+
+#endif
+}; // namespace
+
+const dsp::wavenet::kernels::Kernels& dsp::wavenet::kernels::GetKernels(const InstructionSet instructionSet)
+{
+  static const Kernels scalar{1, LinearScalar, TanhScalar, FastTanhScalar};
+#if DSP_KERNELS_X86
+  static const Kernels sse41{4, LinearSSE41, TanhSSE41, FastTanhSSE41};
+  static const Kernels avx2{8, LinearAVX2, TanhAVX2, FastTanhAVX2};
+  switch (instructionSet)
+  {
+    case InstructionSet::SSE41: return sse41;
+    case InstructionSet::AVX2: return avx2;
+    default: return scalar;
+  }
+#else
+  return scalar;
+#endif
+}
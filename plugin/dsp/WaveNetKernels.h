@@ -0,0 +1,70 @@
+//
+//  WaveNetKernels.h
+//
+// Hand-vectorized versions of the operations that make up a WaveNet layer
+// (dilated convolution, activation, 1x1 mixer), for each x86 instruction set
+// worth having a version for. The best one for the CPU is picked at run time
+// (see dsp::GetInstructionSet()), so one build runs well on old and new
+// machines alike.
+
+#pragma once
+
+#include <cstdint>
+
+#include "InstructionSet.h"
+
+namespace dsp
+{
+namespace wavenet
+{
+namespace kernels
+{
+using dsp::GetInstructionSet;
+using dsp::GetName;
+using dsp::InstructionSet;
+
+// Fast tanh: the Pade [7/6] approximant x * P(x^2) / Q(x^2), with the input
+// clamped to where it reaches 1. Absolute error at most 1.0e-4 (float).
+constexpr float kFastTanhClamp = 4.97178f;
+constexpr float kFastTanhP[4] = {135135.0f, 17325.0f, 378.0f, 1.0f};
+constexpr float kFastTanhQ[4] = {135135.0f, 62370.0f, 3150.0f, 28.0f};
+
+// One product in a layer's output: a (rows, depth) weight matrix times
+// numColumns columns of input, each of depth floats and inputStride apart.
+// The weights are either floats or, with mQuantized set, 8-bit with a scale
+// per row: weight (i, d) is mScales[i] * mQuantized[d * rows + i]. Those are
+// converted in registers as they're used, never stored as floats.
+struct Term
+{
+  const float* mWeights;
+  long mDepth;
+  const float* mInput;
+  long mInputStride;
+  const int8_t* mQuantized = nullptr;
+  const float* mScales = nullptr;
+};
+
+// The operations for one instruction set. All matrices are float and
+// column-major.
+struct Kernels
+{
+  // The number of rows of every matrix must be a multiple of this
+  long mRowMultiple;
+  // output = residual + bias + the sum of the terms' products, for rows rows
+  // and numColumns columns. The columns of output, and of residual, are
+  // outputStride apart. bias and residual can be null.
+  void (*mLinear)(const Term* terms, const int numTerms, const float* bias, const float* residual, const long rows,
+                  const long numColumns, float* output, const long outputStride);
+  // x = tanh(x), with the same approximation as Eigen's float tanh. Columns
+  // are stride apart.
+  void (*mTanh)(float* x, const long rows, const long numColumns, const long stride);
+  // Same with the fast tanh (see kFastTanhP)
+  void (*mFastTanh)(float* x, const long rows, const long numColumns, const long stride);
+};
+
+// Kernels for an instruction set, which must be supported (see
+// GetInstructionSet()).
+const Kernels& GetKernels(const InstructionSet instructionSet);
+}; // namespace kernels
+}; // namespace wavenet
+}; // namespace dsp
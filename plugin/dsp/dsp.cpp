@@ -15,28 +15,48 @@
 
 #include "dsp.h"
 
-dsp::DSP::DSP()
+template <typename T>
+dsp::DSP<T>::DSP()
 : mOutputPointers(nullptr)
 , mOutputPointersSize(0)
 {
 }
 
-dsp::DSP::~DSP()
+template <typename T>
+dsp::DSP<T>::~DSP()
 {
   this->_DeallocateOutputPointers();
 };
 
-void dsp::DSP::_AllocateOutputPointers(const size_t numChannels)
+template <typename T>
+void dsp::DSP<T>::Prepare(const size_t numChannels, const size_t maxFrames)
+{
+  // The buffers keep their capacity when a later, shorter block shrinks them.
+  this->_PrepareBuffers(numChannels, maxFrames);
+}
+
+template <typename T>
+void dsp::DSP<T>::ProcessInPlace(T* const* buffers, const size_t numChannels, const size_t numFrames)
+{
+  T** outputs = this->Process(const_cast<T**>(buffers), numChannels, numFrames);
+  for (size_t c = 0; c < numChannels; c++)
+    if (outputs[c] != buffers[c])
+      std::copy(outputs[c], outputs[c] + numFrames, buffers[c]);
+}
+
+template <typename T>
+void dsp::DSP<T>::_AllocateOutputPointers(const size_t numChannels)
 {
   if (this->mOutputPointers != nullptr)
     throw std::runtime_error("Tried to re-allocate over non-null mOutputPointers");
-  this->mOutputPointers = new DSP_SAMPLE*[numChannels];
+  this->mOutputPointers = new T*[numChannels];
   if (this->mOutputPointers == nullptr)
     throw std::runtime_error("Failed to allocate pointer to output buffer!\n");
   this->mOutputPointersSize = numChannels;
 }
 
-void dsp::DSP::_DeallocateOutputPointers()
+template <typename T>
+void dsp::DSP<T>::_DeallocateOutputPointers()
 {
   if (this->mOutputPointers != nullptr)
   {
@@ -48,14 +68,16 @@ void dsp::DSP::_DeallocateOutputPointers()
   this->mOutputPointersSize = 0;
 }
 
-DSP_SAMPLE** dsp::DSP::_GetPointers()
+template <typename T>
+T** dsp::DSP<T>::_GetPointers()
 {
   for (auto c = 0; c < this->_GetNumChannels(); c++)
     this->mOutputPointers[c] = this->mOutputs[c].data();
   return this->mOutputPointers;
 }
 
-void dsp::DSP::_PrepareBuffers(const size_t numChannels, const size_t numFrames)
+template <typename T>
+void dsp::DSP<T>::_PrepareBuffers(const size_t numChannels, const size_t numFrames)
 {
   const size_t oldFrames = this->_GetNumFrames();
   const size_t oldChannels = this->_GetNumChannels();
@@ -72,7 +94,8 @@ void dsp::DSP::_PrepareBuffers(const size_t numChannels, const size_t numFrames)
       this->mOutputs[c].resize(numFrames);
 }
 
-void dsp::DSP::_ResizePointers(const size_t numChannels)
+template <typename T>
+void dsp::DSP<T>::_ResizePointers(const size_t numChannels)
 {
   if (this->mOutputPointersSize == numChannels)
     return;
@@ -80,48 +103,61 @@ void dsp::DSP::_ResizePointers(const size_t numChannels)
   this->_AllocateOutputPointers(numChannels);
 }
 
-dsp::History::History()
-: DSP()
+template <typename T>
+dsp::History<T>::History()
+: DSP<T>()
 , mHistoryRequired(0)
 , mHistoryIndex(0)
 {
 }
 
-void dsp::History::_AdvanceHistoryIndex(const size_t bufferSize)
+template <typename T>
+void dsp::History<T>::Prepare(const size_t numChannels, const size_t maxFrames)
 {
-  this->mHistoryIndex += bufferSize;
+  this->DSP<T>::Prepare(numChannels, maxFrames);
+  this->_EnsureHistorySize(std::max(this->_GetMaxHistoryRequired(), this->mHistoryRequired), maxFrames);
 }
 
-void dsp::History::_EnsureHistorySize(const size_t bufferSize)
+template <typename T>
+void dsp::History<T>::_AdvanceHistoryIndex(const size_t bufferSize)
 {
-  const size_t repeatSize = std::max(bufferSize, this->mHistoryRequired);
-  const size_t requiredHistoryArraySize = 10 * repeatSize; // Just so we don't spend too much time copying back.
-  if (this->mHistory.size() < requiredHistoryArraySize)
-  {
-    this->mHistory.resize(requiredHistoryArraySize);
-    std::fill(this->mHistory.begin(), this->mHistory.end(), 0.0f);
-    this->mHistoryIndex = this->mHistoryRequired; // Guaranteed to be less than
-                                                  // requiredHistoryArraySize
-  }
+  this->mHistoryIndex = (this->mHistoryIndex + bufferSize) % this->_GetRingSize();
 }
 
-void dsp::History::_RewindHistory()
+template <typename T>
+void dsp::History<T>::_EnsureHistorySize(const size_t historyRequired, const size_t bufferSize)
 {
-  // TODO memcpy?  Should be fine w/ history array being >2x the history length.
-  for (size_t i = 0, j = this->mHistoryIndex - this->mHistoryRequired; i < this->mHistoryRequired; i++, j++)
-    this->mHistory[i] = this->mHistory[j];
-  this->mHistoryIndex = this->mHistoryRequired;
+  const size_t requiredRingSize = historyRequired + bufferSize;
+  if (this->_GetRingSize() < requiredRingSize)
+  {
+    this->mHistory.assign(2 * requiredRingSize, 0.0f);
+    this->mHistoryIndex = 0;
+  }
 }
 
-void dsp::History::_UpdateHistory(DSP_SAMPLE** inputs, const size_t numChannels, const size_t numFrames)
+template <typename T>
+void dsp::History<T>::_UpdateHistory(const T* const* inputs, const size_t numChannels, const size_t numFrames)
 {
-  this->_EnsureHistorySize(numFrames);
+  this->_EnsureHistorySize(this->mHistoryRequired, numFrames);
   if (numChannels < 1)
     throw std::runtime_error("Zero channels?");
-  if (this->mHistoryIndex + numFrames >= this->mHistory.size())
-    this->_RewindHistory();
+  const size_t ringSize = this->_GetRingSize();
+  // Position of the buffer in the ring
+  const size_t start = this->mHistoryIndex % ringSize;
   // Grabs channel 1, drops hannel 2.
-  for (size_t i = 0, j = this->mHistoryIndex; i < numFrames; i++, j++)
+  for (size_t i = 0, j = start; i < numFrames; i++, j = j + 1 < ringSize ? j + 1 : 0)
+  {
     // Convert down to float here.
-    this->mHistory[j] = (float)inputs[0][i];
+    const float sample = (float)inputs[0][i];
+    this->mHistory[j] = sample;
+    this->mHistory[j + ringSize] = sample;
+  }
+  // Read from the second copy if the history wraps around the start of the
+  // first; either way the history and the buffer fit in the two copies.
+  this->mHistoryIndex = start < this->mHistoryRequired ? start + ringSize : start;
 }
+
+template class dsp::DSP<float>;
+template class dsp::DSP<double>;
+template class dsp::History<float>;
+template class dsp::History<double>;
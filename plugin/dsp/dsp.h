@@ -21,6 +21,9 @@ class Params
 {
 };
 
+// Templated on the sample type T of the audio going in and out; float and
+// double are instantiated (in dsp.cpp and the modules' sources).
+template <typename T = DSP_SAMPLE>
 class DSP
 {
 public:
@@ -32,7 +35,15 @@ public:
   // The output shall be a pointer-to-pointers of matching size.
   // This object instance will own the data referenced by the pointers and be
   // responsible for its allocation and deallocation.
-  virtual DSP_SAMPLE** Process(DSP_SAMPLE** inputs, const size_t numChannels, const size_t numFrames) = 0;
+  virtual T** Process(T** inputs, const size_t numChannels, const size_t numFrames) = 0;
+  // Process the audio in place: the output overwrites buffers.
+  // By default this copies the output of .Process() back; modules that can
+  // override it to work in the buffers directly, without the copy.
+  virtual void ProcessInPlace(T* const* buffers, const size_t numChannels, const size_t numFrames);
+  // Allocate everything that processing numChannels channels of up to
+  // maxFrames frames needs, so that .Process() doesn't allocate as long as it's
+  // given no more than that. Not real-time safe: call it before processing.
+  virtual void Prepare(const size_t numChannels, const size_t maxFrames);
   // Update the parameters of the DSP object according to the provided params.
   // Not declaring a pure virtual bc there's no concrete definition that can
   // use Params.
@@ -52,7 +63,7 @@ protected:
   size_t _GetNumFrames() const { return this->_GetNumChannels() > 0 ? this->mOutputs[0].size() : 0; }
   // Return a pointer-to-pointers for the DSP's output buffers (all channels)
   // Assumes that ._PrepareBuffers()  was called recently enough.
-  DSP_SAMPLE** _GetPointers();
+  T** _GetPointers();
   // Resize mOutputs to (numChannels, numFrames) and ensure that the raw
   // pointers are also keeping up.
   virtual void _PrepareBuffers(const size_t numChannels, const size_t numFrames);
@@ -64,46 +75,62 @@ protected:
   // The output array into which the DSP module's calculations will be written.
   // Pointers to this member's data will be returned by .Process(), and std
   // Will ensure proper allocation.
-  std::vector<std::vector<DSP_SAMPLE>> mOutputs;
+  std::vector<std::vector<T>> mOutputs;
   // A pointer to pointers of which copies will be given out as the output of
   // .Process(). This object will ensure proper allocation and deallocation of
   // the first level; The second level points to .data() from mOutputs.
-  DSP_SAMPLE** mOutputPointers;
+  T** mOutputPointers;
   size_t mOutputPointersSize;
 };
 
 // A class where a longer buffer of history is needed to correctly calculate
 // the DSP algorithm (e.g. algorithms involving convolution).
 //
+// The history is a ring buffer stored twice in a row (every sample is written
+// to both copies), so the current buffer and the history before it are always
+// contiguous, without ever copying the history back to the start.
+//
 // Hacky stuff:
 // * Mono
-// * Single-precision floats.
-class History : public DSP
+// * Single-precision floats in the history, whatever T is.
+template <typename T = DSP_SAMPLE>
+class History : public DSP<T>
 {
 public:
   History();
+  // Also sizes the history for blocks of up to maxFrames and for
+  // _GetMaxHistoryRequired(), so that new weights don't reallocate it.
+  void Prepare(const size_t numChannels, const size_t maxFrames) override;
 
 protected:
-  // Called at the end of the DSP, advance the hsitory index to the next open
-  // spot.  Does not ensure that it's at a valid address.
+  // The most history the module can need with any weights it accepts.
+  // Modules whose mHistoryRequired can grow after Prepare() override it.
+  virtual size_t _GetMaxHistoryRequired() const { return this->mHistoryRequired; };
+  // Called at the end of the DSP, advance the history index past the buffer.
   void _AdvanceHistoryIndex(const size_t bufferSize);
   // Drop the new samples into the history array.
-  // Manages history array size
-  void _UpdateHistory(DSP_SAMPLE** inputs, const size_t numChannels, const size_t numFrames);
+  // Grows the history array (which allocates) if it wasn't prepared for this
+  // many frames.
+  void _UpdateHistory(const T* const* inputs, const size_t numChannels, const size_t numFrames);
 
-  // The history array that's used for DSP calculations.
+  // The history array that's used for DSP calculations: the ring buffer,
+  // twice.
   std::vector<float> mHistory;
   // How many samples previous are required.
   // Zero means that no history is required--only the current sample.
   size_t mHistoryRequired;
   // Location of the first sample in the current buffer.
-  // Shall always be in the range [mHistoryRequired, mHistory.size()).
+  // After _UpdateHistory(), mHistory[mHistoryIndex - mHistoryRequired] to
+  // mHistory[mHistoryIndex + numFrames - 1] are the history and the buffer,
+  // in order.
   size_t mHistoryIndex;
 
 private:
-  // Make sure that the history array is long enough.
-  void _EnsureHistorySize(const size_t bufferSize);
-  // Copy the end of the history back to the fron and reset mHistoryIndex
-  void _RewindHistory();
+  // Make sure that the ring buffer is long enough for historyRequired samples
+  // of history and a buffer of bufferSize. Clears the history if it has to
+  // grow it.
+  void _EnsureHistorySize(const size_t historyRequired, const size_t bufferSize);
+  // Length of the ring buffer (half of mHistory)
+  size_t _GetRingSize() const { return this->mHistory.size() / 2; };
 };
 }; // namespace dsp
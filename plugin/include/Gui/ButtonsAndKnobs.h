@@ -787,12 +787,10 @@ private:
                                    {
                 juce::File file = fc.getResult();
                 if (file != juce::File{}) {
-                    dsp::wav::LoadReturnCode wavState = dsp::wav::LoadReturnCode::ERROR_OTHER;
                     juce::String dspPath = file.getFullPathName();
 
                     //populate custom IR dropdown
                     juce::StringArray customIRs = audioProcessor.loadUserIRsFromDirectory(dspPath);
-                    audioProcessor.resampleUserIRs(audioProcessor.projectSr);
                     audioProcessor.updateAllIRs(customIRs);
 
                     juce::String selectedFileName = file.getFileNameWithoutExtension();
@@ -800,9 +798,8 @@ private:
                     for (int i = 0; i < customIRs.size() - 1; i++) { // -1 to exclude "Off"
                         if (customIRs[i] == selectedFileName) {
                             selectedIndex = i;
-                            auto raw_dspPath = dspPath.toRawUTF8();
-                            audioProcessor.mStagedIR = audioProcessor.userIRs[i];
-                            wavState = audioProcessor.mStagedIR->GetWavState();
+                            // Decoded in the background, and staged when it's ready
+                            audioProcessor.setCustomIR(i);
                             break;
                         }
                     }
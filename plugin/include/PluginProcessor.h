@@ -20,8 +20,13 @@
 #include "../dsp/ResamplingContainer/ResamplingContainer.h"
 #include <Eigen/Dense>
 #include "../dsp/ImpulseResponse.h"
+#include "../dsp/ModelHotSwap.h"
+#include "../dsp/SharedWaveNet.h"
 #include "Utility/ParameterHelper.h"
+#include "Utility/TaskGroup.h"
 #include "Service/PresetManager.h"
+#include "Service/ModelBank.h"
+#include "Service/ModelScheduler.h"
 #include <LicenseSpring/LicenseManager.h>
 #include "AppConfig.h"
 #include "defines.h"
@@ -32,7 +37,8 @@ using namespace juce;
 //==============================================================================
 /**
 */
-class EqAudioProcessor  : public juce::AudioProcessor
+class EqAudioProcessor  : public juce::AudioProcessor,
+                          private juce::AsyncUpdater
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
@@ -76,9 +82,11 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     // Per-instance resources (each instance needs its own copy to avoid race conditions during processing)
-    std::vector<std::shared_ptr<nam::DSP>> models;
-    std::vector<std::shared_ptr<dsp::ImpulseResponse>> factoryIRs;
-    std::vector<std::shared_ptr<dsp::ImpulseResponse>> originalFactoryIRs;
+    // Models are materialized on first use; see setModel()
+    std::unique_ptr<Service::ModelBank> modelBank;
+    std::vector<std::shared_ptr<dsp::ImpulseResponse<float>>> factoryIRs;
+    // Factory and user IRs are played without their near-silent tails
+    static constexpr dsp::IRTrimParams irTrimParams {true, -80.0};
 
     std::atomic<bool> licenseVisibility {false};
 
@@ -99,8 +107,12 @@ public:
     std::shared_ptr<nam::DSP> amp1_model = nullptr;
     std::shared_ptr<nam::DSP> old_model;
     Eigen::VectorXf mWeight;
-    std::shared_ptr<dsp::ImpulseResponse> mIR = nullptr;
-    std::shared_ptr<dsp::ImpulseResponse> mStagedIR = nullptr;
+    std::shared_ptr<dsp::ImpulseResponse<float>> mIR = nullptr;
+    std::shared_ptr<dsp::ImpulseResponse<float>> mStagedIR = nullptr;
+    // Right-hand cab of a stereo amp, staged along with mStagedIR; null when
+    // the amp is mono
+    std::shared_ptr<dsp::ImpulseResponse<float>> mIRRight = nullptr;
+    std::shared_ptr<dsp::ImpulseResponse<float>> mStagedIRRight = nullptr;
     juce::String p1n = Constants::factoryPresets[0];
     juce::String p2n = Constants::factoryPresets[1];
     juce::String p3n = Constants::factoryPresets[2];
@@ -115,15 +127,20 @@ public:
     juce::StringArray loadUserIRsFromDirectory(const juce::String& customIRPath);
     juce::File writeBinaryDataToTempFile(const void* data, int size, const juce::String& fileName);
     std::tuple<std::unique_ptr<juce::XmlElement>, juce::File> writePresetBinaryDataToTempFile(const void* data, int size, const juce::String& fileName);
-    const std::vector<std::shared_ptr<nam::DSP>>& getModels() const
+    std::vector<std::shared_ptr<nam::DSP>> getModels() const
     {
-        return models;
+        return modelBank->getModels();
     }
+    // Shortest time between two model swaps during gain sweeps
+    void setModelTransitionInterval(double seconds) { modelScheduler.setMinInterval(seconds); }
+    Service::ModelScheduler::Counters getModelTransitionCounters() const { return modelScheduler.getCounters(); }
 
     // Per-instance initialization methods
     void initializeModels();
     void initializeIRs();
-    void loadModel(const int amp_idx, double gainLvl, unsigned long i);
+    static std::string getModelResourceName(const int amp_idx, double gainLvl);
+    // The factory IRs' audio, in BinaryData (never copied)
+    static const std::vector<dsp::IRSource>& getFactoryIRSources();
     void loadIR(const int i, double sampleRate = 48000.0);
 
     void setPresetPath(const juce::String& newPath) { presetPath = newPath; }
@@ -144,28 +161,38 @@ public:
         }
     }
     void getFactoryIR(int i) {
+        initTasks.wait();
+        pendingUserIR = -1;
         if (i < factoryIRs.size()) {
-            mStagedIR = factoryIRs[i];
+            stageIR(factoryIRs[i]);
             irEnabled.store(true);
         }
         else {
             irEnabled.store(false);
         }
     }
-    void setCustomIR(int i) {
-        if (i < userIRs.size()) {
-            mStagedIR = userIRs[i];
-            irEnabled.store(true);
-        } else {
-            irEnabled.store(false);
-        }
-    }
+    // Stage user IR i. Never blocks: if it hasn't been decoded yet, it's
+    // loaded in the background and staged from handleAsyncUpdate() when
+    // it's ready. The entries either side are decoded ahead of time.
+    void setCustomIR(int i);
 
     void enableSmoothing() {
         valueTreeState.getParameterAsValue("amp smooth").setValue(true);
     }
+    // Stage the model for model_id. Never blocks: if the model hasn't been
+    // materialized yet, it's loaded in the background and staged from
+    // handleAsyncUpdate() when it's ready.
     void setModel() {
-        amp1_dsp = models[model_id];
+        const int id = model_id;
+        if (auto model = modelBank->getIfLoaded(id)) {
+            stageModel(model);
+            pendingModelId = -1;
+        }
+        else {
+            pendingModelId = id;
+        }
+        activeBlend = -1;
+        prefetchNeighbouringModels(id);
     }
     void setOldModel() {
         old_model = amp1_dsp;
@@ -203,8 +230,11 @@ public:
     void loadFactoryPresets(int i);
     int findUserIRIndexByPath(const juce::String& path);
     void restoreIRFromState();
-    std::vector<std::shared_ptr<dsp::ImpulseResponse>> userIRs;
-    std::vector<std::shared_ptr<dsp::ImpulseResponse>> originalUserIRs;
+    // One entry per file in the custom IR folder. The IRs are decoded on
+    // demand (see loadUserIR()), so an entry is nullptr until then.
+    std::vector<std::shared_ptr<dsp::ImpulseResponse<float>>> userIRs;
+    // The same IRs at the rate of their file, to resample from
+    std::vector<std::shared_ptr<dsp::ImpulseResponse<float>>> originalUserIRs;
     std::vector<juce::String> userIRPaths;  // Store paths for recall
     juce::ComboBox irDropdown;
     juce::ComboBox userIRDropdown;
@@ -231,17 +261,27 @@ public:
     std::atomic<bool> stateInformationSet { false };
     double sizePortion = 0.75;
     double projectSr = 48000.0;
-    void resampleUserIRs(double projectSr);
+    // Largest block the host said it would send (see prepareToPlay())
+    int maxBlockSize = 512;
     std::atomic<bool> licenseActivated { false };
     LicenseSpring::LicenseManager::ptr_t licenseManager;
 private:
     std::atomic<float> smoothMix { 0.f };
     std::unique_ptr<Service::PresetManager> presetManager;
+    // Setup jobs started by the constructor (factory IR loads)
+    Utility::TaskGroup initTasks;
+    // IRs being remade at a new sample rate (see resampleIRs())
+    Utility::TaskGroup irTasks;
+    // User IRs being decoded (see loadUserIR())
+    Utility::TaskGroup userIRTasks;
     //==============================================================================
     array<NAM_SAMPLE, Constants::BUFFERSIZE> dataIn = {};
     array<NAM_SAMPLE, Constants::BUFFERSIZE> dataOut = {};
     array<NAM_SAMPLE, Constants::BUFFERSIZE> crossfadeBuffer = {};
-    double **irIn;
+    // Both sides of a stereo input, and the right side of the amp's output
+    array<NAM_SAMPLE, Constants::BUFFERSIZE> dataInL = {};
+    array<NAM_SAMPLE, Constants::BUFFERSIZE> dataInR = {};
+    array<NAM_SAMPLE, Constants::BUFFERSIZE> dataOutR = {};
     juce::LinearSmoothedValue<float> inputGain {1.f};
     juce::LinearSmoothedValue<float> outputGain {1.f};
     juce::LinearSmoothedValue<float> hallWet {0.f};
@@ -249,7 +289,7 @@ private:
     juce::LinearSmoothedValue<float> eq2Gain {0.f};
     unsigned long numModelFiles = 38;
     juce::String presetPath = "";
-    std::shared_ptr<dsp::ImpulseResponse> identityIR;
+    std::shared_ptr<dsp::ImpulseResponse<float>> identityIR;
     std::atomic<bool> irEnabled { false };
     bool isStandalone = juce::JUCEApplicationBase::isStandaloneApp();
     int fftSize;
@@ -315,50 +355,173 @@ private:
     vector<float> interpBuf;
     unsigned int interpSmplCnt = 0;
     unsigned int interpSize;
+    // Length of the amp crossfade, and the low-pass that opens up along it,
+    // at the rate the crossfade is done at
+    struct AmpCrossfade
+    {
+        AmpCrossfade() = default;
+        AmpCrossfade(double sampleRate)
+        {
+            const float K = tan(M_PI*3000.0/sampleRate);
+            size = (unsigned int)(0.2*sampleRate);
+            b0 = K/(K+1);
+            b1 = K/(K+1);
+            a1 = (K-1)/(K+1);
+        }
+        unsigned int size = 1;
+        float b0 = 1.f, b1 = 0.f, a1 = 0.f;
+    };
+    // At the project's rate, and at the models' rate when the models are
+    // crossfaded between the resamplers
+    AmpCrossfade projectCrossfade, modelCrossfade;
+    // Crossfades output from oldOutput to itself, through the low-pass.
+    // Returns whether the crossfade is over, in which case the rest of output
+    // is left as it is and old_model should become the playing model.
+    bool crossfadeModels(NAM_SAMPLE* output, const NAM_SAMPLE* oldOutput, int numFrames, const AmpCrossfade& crossfade);
     unsigned int presetInterpSmplCnt[2] = {0, 0};
     unsigned int presetInterpSize;
     float lastAmpOut = 0;
     dsp::ResamplingContainer<NAM_SAMPLE, 1, 12> mResampler1; // process current model
     dsp::ResamplingContainer<NAM_SAMPLE, 1, 12> mResampler2; // process old model
+    dsp::ResamplingContainer<NAM_SAMPLE, 2, 12> mResamplerStereo; // process current model, stereo input
     dsp::ResamplingContainer<NAM_SAMPLE, 1, 12> irResampler; // process old model
-    std::function<void(NAM_SAMPLE**, NAM_SAMPLE**, int)> setResamplingModelProcess (std::shared_ptr<nam::DSP> model)
+    // Runs a mono model on a block inside a resampling container. Holds the
+    // model by raw pointer (whoever passes it keeps it alive), so handing it
+    // to ProcessBlock() allocates nothing and touches no reference count.
+    struct ModelProcess
     {
-        // Capture the raw pointer by value:
-        return [model] (NAM_SAMPLE** input,
-                       NAM_SAMPLE** output,
-                       int         numFrames)
+        nam::DSP* model;
+        void operator()(NAM_SAMPLE** input, NAM_SAMPLE** output, int numFrames) const
         {
-            // forward exactly as before:
-            model->process (input[0],
-                           output[0],
-                           numFrames);
+            model->process(input[0], output[0], numFrames);
             model->finalize_(numFrames);
-        };
-    }
-    std::function<double**(double**, int)> setResamplingIRProcess (std::shared_ptr<dsp::ImpulseResponse> ir)
+        }
+    };
+    // IRs remade at a new sample rate by resampleIRs(), to be swapped in on
+    // the message thread (see applyIRVariants())
+    struct IRVariants
     {
-        // Capture the raw pointer by value:
-        return [ir] (double** input,
-                       int         numFrames)
-        {
-            // forward exactly as before:
-            return ir->Process (input, 1, numFrames);
-        };
-    }
-    std::function<void(std::shared_ptr<nam::DSP>)> mBlockProcessFunc;
-    std::function<void(NAM_SAMPLE**, NAM_SAMPLE**, int)> resampleProcessFunc;
-    void resampleFactoryIRs(double projectSr);
+        // irVariantsGeneration they were requested in
+        int generation = 0;
+        double sampleRate = 0.0;
+        // The user IRs they were made from
+        std::vector<std::shared_ptr<dsp::ImpulseResponse<float>>> userSources;
+        std::vector<std::shared_ptr<dsp::ImpulseResponse<float>>> factory;
+        std::vector<std::shared_ptr<dsp::ImpulseResponse<float>>> user;
+        std::atomic<int> numPending { 0 };
+    };
+    // Remake the factory and user IRs at targetSr in the background, from
+    // Service::IRCache. Until they're ready, the current ones keep playing.
+    void resampleIRs(double targetSr);
+    void applyIRVariants(const IRVariants& variants);
+    std::mutex irVariantsMutex;
+    std::shared_ptr<IRVariants> readyIRVariants;
+    // Bumped by each resampleIRs(), so that a batch that finishes after a
+    // later one doesn't replace it. Guarded by irVariantsMutex.
+    int irVariantsGeneration = 0;
+    // Sample rate that factoryIRs and userIRs play at
+    double irSampleRate = 48000.0;
+    // Decode user IR i and make it at the project's rate in the background,
+    // unless it's loaded or queued already. It's handed over to the message
+    // thread in handleAsyncUpdate().
+    void loadUserIR(int i);
+    struct LoadedUserIR
+    {
+        // userIRGeneration it was queued in
+        int generation = 0;
+        int index = 0;
+        double sampleRate = 0.0;
+        int blockSize = 0;
+        std::shared_ptr<dsp::ImpulseResponse<float>> original;
+        // nullptr if the file couldn't be read
+        std::shared_ptr<dsp::ImpulseResponse<float>> ir;
+    };
+    void applyLoadedUserIRs();
+    std::mutex userIRMutex;
+    std::vector<LoadedUserIR> readyUserIRs;
+    // Bumped each time the folder is listed, so that IRs decoded from the
+    // previous one are dropped
+    int userIRGeneration = 0;
+    // Entries that have been queued by loadUserIR()
+    std::vector<bool> userIRQueued;
+    // User IR selected while it was still being decoded, or -1
+    int pendingUserIR = -1;
     
+    // Queue the models the user is likely to pick next: the given one, the
+    // gain steps either side of it and the same gain on the other amp.
+    void prefetchNeighbouringModels(int id);
+    void handleAsyncUpdate() override;
+    // Model selected while it was still being loaded, or -1
+    std::atomic<int> pendingModelId { -1 };
+
+    // Gain settings between two captures are played by blending the weights
+    // of the captures either side, where those blend cleanly. Returns false
+    // if the setting has to snap to a capture instead (blending is off, the
+    // pair doesn't blend, or it hasn't been checked/loaded yet).
+    bool setBlendedModel(int ampStart, float gainLvl);
+    // The blend being played and the one before it, which may still be
+    // fading out
+    std::shared_ptr<dsp::wavenet::BlendedWaveNet> blendedModels[2];
+    // Index into blendedModels of the blend being played, or -1
+    int activeBlend = -1;
+    // Bank index of the lower capture of the active blend
+    int blendPair = -1;
+    int blendAmpStart = -1;
+    // Pair waiting on a blend check or a model load, or -1
+    std::atomic<int> pendingBlendPair { -1 };
+
     double modelSr = 48000.0;
+
+    // Switch to a model. It's warmed up on the recent input off the audio
+    // thread and swapped in by modelSwapper with a short crossfade, as
+    // scheduled by modelScheduler; models that can't be warmed up fall back
+    // to the long crossfade ("amp smooth").
+    // isUnused: model isn't played or shared, so it can be warmed up as is
+    // instead of on a new instance.
+    void stageModel(std::shared_ptr<nam::DSP> model, bool isUnused = false);
+    // The factory captures are indistinguishable with fast activations
+    // (tests/AccuracyTest.cpp fails any factory model whose ESR against exact
+    // activations is over 1e-5), so every amp model plays with them: the bank
+    // builds its models with them, and blends get them when they're made
+    static constexpr dsp::wavenet::ActivationAccuracy ampActivationAccuracy = dsp::wavenet::ActivationAccuracy::FAST;
+    // Last model passed to stageModel()
+    std::shared_ptr<nam::DSP> stagedModel;
+    dsp::hotswap::Swapper modelSwapper { modelSr };
+    // Coalesces and rate-limits model changes; declared after the swapper it uses
+    Service::ModelScheduler modelScheduler { modelSwapper, modelSr };
+
+    // With "amp stereo" on and a stereo input, both sides go through the amp
+    // (one instance, on the same weights) and each gets its own cab. This is
+    // for width, not speed: it costs about as much as two mono amps.
+    // Channels of the model instances staged from now on
+    int ampChannels = 1;
+    // Channels the audio thread wants, given the parameter and the layout
+    std::atomic<int> requestedAmpChannels { 1 };
+    std::atomic<float>* ampStereoParameter = nullptr;
+    // With "amp low memory" on, the amp models are stored with 8-bit weights
+    // (see dsp::wavenet::Precision); set on the audio thread, applied to the
+    // model bank by handleAsyncUpdate()
+    std::atomic<bool> requestedLowMemory { false };
+    std::atomic<float>* ampLowMemoryParameter = nullptr;
+    // Stage ir as the cab, with a second instance for the right side if the
+    // amp is stereo
+    void stageIR(std::shared_ptr<dsp::ImpulseResponse<float>> ir);
+    // Last IR passed to stageIR()
+    std::shared_ptr<dsp::ImpulseResponse<float>> selectedIR;
+    // Right-side instance stageIR() made for rightIRFor, kept so that
+    // switching the amp between mono and stereo doesn't make it again
+    std::shared_ptr<dsp::ImpulseResponse<float>> rightIR;
+    std::weak_ptr<dsp::ImpulseResponse<float>> rightIRFor;
     
     juce::LinearSmoothedValue<float> rmsIn;
     juce::LinearSmoothedValue<float> rmsLeftOut;
     
     bool noiseGateActive = true;
-    dsp::noise_gate::Trigger mNoiseGateTrigger;
-    dsp::noise_gate::Gain mNoiseGateGain;
+    // The trigger listens to the amp's input, the gain works on the buffer
+    dsp::noise_gate::Trigger<NAM_SAMPLE> mNoiseGateTrigger;
+    dsp::noise_gate::Gain<float> mNoiseGateGain;
     
-    float K, b0, b1, a0, a1, y1, x1, lpfMix;
+    float a0, y1, x1, lpfMix;
     float mix;
     
     float *reverbWetL;
@@ -0,0 +1,85 @@
+#include "IRCache.h"
+
+namespace Service
+{
+	IRCache& IRCache::getInstance()
+	{
+		static IRCache instance;
+		return instance;
+	}
+
+	uint64_t IRCache::getKey(const dsp::IRSource& source, double sampleRate)
+	{
+		// FNV-1a over both rates and the samples
+		uint64_t hash = 14695981039346656037ull;
+		auto add = [&hash] (const void* data, size_t size)
+		{
+			const auto* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; i++)
+			{
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		};
+		add(&source.mSampleRate, sizeof(double));
+		add(&sampleRate, sizeof(double));
+		add(source.mSamples, source.mNumSamples * sizeof(float));
+		return hash;
+	}
+
+	std::shared_ptr<const IRCache::IRData> IRCache::getVariant(const dsp::IRSource& source, double sampleRate)
+	{
+		const uint64_t key = getKey(source, sampleRate);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto it = index.find(key);
+			if (it != index.end())
+			{
+				entries.splice(entries.begin(), entries, it->second);
+				return it->second->variant;
+			}
+		}
+
+		// Resample outside of the lock so that different IRs can be resampled
+		// concurrently.
+		auto variant = std::make_shared<const IRData>(dsp::ImpulseResponse<float>::Resample(source, sampleRate));
+
+		std::lock_guard<std::mutex> lock(mutex);
+		// Another thread may have made the same variant in the meantime; keep
+		// a single copy.
+		auto it = index.find(key);
+		if (it != index.end())
+		{
+			entries.splice(entries.begin(), entries, it->second);
+			return it->second->variant;
+		}
+		entries.push_front({ key, variant });
+		index[key] = entries.begin();
+		sizeInBytes += variant->mRawAudio.size() * sizeof(float);
+		// Keep at least the new variant, however big it is
+		while (sizeInBytes > maxBytes && entries.size() > 1)
+		{
+			const Entry& oldest = entries.back();
+			sizeInBytes -= oldest.variant->mRawAudio.size() * sizeof(float);
+			index.erase(oldest.key);
+			entries.pop_back();
+		}
+		return variant;
+	}
+
+	std::shared_ptr<dsp::ImpulseResponse<float>> IRCache::createIR(const dsp::IRSource& source, double sampleRate,
+	                                                               const dsp::IRTrimParams& trimParams)
+	{
+		using IR = dsp::ImpulseResponse<float>;
+		if (source.mSampleRate == sampleRate)
+			return std::make_shared<IR>(source, sampleRate, IR::ConvolutionMode::PARTITIONED, trimParams);
+		return std::make_shared<IR>(
+			IR::MakeSource(getVariant(source, sampleRate)), sampleRate, IR::ConvolutionMode::PARTITIONED, trimParams);
+	}
+
+	size_t IRCache::getSizeInBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return sizeInBytes;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "ImpulseResponse.h"
+
+namespace Service
+{
+	// Process-wide store of IRs resampled to the rates they're played at.
+	//
+	// Switching a project between sample rates used to resample every factory
+	// and user IR again each time. Instead, each variant is made once, keyed
+	// by a hash of the source IR and the rate, and kept for every instance:
+	// going back to a rate that was played before costs nothing more than
+	// building the convolution from the cached audio.
+	// The least recently used variants are dropped beyond maxBytes.
+	class IRCache
+	{
+	public:
+		using IRData = dsp::ImpulseResponse<float>::IRData;
+
+		static IRCache& getInstance();
+
+		// The audio of source resampled to sampleRate, resampling it if this
+		// IR hasn't been resampled to that rate yet.
+		// Thread-safe; allocates, so never call it from the audio thread.
+		std::shared_ptr<const IRData> getVariant(const dsp::IRSource& source, double sampleRate);
+
+		// Build an IR that plays source at sampleRate. It shares the audio of
+		// the cached variant (or of source, if that's at sampleRate already),
+		// so only what it convolves with is allocated.
+		std::shared_ptr<dsp::ImpulseResponse<float>> createIR(const dsp::IRSource& source, double sampleRate,
+		                                                      const dsp::IRTrimParams& trimParams = dsp::IRTrimParams());
+
+		// Memory taken by the cached variants
+		size_t getSizeInBytes() const;
+
+		static constexpr size_t maxBytes = 64 * 1024 * 1024;
+
+	private:
+		IRCache() = default;
+		IRCache(const IRCache&) = delete;
+		IRCache& operator=(const IRCache&) = delete;
+
+		static uint64_t getKey(const dsp::IRSource& source, double sampleRate);
+
+		struct Entry
+		{
+			uint64_t key;
+			std::shared_ptr<const IRData> variant;
+		};
+
+		mutable std::mutex mutex;
+		// Most recently used first
+		std::list<Entry> entries;
+		std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+		size_t sizeInBytes = 0;
+	};
+}
@@ -0,0 +1,146 @@
+#include "ModelBank.h"
+#include "ModelRegistry.h"
+
+#include <algorithm>
+
+namespace Service
+{
+	ModelBank::ModelBank(std::vector<std::string> names, dsp::wavenet::ActivationAccuracy activationAccuracy) :
+		resourceNames(std::move(names)),
+		accuracy(activationAccuracy),
+		models(resourceNames.size())
+	{
+		worker = std::thread([this] { run(); });
+	}
+
+	ModelBank::~ModelBank()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shouldExit = true;
+			queue.clear();
+			blendQueue.clear();
+		}
+		condition.notify_all();
+		worker.join();
+	}
+
+	std::shared_ptr<nam::DSP> ModelBank::getIfLoaded(size_t index) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return index < models.size() ? models[index] : nullptr;
+	}
+
+	std::shared_ptr<nam::DSP> ModelBank::load(size_t index)
+	{
+		if (index >= resourceNames.size())
+			return nullptr;
+		if (auto model = getIfLoaded(index))
+			return model;
+
+		// Build outside of the lock; if someone else got there first, theirs wins.
+		const auto wanted = getPrecision();
+		auto model = ModelRegistry::getInstance().createModel(resourceNames[index], wanted, accuracy);
+		std::lock_guard<std::mutex> lock(mutex);
+		// The precision changed while building: don't keep a stale model.
+		if (precision != wanted)
+			return model;
+		if (models[index] == nullptr)
+			models[index] = model;
+		return models[index];
+	}
+
+	void ModelBank::prefetch(const std::vector<size_t>& indices)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.clear();
+			for (auto index : indices)
+				if (index < models.size() && models[index] == nullptr)
+					queue.push_back(index);
+			if (queue.empty())
+				return;
+		}
+		condition.notify_one();
+	}
+
+	std::vector<std::shared_ptr<nam::DSP>> ModelBank::getModels() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return models;
+	}
+
+	void ModelBank::setPrecision(dsp::wavenet::Precision newPrecision)
+	{
+		// Released after the lock, outside of the critical section
+		std::vector<std::shared_ptr<nam::DSP>> released;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (precision == newPrecision)
+				return;
+			precision = newPrecision;
+			released.resize(models.size());
+			models.swap(released);
+		}
+	}
+
+	dsp::wavenet::Precision ModelBank::getPrecision() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return precision;
+	}
+
+	std::optional<bool> ModelBank::getBlendResult(size_t index) const
+	{
+		if (index + 1 >= resourceNames.size())
+			return false;
+		return ModelRegistry::getInstance().findBlendResult(resourceNames[index], resourceNames[index + 1]);
+	}
+
+	void ModelBank::checkBlend(size_t index)
+	{
+		if (getBlendResult(index).has_value())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (std::find(blendQueue.begin(), blendQueue.end(), index) != blendQueue.end())
+				return;
+			blendQueue.push_back(index);
+		}
+		condition.notify_one();
+	}
+
+	void ModelBank::run()
+	{
+		while (true)
+		{
+			size_t index;
+			bool isBlendCheck;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return shouldExit || !queue.empty() || !blendQueue.empty(); });
+				if (shouldExit)
+					return;
+				isBlendCheck = queue.empty();
+				auto& source = isBlendCheck ? blendQueue : queue;
+				index = source.front();
+				source.pop_front();
+				if (!isBlendCheck && models[index] != nullptr)
+					continue;
+			}
+			if (isBlendCheck)
+			{
+				auto first = load(index);
+				auto second = load(index + 1);
+				if (first != nullptr && second != nullptr)
+				{
+					ModelRegistry::getInstance().checkBlend(resourceNames[index], first, resourceNames[index + 1], second);
+					if (onBlendChecked)
+						onBlendChecked(index);
+				}
+			}
+			else if (load(index) != nullptr && onModelLoaded)
+				onModelLoaded(index);
+		}
+	}
+}
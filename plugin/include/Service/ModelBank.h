@@ -0,0 +1,78 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SharedWaveNet.h"
+
+namespace Service
+{
+	// An instance's set of factory models, materialized on demand.
+	//
+	// Nothing is built up front: a model is created (through ModelRegistry)
+	// the first time it's asked for, either synchronously with load() or on
+	// the bank's background thread with prefetch(). Once built, a model stays
+	// in the bank for the lifetime of the instance. Every model plays with the
+	// bank's activation accuracy.
+	class ModelBank
+	{
+	public:
+		explicit ModelBank(std::vector<std::string> resourceNames,
+						   dsp::wavenet::ActivationAccuracy accuracy = dsp::wavenet::ActivationAccuracy::EXACT);
+		~ModelBank();
+
+		size_t size() const { return resourceNames.size(); }
+
+		// The model at index if it has been materialized, nullptr otherwise.
+		// Never blocks on loading.
+		std::shared_ptr<nam::DSP> getIfLoaded(size_t index) const;
+		// Materialize a model on the calling thread (if it isn't already) and
+		// return it.
+		std::shared_ptr<nam::DSP> load(size_t index);
+		// Queue models to be materialized in the background, most important
+		// first. Replaces whatever is still queued from a previous call, so
+		// that the latest request is always served next.
+		void prefetch(const std::vector<size_t>& indices);
+		// Snapshot of the bank; models that haven't been loaded are nullptr.
+		std::vector<std::shared_ptr<nam::DSP>> getModels() const;
+
+		// Store the weights of the models materialized from now on at this
+		// precision. Drops the models already in the bank, so they have to
+		// be loaded again; models still playing are released by their users.
+		void setPrecision(dsp::wavenet::Precision newPrecision);
+		dsp::wavenet::Precision getPrecision() const;
+
+		// Whether models index and index + 1 can be blended, if known yet.
+		std::optional<bool> getBlendResult(size_t index) const;
+		// Find out in the background whether models index and index + 1 can
+		// be blended, loading them if needed. Runs after any queued prefetch.
+		void checkBlend(size_t index);
+
+		// Called on the background thread whenever prefetch() has
+		// materialized a model. Set it before the first prefetch().
+		std::function<void(size_t)> onModelLoaded;
+		// Called on the background thread when checkBlend() has a result.
+		std::function<void(size_t)> onBlendChecked;
+
+	private:
+		void run();
+
+		const std::vector<std::string> resourceNames;
+		const dsp::wavenet::ActivationAccuracy accuracy;
+		mutable std::mutex mutex;
+		std::condition_variable condition;
+		std::vector<std::shared_ptr<nam::DSP>> models;
+		std::deque<size_t> queue;
+		std::deque<size_t> blendQueue;
+		dsp::wavenet::Precision precision = dsp::wavenet::Precision::FLOAT32;
+		bool shouldExit = false;
+		std::thread worker;
+	};
+}
@@ -0,0 +1,158 @@
+#include "ModelRegistry.h"
+#include "BinaryData.h"
+#include "ModelBinary.h"
+
+#include <juce_core/juce_core.h>
+#include <stdexcept>
+
+namespace Service
+{
+	ModelRegistry& ModelRegistry::getInstance()
+	{
+		static ModelRegistry instance;
+		return instance;
+	}
+
+	std::shared_ptr<const dsp::wavenet::Weights> ModelRegistry::findWeights(const std::string& key) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = weights.find(key);
+		return it != weights.end() ? it->second.lock() : nullptr;
+	}
+
+	std::shared_ptr<nam::DSP> ModelRegistry::createModel(const std::string& resourceName, dsp::wavenet::Precision precision,
+												   dsp::wavenet::ActivationAccuracy accuracy)
+	{
+		const bool isFloat = precision == dsp::wavenet::Precision::FLOAT32;
+		const std::string key = isFloat ? resourceName : resourceName + "#int8";
+		std::shared_ptr<const dsp::wavenet::Weights> shared = findWeights(key);
+
+		// Reduced-precision weights are made from the float ones, which are
+		// reused if some instance already has them.
+		std::shared_ptr<const dsp::wavenet::Weights> source = isFloat || shared != nullptr ? shared : findWeights(resourceName);
+
+		if (source == nullptr)
+		{
+			// Parse outside of the lock so that different models can be
+			// loaded concurrently.
+			int modelSize = 0;
+			const void* modelData = BinaryData::getNamedResource(resourceName.c_str(), modelSize);
+			if (modelData == nullptr || modelSize <= 0)
+			{
+				DBG("Model resource not found: " << juce::String(resourceName));
+				return nullptr;
+			}
+
+			nam::dspData conf;
+			if (!parseModelData(modelData, (size_t)modelSize, conf))
+			{
+				DBG("Could not parse model resource: " << juce::String(resourceName));
+				return nullptr;
+			}
+
+			try
+			{
+				if (conf.architecture != "WaveNet")
+					throw std::runtime_error("Not a WaveNet");
+				source = std::make_shared<const dsp::wavenet::Weights>(conf.config, conf.weights, conf.expected_sample_rate);
+			}
+			catch (const std::exception& e)
+			{
+				DBG("Model " << juce::String(resourceName) << " can't be shared (" << e.what() << "), building it with NAM");
+				return std::shared_ptr<nam::DSP>(nam::get_dsp(conf));
+			}
+		}
+
+		if (shared == nullptr)
+		{
+			shared = isFloat ? source : std::make_shared<const dsp::wavenet::Weights>(*source, precision);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			// Another thread may have loaded the same model in the meantime;
+			// keep a single copy.
+			auto& entry = weights[key];
+			if (auto existing = entry.lock())
+				shared = existing;
+			else
+				entry = shared;
+		}
+
+		auto model = std::make_shared<dsp::wavenet::WaveNet>(shared);
+		// Before pre-warming, so that the settled state is the one it plays from
+		model->SetActivationAccuracy(accuracy);
+		model->Prewarm();
+		return model;
+	}
+
+	bool ModelRegistry::parseModelData(const void* data, size_t size, nam::dspData& conf)
+	{
+		try
+		{
+			// Models converted at build time by NamToBinary
+			if (dsp::modelbinary::IsModelBinary(data, size))
+			{
+				dsp::modelbinary::Model model = dsp::modelbinary::Read(data, size);
+				conf.version = std::move(model.mVersion);
+				conf.architecture = std::move(model.mArchitecture);
+				conf.config = std::move(model.mConfig);
+				conf.weights = std::move(model.mWeights);
+				if (model.mSampleRate > 0.0)
+					conf.expected_sample_rate = model.mSampleRate;
+				return true;
+			}
+
+			// Plain .nam (JSON)
+			const char* text = static_cast<const char*>(data);
+			const nlohmann::json json = nlohmann::json::parse(text, text + size);
+			conf.version = json.at("version").get<std::string>();
+			conf.architecture = json.at("architecture").get<std::string>();
+			conf.config = json.at("config");
+			conf.weights = json.at("weights").get<std::vector<float>>();
+			if (json.contains("sample_rate") && json["sample_rate"].is_number())
+				conf.expected_sample_rate = json["sample_rate"].get<double>();
+			return true;
+		}
+		catch (const std::exception& e)
+		{
+			DBG("Model parse error: " << e.what());
+			return false;
+		}
+	}
+
+	size_t ModelRegistry::getNumResidentModels() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t count = 0;
+		for (const auto& entry : weights)
+			if (!entry.second.expired())
+				count++;
+		return count;
+	}
+
+	std::optional<bool> ModelRegistry::findBlendResult(const std::string& nameA, const std::string& nameB) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = blendResults.find(nameA + "|" + nameB);
+		if (it == blendResults.end())
+			return std::nullopt;
+		return it->second;
+	}
+
+	bool ModelRegistry::checkBlend(const std::string& nameA, const std::shared_ptr<nam::DSP>& modelA,
+								   const std::string& nameB, const std::shared_ptr<nam::DSP>& modelB)
+	{
+		if (auto known = findBlendResult(nameA, nameB))
+			return *known;
+
+		// Only models built on shared weights can be blended
+		auto* wavenetA = dynamic_cast<dsp::wavenet::WaveNet*>(modelA.get());
+		auto* wavenetB = dynamic_cast<dsp::wavenet::WaveNet*>(modelB.get());
+		const bool result = wavenetA != nullptr && wavenetB != nullptr
+			&& dsp::wavenet::BlendsCleanly(wavenetA->GetWeights(), wavenetB->GetWeights());
+		DBG("Blending " << juce::String(nameA) << " with " << juce::String(nameB) << (result ? ": ok" : ": not possible"));
+
+		std::lock_guard<std::mutex> lock(mutex);
+		blendResults[nameA + "|" + nameB] = result;
+		return result;
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "SharedWaveNet.h"
+
+namespace Service
+{
+	// Process-wide store for the weights of the embedded factory models.
+	//
+	// Model weights never change once loaded, so instead of every plugin
+	// instance parsing and building its own copy of each .nam file, they are
+	// parsed once and shared. Each caller gets its own lightweight
+	// dsp::wavenet::WaveNet that only owns its layer buffers.
+	// Entries are refcounted by the models built from them: the weights are
+	// freed when the last model using them is destroyed, and reloaded on the
+	// next request.
+	class ModelRegistry
+	{
+	public:
+		static ModelRegistry& getInstance();
+
+		// Build a new, pre-warmed model for an embedded model resource, e.g.
+		// "AMP1GAIN5_0_wav_bin". Architectures other than WaveNet fall back to
+		// nam::get_dsp() and aren't shared.
+		// precision: how the WaveNet weights are stored. Each precision is
+		// shared separately; INT8 weights are quantized from the float ones.
+		// accuracy: the activations the WaveNet plays (and is pre-warmed) with.
+		// Returns nullptr if the resource is missing or can't be parsed.
+		// Thread-safe; allocates, so never call it from the audio thread.
+		std::shared_ptr<nam::DSP> createModel(const std::string& resourceName,
+											  dsp::wavenet::Precision precision = dsp::wavenet::Precision::FLOAT32,
+											  dsp::wavenet::ActivationAccuracy accuracy = dsp::wavenet::ActivationAccuracy::EXACT);
+
+		// Parse the contents of a model resource: either a binary model made
+		// by NamToBinary (see dsp::modelbinary) or a plain .nam file.
+		static bool parseModelData(const void* data, size_t size, nam::dspData& conf);
+
+		// Number of models whose weights are currently held in memory
+		size_t getNumResidentModels() const;
+
+		// Whether two factory models can be blended in weight space (see
+		// dsp::wavenet::BlendsCleanly()), if that has already been worked out
+		// for this pair.
+		std::optional<bool> findBlendResult(const std::string& nameA, const std::string& nameB) const;
+		// Same, working it out from the models if it isn't known yet. The
+		// result is kept for the lifetime of the process, for every instance.
+		// Slow; call it from a background thread.
+		bool checkBlend(const std::string& nameA, const std::shared_ptr<nam::DSP>& modelA,
+						const std::string& nameB, const std::shared_ptr<nam::DSP>& modelB);
+
+	private:
+		ModelRegistry() = default;
+		ModelRegistry(const ModelRegistry&) = delete;
+		ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+		std::shared_ptr<const dsp::wavenet::Weights> findWeights(const std::string& key) const;
+
+		mutable std::mutex mutex;
+		// Keyed by resource name, with "#int8" appended for INT8 weights
+		std::unordered_map<std::string, std::weak_ptr<const dsp::wavenet::Weights>> weights;
+		// Keyed by "nameA|nameB"
+		std::unordered_map<std::string, bool> blendResults;
+	};
+}
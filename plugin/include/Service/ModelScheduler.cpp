@@ -0,0 +1,143 @@
+#include "ModelScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Service
+{
+	namespace
+	{
+		// How close to the live input a warm-up gets before it's offered,
+		// leaving the audio thread some slack to take it
+		constexpr long maxWarmUpLag = dsp::hotswap::Swapper::kMaxCatchUp / 4;
+		// The audio thread doesn't signal anything, so the interval between
+		// swaps is checked this often
+		constexpr auto intervalPollTime = std::chrono::milliseconds(5);
+		// ...and whether an offer is still fresh enough to be taken, this often
+		constexpr auto offerPollTime = std::chrono::milliseconds(2);
+	}
+
+	ModelScheduler::ModelScheduler(dsp::hotswap::Swapper& s, double rate) :
+		swapper(s),
+		sampleRate(rate),
+		minIntervalSamples((uint64_t)(defaultMinInterval * rate))
+	{
+		worker = std::thread([this] { run(); });
+	}
+
+	ModelScheduler::~ModelScheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			shouldExit = true;
+		}
+		condition.notify_all();
+		worker.join();
+	}
+
+	void ModelScheduler::setTarget(std::shared_ptr<nam::DSP> model)
+	{
+		std::shared_ptr<nam::DSP> replaced;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			counters.requested++;
+			if (target != nullptr)
+				counters.coalesced++;
+			replaced = std::move(target);
+			target = std::move(model);
+		}
+		condition.notify_one();
+	}
+
+	void ModelScheduler::cancel()
+	{
+		std::shared_ptr<nam::DSP> dropped;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			dropped = std::move(target);
+			generation++;
+		}
+		swapper.Cancel();
+	}
+
+	void ModelScheduler::setMinInterval(double seconds)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		minIntervalSamples = (uint64_t)(std::max(0.0, seconds) * sampleRate);
+	}
+
+	ModelScheduler::Counters ModelScheduler::getCounters() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Counters result = counters;
+		result.swapped = swapper.GetNumSwaps();
+		return result;
+	}
+
+	bool ModelScheduler::canSwap() const
+	{
+		if (swapper.GetNumSwaps() == 0)
+			return true;
+		return swapper.GetHistory().GetPosition() >= swapper.GetLastSwapPosition() + minIntervalSamples;
+	}
+
+	void ModelScheduler::run()
+	{
+		while (true)
+		{
+			std::shared_ptr<nam::DSP> model;
+			uint64_t modelGeneration;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return shouldExit || target != nullptr; });
+				// Hold off until the last swap is old enough; whatever is set
+				// in the meantime replaces this target.
+				while (!shouldExit && target != nullptr && !canSwap())
+					condition.wait_for(lock, intervalPollTime);
+				if (shouldExit)
+					return;
+				if (target == nullptr)
+					continue;
+				model = std::move(target);
+				modelGeneration = generation;
+			}
+
+			// Warm up outside of the lock, so that setTarget() never waits
+			uint64_t position = dsp::hotswap::WarmUp(*model, swapper.GetHistory(), maxWarmUpLag);
+
+			// A target set during the warm-up is warmed up next. This one is
+			// still offered, so that a long sweep moves along with the knob
+			// instead of waiting for it to stop.
+			std::unique_lock<std::mutex> lock(mutex);
+			if (generation != modelGeneration)
+				continue;
+			const uint64_t numSwaps = swapper.GetNumSwaps();
+			if (swapper.Offer(std::move(model), position))
+				counters.coalesced++;
+
+			// The audio thread only takes an offer that's at most kMaxCatchUp
+			// samples behind, which a single host block can exceed. Until it's
+			// taken (or replaced by the next target), keep bringing it up to
+			// date here.
+			while (true)
+			{
+				condition.wait_for(lock, offerPollTime);
+				if (shouldExit)
+					return;
+				if (generation != modelGeneration || target != nullptr || swapper.GetNumSwaps() != numSwaps)
+					break;
+				if (swapper.GetHistory().GetPosition() - position <= (uint64_t)dsp::hotswap::Swapper::kMaxCatchUp)
+					continue;
+				model = swapper.Withdraw(position);
+				if (model == nullptr)
+					break;
+				lock.unlock();
+				position = dsp::hotswap::CatchUp(*model, swapper.GetHistory(), position, maxWarmUpLag);
+				lock.lock();
+				if (generation != modelGeneration)
+					break;
+				swapper.Offer(std::move(model), position);
+			}
+		}
+	}
+}
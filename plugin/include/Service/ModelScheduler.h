@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "ModelHotSwap.h"
+
+namespace Service
+{
+	// Schedules model changes on the hot-swap path (see dsp::hotswap).
+	//
+	// Changes don't each start a transition. Targets that arrive while one is
+	// being prepared are coalesced, so only the latest is warmed up next and
+	// handed to the swapper. Swaps are also kept at least a minimum interval of audio
+	// apart. A gain sweep (automation, a fast drag) therefore produces a steady
+	// series of short transitions from the model that's playing to the latest
+	// setting, instead of a transition restarted on every value.
+	class ModelScheduler
+	{
+	public:
+		static constexpr double defaultMinInterval = 0.05;
+
+		struct Counters
+		{
+			// setTarget() calls
+			uint64_t requested = 0;
+			// Targets that were replaced by a later one before being played
+			uint64_t coalesced = 0;
+			// Models actually swapped in
+			uint64_t swapped = 0;
+		};
+
+		// swapper runs at sampleRate and must outlive the scheduler.
+		ModelScheduler(dsp::hotswap::Swapper& swapper, double sampleRate);
+		~ModelScheduler();
+
+		// Make model the next one to play. It must be an instance nothing
+		// else uses (see dsp::hotswap::NewInstance()). Never blocks.
+		void setTarget(std::shared_ptr<nam::DSP> model);
+		// Drop any target that hasn't been swapped in yet.
+		void cancel();
+		// Shortest time between two swaps, in seconds of audio
+		void setMinInterval(double seconds);
+		Counters getCounters() const;
+
+	private:
+		void run();
+		bool canSwap() const;
+
+		dsp::hotswap::Swapper& swapper;
+		const double sampleRate;
+		mutable std::mutex mutex;
+		std::condition_variable condition;
+		std::shared_ptr<nam::DSP> target;
+		// Bumped by cancel(), so that a warm-up under way is dropped
+		uint64_t generation = 0;
+		uint64_t minIntervalSamples;
+		Counters counters;
+		bool shouldExit = false;
+		std::thread worker;
+	};
+}
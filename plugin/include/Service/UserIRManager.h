@@ -10,7 +10,7 @@ namespace Service {
 struct UserIRData {
     juce::String name;
     juce::String path;
-    std::shared_ptr<dsp::ImpulseResponse> ir;
+    std::shared_ptr<dsp::ImpulseResponse<float>> ir;
 };
 
 class UserIRManager {
@@ -26,7 +26,7 @@ public:
     
     bool validateIRFile(const juce::File& irFile) const;
     
-    std::shared_ptr<dsp::ImpulseResponse> getUserIR(int index) const;
+    std::shared_ptr<dsp::ImpulseResponse<float>> getUserIR(int index) const;
     
     void populateComboBox(juce::ComboBox& comboBox) const;
     
@@ -46,7 +46,7 @@ private:
     double mDefaultSampleRate;
     
     void storeOriginalIRs();
-    std::shared_ptr<dsp::ImpulseResponse> createIRFromFile(const juce::String& filePath, double sampleRate);
+    std::shared_ptr<dsp::ImpulseResponse<float>> createIRFromFile(const juce::String& filePath, double sampleRate);
     bool isValidWavFile(const juce::File& file) const;
 };
 
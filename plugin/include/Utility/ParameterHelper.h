@@ -47,7 +47,10 @@ namespace Utility
                 std::make_unique<AudioParameterBool>("reverb state", "Reverb State", false),
                 std::make_unique<AudioParameterBool>("delay state", "Delay State", false),
                 std::make_unique<AudioParameterBool>("fx state", "FX State", false),
-                std::make_unique<AudioParameterBool>("back state", "Back State", false)
+                std::make_unique<AudioParameterBool>("back state", "Back State", false),
+                std::make_unique<AudioParameterBool>("amp interpolate", "Amp Interpolate", true),
+                std::make_unique<AudioParameterBool>("amp stereo", "Amp Stereo", false),
+                std::make_unique<AudioParameterBool>("amp low memory", "Amp Low Memory", false)
 			};
 		}
 	};
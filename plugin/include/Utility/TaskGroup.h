@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <juce_core/juce_core.h>
+
+namespace Utility
+{
+	// A batch of independent jobs run on a process-wide, bounded thread pool,
+	// with a barrier: wait() returns once every job added so far has finished.
+	// Used to run slow, independent setup work (IR loads, resampling) in
+	// parallel. The destructor waits too, so jobs may safely use whatever
+	// outlives the group.
+	// A job that throws still counts as finished; the exception is logged
+	// and dropped, so jobs report their own failures.
+	class TaskGroup
+	{
+	public:
+		TaskGroup() = default;
+		~TaskGroup() { wait(); }
+
+		void add(std::function<void()> job)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				++numPending;
+			}
+			sharedPool->pool.addJob([this, job = std::move(job)]
+			{
+				try
+				{
+					job();
+				}
+				catch (const std::exception& e)
+				{
+					DBG("TaskGroup job failed: " << e.what());
+				}
+				catch (...)
+				{
+					DBG("TaskGroup job failed");
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--numPending == 0)
+					finished.notify_all();
+			});
+		}
+
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			finished.wait(lock, [this] { return numPending == 0; });
+		}
+
+		static int getNumThreads() { return SharedPool::getNumThreads(); }
+		// Limit the pool to numThreads (0 for the default: one per CPU, up to
+		// 8). Takes effect when the pool is next created, i.e. once every
+		// TaskGroup has been destroyed.
+		static void setMaxThreads(int numThreads) { maxThreads = numThreads; }
+
+	private:
+		struct SharedPool
+		{
+			static int getNumThreads()
+			{
+				const int numThreads = juce::jlimit(1, 8, juce::SystemStats::getNumCpus());
+				return maxThreads > 0 ? juce::jmin(numThreads, maxThreads.load()) : numThreads;
+			}
+			juce::ThreadPool pool { getNumThreads() };
+		};
+
+		static inline std::atomic<int> maxThreads { 0 };
+		juce::SharedResourcePointer<SharedPool> sharedPool;
+		std::mutex mutex;
+		std::condition_variable finished;
+		int numPending = 0;
+
+		JUCE_DECLARE_NON_COPYABLE(TaskGroup)
+	};
+}
@@ -9,11 +9,14 @@
 #include "../include/PluginProcessor.h"
 #include "../include/PluginEditor.h"
 #include "../include/Service/PresetManager.h"
+#include "../include/Service/IRCache.h"
 #include <cmath>
 #include <mutex>
 
 //==============================================================================
-// No more static shared resources for models and IRs - each instance gets its own
+// Model weights are shared process-wide through Service::ModelRegistry, and
+// IRs resampled to a sample rate through Service::IRCache; model state and IRs
+// are per instance
 
 //==============================================================================
 EqAudioProcessor::EqAudioProcessor()
@@ -34,6 +37,7 @@ EQ2_2(48000.0, Constants::fc_eq2_2),
 GlobalEQ(48000.0, Constants::fc_globalEQ),
 mResampler1(48000.0),
 mResampler2(48000.0),
+mResamplerStereo(48000.0),
 irResampler(48000.0)
 #endif
 {
@@ -50,16 +54,18 @@ irResampler(48000.0)
     valueTreeState.state.setProperty("presetPath", "", nullptr);
     presetManager = std::make_unique<Service::PresetManager>(valueTreeState);
 
-    // Initialize per-instance resources (each instance gets its own models and IRs)
+    // Initialize per-instance resources (models share their weights with other instances)
     DBG("=== Creating EqAudioProcessor instance ===");
-    initializeModels();
+    const double constructionStart = juce::Time::getMillisecondCounterHiRes();
+    // IRs load on the shared pool while the first model is built here
     initializeIRs();
-    DBG("=== After initialization: models.size()=" << models.size() << ", factoryIRs.size()=" << factoryIRs.size() << " ===");
+    initializeModels();
+    DBG("=== After initialization: modelBank->size()=" << modelBank->size() << ", factoryIRs.size()=" << factoryIRs.size() << " ===");
 
-    amp1_dsp = models[0];
-    old_model = models[0];
-    irIn = new double*[1];
-    irIn[0] = new double[Constants::BUFFERSIZE];
+    amp1_dsp = modelBank->load(0);
+    old_model = amp1_dsp;
+    stagedModel = amp1_dsp;
+    prefetchNeighbouringModels(0);
     ampOn = false;
     fftSize = 1024;
     acf.resize(fftSize);
@@ -80,6 +86,8 @@ irResampler(48000.0)
     }
     eq1Parameter = valueTreeState.getRawParameterValue("eq1");
     eq2Parameter = valueTreeState.getRawParameterValue("eq2");
+    ampStereoParameter = valueTreeState.getRawParameterValue("amp stereo");
+    ampLowMemoryParameter = valueTreeState.getRawParameterValue("amp low memory");
 
     // Initialize LicenseSpring
     AppConfig appConfig( Constants::productName, Constants::versionNum );
@@ -109,12 +117,18 @@ irResampler(48000.0)
         channelDelays[ch] = std::make_unique<Delay>(48000.0);
     }
     restoreIRFromState();
+    DBG("=== EqAudioProcessor constructed in " << juce::Time::getMillisecondCounterHiRes() - constructionStart
+        << " ms (" << Utility::TaskGroup::getNumThreads() << " worker threads) ===");
 }
 
 EqAudioProcessor::~EqAudioProcessor()
 {
-    delete[] irIn[0];
-    delete[] irIn;
+    initTasks.wait();
+    irTasks.wait();
+    userIRTasks.wait();
+    const auto transitions = modelScheduler.getCounters();
+    DBG("Model transitions: " << (int)transitions.requested << " requested, " << (int)transitions.swapped
+        << " swapped, " << (int)transitions.coalesced << " coalesced");
 }
 
 juce::File EqAudioProcessor::writeBinaryDataToTempFile(const void* data, int size, const juce::String& fileName)
@@ -176,126 +190,216 @@ void EqAudioProcessor::loadFactoryPresets(int i) {
      }
 }
 
-void EqAudioProcessor::loadModel(const int amp_idx, double gainLvl, unsigned long i) {
-//    return;
+std::string EqAudioProcessor::getModelResourceName(const int amp_idx, double gainLvl) {
     // Format gain string: replace dot with underscore, or strip .0 for integer gains
     juce::String gainStr = juce::String(gainLvl, 1);
     gainStr = gainStr.replace(".", "_");
 
-    // Construct binary resource name: AMP{amp_idx}GAIN{gain}_wav_nam
-    std::string modelBinaryName = "AMP" + std::to_string(amp_idx) + "GAIN" + gainStr.toStdString() + "_wav_nam";
-
-    const void* modelData = nullptr;
-    int modelSize = 0;
-    modelData = BinaryData::getNamedResource(modelBinaryName.c_str(), modelSize);
-
-    if (modelData != nullptr && modelSize > 0)
-    {
-        juce::MemoryInputStream memoryStream(modelData, modelSize, false);
+    // Construct binary resource name: AMP{amp_idx}GAIN{gain}_wav_bin (converted from the .nam at build time)
+    return "AMP" + std::to_string(amp_idx) + "GAIN" + gainStr.toStdString() + "_wav_bin";
+}
 
-        // Read and parse the JSON
-        juce::var jsonParsed = juce::JSON::parse(memoryStream);
-        if (jsonParsed.isObject())
-        {
-            auto* dynamicObject = jsonParsed.getDynamicObject();
-            if (dynamicObject != nullptr)
-            {
-                nam::dspData conf;
-                for (const auto& property : dynamicObject->getProperties())
-                {
-                    juce::String attributeName = property.name.toString();
-                    juce::var attributeValue = property.value;
-                    if (attributeName == "version") {
-                        conf.version = attributeValue.toString().toStdString();
-                    }
-                    else if (attributeName == "architecture") {
-                        conf.architecture = attributeValue.toString().toStdString();
-                    }
-                    else if (attributeName == "config") {
-                        auto* configDynamicObject = attributeValue.getDynamicObject();
-                        juce::String jsonString = juce::JSON::toString(juce::var(configDynamicObject));
-                        nlohmann::json jsonObject = nlohmann::json::parse(jsonString.toStdString());
-                        conf.config = jsonObject;
-                    }
-                    else if (attributeName == "metadata") {
-                        auto* configDynamicObject = attributeValue.getDynamicObject();
-                        juce::String jsonString = juce::JSON::toString(juce::var(configDynamicObject));
-                        nlohmann::json jsonObject = nlohmann::json::parse(jsonString.toStdString());
-                        conf.config = jsonObject;
-                    }
-                    else if (attributeName == "weights") {
-                        if (attributeValue.isArray()) {
-                            auto* array = attributeValue.getArray();
-                            if (array != nullptr) {
-                                for (const auto& element : *array) {
-                                    if (element.isDouble()) {
-                                        float value = static_cast<float>(static_cast<double>(element));
-                                        conf.weights.push_back(value);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    else if (attributeName == "sample_rate") {
-                        conf.expected_sample_rate = static_cast<double>(attributeValue);
-                    }
-                }
-                models[i] = nam::get_dsp(conf);
+const std::vector<dsp::IRSource>& EqAudioProcessor::getFactoryIRSources()
+{
+    // One table for the whole process, viewing the audio where it is
+    static const std::vector<dsp::IRSource> sources = [] {
+        std::vector<dsp::IRSource> result(Constants::NUM_IRS);
+        for (int i = 1; i <= Constants::NUM_IRS; i++) {
+            int irSize = 0;
+            std::string irBinaryName = std::string(Constants::productName)+"_"+std::to_string(i)+"_bin";
+            const char* irData = BinaryData::getNamedResource(irBinaryName.c_str(), irSize);
+            if (irData != nullptr && irSize > (int)sizeof(double)) {
+                // A double header, then the samples, at 48kHz
+                result[i-1].mSamples = reinterpret_cast<const float*>(irData + sizeof(double));
+                result[i-1].mNumSamples = (irSize-sizeof(double))/sizeof(float);
+                result[i-1].mSampleRate = 48000.0;
             }
         }
-    }
+        return result;
+    }();
+    return sources;
 }
 
 void EqAudioProcessor::loadIR(const int i, double sampleRate) {
 //    return;
-    const char* irData = nullptr;
-    int irSize = 0;
-    juce::String irName = juce::String(Constants::productName)+" "+juce::String(i);
-    std::string irBinaryName = std::string(Constants::productName)+"_"+std::to_string(i)+"_bin";
-    irData = BinaryData::getNamedResource(irBinaryName.c_str(), irSize);
-    if (irData != nullptr && irSize > 0) {
-        dsp::ImpulseResponse::IRData irInfo;
-        size_t numSamples = (irSize-sizeof(double))/sizeof(float);
-        const float* audioSamples = reinterpret_cast<const float*>(irData + sizeof(double));
-        irInfo.mRawAudio.resize(0);
-        for (int n = 0; n < numSamples; n++) {
-            irInfo.mRawAudio.push_back(audioSamples[n]);
-        }
-        irInfo.mRawAudioSampleRate = 48000.0;
-        factoryIRs[i-1] = std::make_shared<dsp::ImpulseResponse>(irInfo, sampleRate);
-        originalFactoryIRs[i-1] = std::make_shared<dsp::ImpulseResponse>(irInfo, sampleRate);
+    const dsp::IRSource& source = getFactoryIRSources()[i-1];
+    if (source.mSamples != nullptr) {
+        // factoryIRs[i-1] is replaced by a resampled IR in prepareToPlay() if
+        // the project runs at another rate
+        factoryIRs[i-1] = Service::IRCache::getInstance().createIR(source, sampleRate, irTrimParams);
     }
-
 }
 
 void EqAudioProcessor::initializeModels()
 {
-    DBG("=== INITIALIZING PER-INSTANCE MODELS ===");
-    const int numModelFiles = 38;
-    models.resize(numModelFiles);
-
-    unsigned long i = 0;
+    DBG("=== INITIALIZING PER-INSTANCE MODEL BANK ===");
+    // Nothing is built here: models are materialized on first use, and their
+    // weights are shared with other instances through Service::ModelRegistry.
+    std::vector<std::string> resourceNames;
     for (double gain = 1.0; gain <= 10.0; gain += 0.5) {
-        loadModel(1, gain, i);
-        i++;
+        resourceNames.push_back(getModelResourceName(1, gain));
     }
     for (double gain = 1.0; gain <= 10.0; gain += 0.5) {
-        loadModel(2, gain, i);
-        i++;
+        resourceNames.push_back(getModelResourceName(2, gain));
     }
-    DBG("=== PER-INSTANCE MODELS INITIALIZED: " << models.size() << " models ===");
+    modelBank = std::make_unique<Service::ModelBank>(std::move(resourceNames), ampActivationAccuracy);
+    modelBank->onModelLoaded = [this] (size_t) { triggerAsyncUpdate(); };
+    modelBank->onBlendChecked = [this] (size_t) { triggerAsyncUpdate(); };
+    DBG("=== PER-INSTANCE MODEL BANK INITIALIZED: " << modelBank->size() << " models ===");
+}
+
+void EqAudioProcessor::prefetchNeighbouringModels(int id)
+{
+    const int modelsPerAmp = (int)modelBank->size() / 2;
+    const int position = id % modelsPerAmp;
+    const int ampStart = id - position;
+    std::vector<size_t> indices { (size_t)id };
+    // +-0.5 and +-1.0 on the gain knob
+    for (int step : { -1, 1, -2, 2 }) {
+        if (position + step >= 0 && position + step < modelsPerAmp) {
+            indices.push_back((size_t)(id + step));
+        }
+    }
+    // Same gain on the other amp
+    indices.push_back((size_t)((ampStart + modelsPerAmp) % (2 * modelsPerAmp) + position));
+    modelBank->prefetch(indices);
+}
+
+void EqAudioProcessor::handleAsyncUpdate()
+{
+    // The IRs were rebuilt at a new sample rate: swap them in, unless the
+    // rate changed again in the meantime
+    std::shared_ptr<IRVariants> variants;
+    {
+        std::lock_guard<std::mutex> lock(irVariantsMutex);
+        variants = std::move(readyIRVariants);
+    }
+    if (variants != nullptr && variants->sampleRate == projectSr) {
+        applyIRVariants(*variants);
+    }
+    applyLoadedUserIRs();
+
+    // The amp was switched between mono and stereo: play the current setting
+    // on instances with the new number of channels, and give the cab a
+    // second side or take it away. Models other than WaveNets stay mono.
+    const int channels = requestedAmpChannels;
+    if (channels != ampChannels) {
+        ampChannels = channels;
+        if (std::dynamic_pointer_cast<dsp::wavenet::WaveNet>(stagedModel) != nullptr) {
+            stagedModel = nullptr;
+            activeBlend = -1;
+            setAmp();
+        }
+        if (selectedIR != nullptr) {
+            stageIR(selectedIR);
+        }
+    }
+
+    // "amp low memory" was toggled: reload the models at the other
+    // precision, and replay the current setting on them.
+    const auto precision = requestedLowMemory ? dsp::wavenet::Precision::INT8 : dsp::wavenet::Precision::FLOAT32;
+    if (precision != modelBank->getPrecision()) {
+        modelBank->setPrecision(precision);
+        stagedModel = nullptr;
+        activeBlend = -1;
+        setAmp();
+    }
+
+    // A blend was waiting on a check or a model: if it can be played now,
+    // re-apply the gain setting to switch over to it.
+    int pair = pendingBlendPair;
+    auto canBlend = pair >= 0 ? modelBank->getBlendResult(pair) : std::nullopt;
+    if (canBlend.has_value()) {
+        const bool loaded = modelBank->getIfLoaded(pair) != nullptr && modelBank->getIfLoaded(pair + 1) != nullptr;
+        if ((!*canBlend || loaded) && pendingBlendPair.compare_exchange_strong(pair, -1) && *canBlend) {
+            setAmp();
+            return;
+        }
+    }
+
+    // A model finished loading in the background; if it's the one that was
+    // selected while it was loading, stage it now, with the usual crossfade.
+    int id = pendingModelId;
+    if (id < 0 || id != model_id) {
+        return;
+    }
+    if (auto model = modelBank->getIfLoaded(id)) {
+        if (pendingModelId.compare_exchange_strong(id, -1)) {
+            stageModel(model);
+        }
+    }
+}
+
+bool EqAudioProcessor::crossfadeModels(NAM_SAMPLE* output, const NAM_SAMPLE* oldOutput, int numFrames, const AmpCrossfade& crossfade)
+{
+    for (int s = 0; s < numFrames; s++) {
+        mix = (float)interpSmplCnt/(float)crossfade.size;
+        float x = mix*output[s]+(1.f-mix)*oldOutput[s];
+        float y = crossfade.b0*x+crossfade.b1*x1-crossfade.a1*y1;
+        x1 = x;
+        y1 = y;
+        output[s] = (1.f-mix)*y+mix*x;
+        interpSmplCnt++;
+        if (interpSmplCnt >= crossfade.size) {
+            mix = 0.f;
+            x1 = 0;
+            y1 = 0;
+            valueTreeState.getParameterAsValue("amp smooth").setValue(false);
+            interpSmplCnt = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+void EqAudioProcessor::stageModel(std::shared_ptr<nam::DSP> model, bool isUnused)
+{
+    if (model == stagedModel) {
+        return;
+    }
+    stagedModel = model;
+    // New instances keep the model's activation accuracy
+    auto instance = isUnused ? model : dsp::hotswap::NewInstance(*model, ampChannels);
+    if (instance == nullptr) {
+        // Can't be warmed up next to the playing model: run both and crossfade
+        modelScheduler.cancel();
+        enableSmoothing();
+        amp1_dsp = model;
+        return;
+    }
+    modelScheduler.setTarget(instance);
+}
+
+void EqAudioProcessor::stageIR(std::shared_ptr<dsp::ImpulseResponse<float>> ir)
+{
+    selectedIR = ir;
+    // The right side can't share the IR's state: it's a second instance,
+    // made once per IR
+    std::shared_ptr<dsp::ImpulseResponse<float>> right;
+    if (ampChannels > 1 && ir != nullptr) {
+        if (rightIRFor.lock() != ir) {
+            rightIR = std::make_shared<dsp::ImpulseResponse<float>>(ir->GetSource(), ir->GetSampleRate(), ir->GetConvolutionMode(),
+                                                                    ir->GetTrimParams());
+            rightIR->Prepare(1, maxBlockSize);
+            rightIRFor = ir;
+        }
+        right = rightIR;
+    }
+    // Picked up together with mStagedIR, so set it first
+    mStagedIRRight = right;
+    mStagedIR = ir;
 }
 
 void EqAudioProcessor::initializeIRs()
 {
     DBG("=== INITIALIZING PER-INSTANCE IRs ===");
     factoryIRs.resize(Constants::NUM_IRS);
-    originalFactoryIRs.resize(Constants::NUM_IRS);
 
+    // Loads run in parallel; anything that reads the IRs waits on initTasks
     for (int n = 1; n <= Constants::NUM_IRS; n++) {
-        loadIR(n);
+        initTasks.add([this, n] { loadIR(n); });
     }
-    DBG("=== PER-INSTANCE IRs INITIALIZED: " << factoryIRs.size() << " IRs ===");
+    DBG("=== PER-INSTANCE IRs QUEUED: " << factoryIRs.size() << " IRs ===");
 }
 
 juce::StringArray EqAudioProcessor::loadUserIRsFromDirectory(const juce::String& customIRPath)
@@ -306,6 +410,8 @@ juce::StringArray EqAudioProcessor::loadUserIRsFromDirectory(const juce::String&
     if (!file.existsAsFile()) {
         mStagedIR = nullptr;
         mIR = nullptr;
+        mStagedIRRight = nullptr;
+        mIRRight = nullptr;
         return customIRs;
     }
     
@@ -326,9 +432,14 @@ juce::StringArray EqAudioProcessor::loadUserIRsFromDirectory(const juce::String&
         return a.getFileNameWithoutExtension().compareIgnoreCase(b.getFileNameWithoutExtension()) < 0;
     });
     
-    userIRs.resize(wavFiles.size());
-    originalUserIRs.resize(wavFiles.size());
+    // Only the names are listed here; each file is decoded when it's first
+    // selected or prefetched (see setCustomIR())
+    userIRs.assign(wavFiles.size(), nullptr);
+    originalUserIRs.assign(wavFiles.size(), nullptr);
+    userIRQueued.assign(wavFiles.size(), false);
     userIRPaths.resize(wavFiles.size());  // Store paths for recall
+    userIRGeneration++;
+    pendingUserIR = -1;
     userIRDropdown.clear(juce::dontSendNotification);
 
     for (int i = 1; i <= wavFiles.size(); i++) {
@@ -337,20 +448,6 @@ juce::StringArray EqAudioProcessor::loadUserIRsFromDirectory(const juce::String&
         juce::String irName = irFile.getFileNameWithoutExtension();
         userIRDropdown.addItem(irName, i);
         customIRs.add(irName);
-
-        // Read sample rate from WAV file
-        std::unique_ptr<juce::AudioFormatReader> reader;
-        juce::AudioFormatManager formatManager;
-        formatManager.registerBasicFormats();
-        reader.reset(formatManager.createReaderFor(irFile));
-
-        double wavSampleRate = 48000.0; // fallback default
-        if (reader != nullptr) {
-            wavSampleRate = reader->sampleRate;
-        }
-
-        userIRs[i-1] = std::make_shared<dsp::ImpulseResponse>(path.toRawUTF8(), wavSampleRate);
-        originalUserIRs[i-1] = std::make_shared<dsp::ImpulseResponse>(path.toRawUTF8(), wavSampleRate);
         userIRPaths[i-1] = path;  // Store the full path for recall
     }
     
@@ -387,7 +484,6 @@ void EqAudioProcessor::restoreIRFromState()
     juce::String customIRPath = state.getProperty("customIR", "");
     if (customIRPath.isNotEmpty()) {
         juce::StringArray customIRs = loadUserIRsFromDirectory(customIRPath);
-        resampleUserIRs(projectSr);
         updateAllIRs(customIRs);
         DBG("Loaded custom IRs from path: " << customIRPath);
     }
@@ -498,6 +594,8 @@ void EqAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
+    // Barrier: everything started in the constructor is done before the first processBlock
+    initTasks.wait();
     EQ1_1.setSr(sampleRate);
     EQ1_2.setSr(sampleRate);
     EQ2_1.setSr(sampleRate);
@@ -517,10 +615,8 @@ void EqAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
     interpSize = (unsigned int)(0.2*sampleRate);
     presetInterpSize = (unsigned int)(0.5*sampleRate);
     interpBuf.resize(interpSize);
-    K = tan(M_PI*3000.0/sampleRate);
-    b0 = K/(K+1);
-    b1 = K/(K+1);
-    a1 = (K-1)/(K+1);
+    projectCrossfade = AmpCrossfade(sampleRate);
+    modelCrossfade = AmpCrossfade(modelSr);
     y1 = 0;
     x1 = 0;
     lpfMix = 1.f;
@@ -530,11 +626,37 @@ void EqAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
     rmsIn.setCurrentAndTargetValue(-100.f);
     reverbWp = (int)(sampleRate*0.035);
     projectSr = sampleRate;
-    mResampler1.Reset(projectSr, Constants::BUFFERSIZE);
+    // Two branches: the current and the outgoing model during a crossfade
+    mResampler1.Reset(projectSr, Constants::BUFFERSIZE, 2);
     mResampler2.Reset(projectSr, Constants::BUFFERSIZE);
+    mResamplerStereo.Reset(projectSr, Constants::BUFFERSIZE);
     irResampler.Reset(projectSr, Constants::BUFFERSIZE);
-    resampleFactoryIRs(projectSr);
-    resampleUserIRs(projectSr);
+    // The IRs and gates are prepared for the host's blocks, so processing
+    // them doesn't allocate
+    maxBlockSize = samplesPerBlock;
+    mNoiseGateTrigger.Prepare(1, maxBlockSize);
+    mNoiseGateGain.Prepare(1, maxBlockSize);
+    // Nothing is playing, so the current IRs can be prepared in place
+    auto prepareIR = [this] (const std::shared_ptr<dsp::ImpulseResponse<float>>& ir) {
+        if (ir != nullptr) {
+            ir->Prepare(1, maxBlockSize);
+        }
+    };
+    for (const auto& ir : factoryIRs) {
+        prepareIR(ir);
+    }
+    for (const auto& ir : userIRs) {
+        prepareIR(ir);
+    }
+    prepareIR(mIR);
+    prepareIR(mIRRight);
+    prepareIR(mStagedIR);
+    prepareIR(mStagedIRRight);
+    prepareIR(rightIR);
+    // They keep playing until they've been remade for a new rate
+    if (projectSr != irSampleRate) {
+        resampleIRs(projectSr);
+    }
 
     // Reset delay for new sample rate
     for (int ch = 0; ch < getTotalNumInputChannels(); ch++) {
@@ -542,21 +664,177 @@ void EqAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
     }
 }
 
-void EqAudioProcessor::resampleFactoryIRs(double targetSr)
+void EqAudioProcessor::resampleIRs(double targetSr)
 {
-//    return;
-    for (int i = 0; i < Constants::NUM_IRS; i++) {
-        const auto irData = originalFactoryIRs[i]->GetData();
-        factoryIRs[i] = std::make_unique<dsp::ImpulseResponse>(irData, targetSr);
+    initTasks.wait();
+    auto variants = std::make_shared<IRVariants>();
+    {
+        std::lock_guard<std::mutex> lock(irVariantsMutex);
+        variants->generation = ++irVariantsGeneration;
+    }
+    variants->sampleRate = targetSr;
+    variants->factory.resize(factoryIRs.size());
+    variants->userSources = originalUserIRs;
+    variants->user.resize(originalUserIRs.size());
+    variants->numPending = (int)(variants->factory.size() + variants->user.size());
+    const int blockSize = maxBlockSize;
+    auto add = [this, variants, targetSr, blockSize] (bool user, size_t i) {
+        irTasks.add([this, variants, targetSr, blockSize, user, i] {
+            dsp::IRSource source = user ? dsp::IRSource() : getFactoryIRSources()[i];
+            if (user && variants->userSources[i] != nullptr) {
+                source = variants->userSources[i]->GetSource();
+            }
+            auto& ir = (user ? variants->user : variants->factory)[i];
+            if (source.mSamples != nullptr) {
+                ir = Service::IRCache::getInstance().createIR(source, targetSr, irTrimParams);
+                ir->Prepare(1, blockSize);
+            }
+            // The last one hands them all over to the message thread, unless
+            // they've been requested again since
+            if (--variants->numPending == 0) {
+                std::lock_guard<std::mutex> lock(irVariantsMutex);
+                if (variants->generation == irVariantsGeneration) {
+                    readyIRVariants = variants;
+                    triggerAsyncUpdate();
+                }
+            }
+        });
+    };
+    for (size_t i = 0; i < variants->factory.size(); i++) {
+        add(false, i);
+    }
+    for (size_t i = 0; i < variants->user.size(); i++) {
+        add(true, i);
     }
 }
 
-void EqAudioProcessor::resampleUserIRs(double targetSr)
+void EqAudioProcessor::applyIRVariants(const IRVariants& variants)
 {
-//    return;
-    for (int i = 0; i < userIRs.size(); i++) {
-        const auto irData = originalUserIRs[i]->GetData();
-        userIRs[i] = std::make_unique<dsp::ImpulseResponse>(irData, targetSr);
+    // User IRs decoded or reloaded since were made at the new rate already
+    // (see loadUserIR()); only the ones these were made from are replaced
+    auto sameUserIR = [this, &variants] (size_t i) {
+        return i < variants.userSources.size() && i < originalUserIRs.size()
+            && variants.userSources[i] != nullptr && variants.userSources[i] == originalUserIRs[i];
+    };
+    // Keep playing the selected IR, at the new rate
+    std::shared_ptr<dsp::ImpulseResponse<float>> selected;
+    const auto factoryIt = std::find(factoryIRs.begin(), factoryIRs.end(), selectedIR);
+    const auto userIt = std::find(userIRs.begin(), userIRs.end(), selectedIR);
+    if (selectedIR != nullptr && factoryIt != factoryIRs.end()) {
+        selected = variants.factory[factoryIt - factoryIRs.begin()];
+    }
+    else if (selectedIR != nullptr && userIt != userIRs.end() && sameUserIR(userIt - userIRs.begin())) {
+        selected = variants.user[userIt - userIRs.begin()];
+    }
+    factoryIRs = variants.factory;
+    for (size_t i = 0; i < userIRs.size(); i++) {
+        if (sameUserIR(i)) {
+            userIRs[i] = variants.user[i];
+        }
+    }
+    irSampleRate = variants.sampleRate;
+    if (selected != nullptr) {
+        stageIR(selected);
+    }
+}
+
+void EqAudioProcessor::setCustomIR(int i)
+{
+    if (i < 0 || i >= (int)userIRs.size()) {
+        pendingUserIR = -1;
+        irEnabled.store(false);
+        return;
+    }
+    if (userIRs[i] != nullptr) {
+        pendingUserIR = -1;
+        stageIR(userIRs[i]);
+        irEnabled.store(true);
+    }
+    else {
+        // The current IR keeps playing until this one is ready
+        pendingUserIR = i;
+        loadUserIR(i);
+    }
+    // Most likely to be picked next, with the next/previous buttons
+    loadUserIR(i + 1);
+    loadUserIR(i - 1);
+}
+
+void EqAudioProcessor::loadUserIR(int i)
+{
+    if (i < 0 || i >= (int)userIRs.size() || userIRs[i] != nullptr || userIRQueued[i]) {
+        return;
+    }
+    userIRQueued[i] = true;
+    LoadedUserIR loaded;
+    loaded.generation = userIRGeneration;
+    loaded.index = i;
+    loaded.sampleRate = projectSr;
+    loaded.blockSize = maxBlockSize;
+    // Decoded already if it's only being remade at another rate
+    loaded.original = originalUserIRs[i];
+    const juce::String path = userIRPaths[i];
+    userIRTasks.add([this, loaded, path] () mutable {
+        if (loaded.original == nullptr) {
+            // The rate of the file comes with its audio
+            auto irData = std::make_shared<Service::IRCache::IRData>();
+            const auto wavState = dsp::wav::Load(path.toRawUTF8(), irData->mRawAudio, irData->mRawAudioSampleRate);
+            if (wavState == dsp::wav::LoadReturnCode::SUCCESS) {
+                const auto source = dsp::ImpulseResponse<float>::MakeSource(irData);
+                loaded.original = std::make_shared<dsp::ImpulseResponse<float>>(source, source.mSampleRate);
+            }
+        }
+        if (loaded.original != nullptr) {
+            loaded.ir = Service::IRCache::getInstance().createIR(loaded.original->GetSource(), loaded.sampleRate,
+                                                                 irTrimParams);
+            loaded.ir->Prepare(1, loaded.blockSize);
+        }
+        {
+            std::lock_guard<std::mutex> lock(userIRMutex);
+            readyUserIRs.push_back(std::move(loaded));
+        }
+        triggerAsyncUpdate();
+    });
+}
+
+void EqAudioProcessor::applyLoadedUserIRs()
+{
+    std::vector<LoadedUserIR> loadedIRs;
+    {
+        std::lock_guard<std::mutex> lock(userIRMutex);
+        loadedIRs.swap(readyUserIRs);
+    }
+    for (auto& loaded : loadedIRs) {
+        // From a folder that has been listed again since
+        if (loaded.generation != userIRGeneration) {
+            continue;
+        }
+        const int i = loaded.index;
+        if (loaded.ir == nullptr) {
+            // Stays queued, so it isn't read again
+            DBG("Failed to load user IR " << userIRPaths[i]);
+            if (pendingUserIR == i) {
+                pendingUserIR = -1;
+            }
+            continue;
+        }
+        originalUserIRs[i] = loaded.original;
+        if (loaded.sampleRate != projectSr || loaded.blockSize != maxBlockSize) {
+            // prepareToPlay() was called while it was loading: remake it
+            // from the decoded audio
+            userIRQueued[i] = false;
+            loadUserIR(i);
+            continue;
+        }
+        userIRs[i] = loaded.ir;
+        // Near-silent tails are trimmed at load time (see irTrimParams)
+        DBG("User IR " << userIRPaths[i] << ": " << (int)loaded.ir->GetNumTaps() << " of "
+            << (int)loaded.ir->GetUntrimmedLength() << " taps convolved");
+        if (pendingUserIR == i) {
+            pendingUserIR = -1;
+            stageIR(loaded.ir);
+            irEnabled.store(true);
+        }
     }
 }
 
@@ -630,9 +908,27 @@ void EqAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mid
             rmsIn.setCurrentAndTargetValue(rmsIn_val);
         }
         NAM_SAMPLE* dataInPtr = dataIn.data();
-        NAM_SAMPLE** triggerOut = &dataInPtr;
         NAM_SAMPLE* dataOutPtr = dataOut.data();
+        NAM_SAMPLE* dataOutRPtr = dataOutR.data();
         NAM_SAMPLE* cfPtr = crossfadeBuffer.data();
+        // A stereo amp plays both sides of a stereo input; otherwise the amp
+        // plays their mix (dataIn) and its output goes to both sides.
+        const bool stereoIn = totalNumInputChannels > 1;
+        const int wantedAmpChannels = stereoIn && ampStereoParameter->load() >= 0.5f ? 2 : 1;
+        const bool stereoAmp = wantedAmpChannels == 2;
+        if (requestedAmpChannels.exchange(wantedAmpChannels) != wantedAmpChannels) {
+            triggerAsyncUpdate();
+        }
+        const bool wantedLowMemory = ampLowMemoryParameter->load() >= 0.5f;
+        if (requestedLowMemory.exchange(wantedLowMemory) != wantedLowMemory) {
+            triggerAsyncUpdate();
+        }
+        if (stereoAmp) {
+            for (int i = 0; i < buffer.getNumSamples(); i++) {
+                dataInL[i] = (NAM_SAMPLE)chL[i];
+                dataInR[i] = (NAM_SAMPLE)chR[i];
+            }
+        }
         const double threshold = valueTreeState.getParameterAsValue("noise gate").getValue();
         if (threshold >= -99.9)
         {
@@ -644,7 +940,8 @@ void EqAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mid
             const dsp::noise_gate::TriggerParams triggerParams(time, threshold, ratio, openTime, holdTime, closeTime);
             mNoiseGateTrigger.SetParams(triggerParams);
             mNoiseGateTrigger.SetSampleRate(projectSr);
-            triggerOut = mNoiseGateTrigger.Process(&dataInPtr, 1, buffer.getNumSamples());
+            // The trigger only listens, so the amp's input stays in dataIn
+            mNoiseGateTrigger.ProcessInPlace(&dataInPtr, 1, buffer.getNumSamples());
         }
         // this is like _applyDSPStaging()
         if (amp1_dsp != nullptr) {
@@ -653,80 +950,125 @@ void EqAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::Mid
         }
         // this is the actual processing
         if (amp1_model != nullptr) {
-            if (projectSr != modelSr) {
-                mResampler1.ProcessBlock(&dataInPtr, &dataOutPtr, buffer.getNumSamples(), setResamplingModelProcess(amp1_model));
+            bool needSmoothing = valueTreeState.getParameterAsValue("amp smooth").getValue();
+            // Whether the crossfade from old_model was done with the models
+            bool crossfaded = false;
+            // The swapper records the model's input and swaps in warmed-up models
+            if (stereoAmp) {
+                NAM_SAMPLE* stereoInPtrs[2] = { dataInL.data(), dataInR.data() };
+                NAM_SAMPLE* stereoOutPtrs[2] = { dataOutPtr, dataOutRPtr };
+                if (projectSr != modelSr) {
+                    mResamplerStereo.ProcessBlock(stereoInPtrs, stereoOutPtrs, buffer.getNumSamples(), [this] (NAM_SAMPLE** input, NAM_SAMPLE** output, int numFrames) {
+                        modelSwapper.Process(amp1_model, input, output, 2, numFrames);
+                    });
+                }
+                else {
+                    modelSwapper.Process(amp1_model, stereoInPtrs, stereoOutPtrs, 2, buffer.getNumSamples());
+                }
+            }
+            else if (projectSr != modelSr && needSmoothing) {
+                // Both models share the upsampled input (the mono mix of a
+                // stereo input) and are crossfaded at their rate, so only the
+                // mix is downsampled. old_model stays put until the block is
+                // done.
+                const ModelProcess outgoing { old_model.get() };
+                bool fading = true;
+                mResampler1.ProcessBranches(&dataInPtr, &dataOutPtr, buffer.getNumSamples(), 2, [this, outgoing] (int branch, NAM_SAMPLE** input, NAM_SAMPLE** output, int numFrames) {
+                    if (branch == 0) {
+                        modelSwapper.Process(amp1_model, input[0], output[0], numFrames);
+                    }
+                    else {
+                        outgoing(input, output, numFrames);
+                    }
+                }, [this, &fading] (NAM_SAMPLE** branchOutputs, NAM_SAMPLE** output, int numFrames) {
+                    std::copy(branchOutputs[0], branchOutputs[0] + numFrames, output[0]);
+                    if (fading) {
+                        fading = !crossfadeModels(output[0], branchOutputs[1], numFrames, modelCrossfade);
+                    }
+                });
+                if (!fading) {
+                    old_model = amp1_model;
+                }
+                crossfaded = true;
+            }
+            else if (projectSr != modelSr) {
+                mResampler1.ProcessBlock(&dataInPtr, &dataOutPtr, buffer.getNumSamples(), [this] (NAM_SAMPLE** input, NAM_SAMPLE** output, int numFrames) {
+                    modelSwapper.Process(amp1_model, input[0], output[0], numFrames);
+                });
             }
             else {
-                amp1_model->process(*triggerOut, dataOutPtr, buffer.getNumSamples());
-                amp1_model->finalize_(buffer.getNumSamples());
+                modelSwapper.Process(amp1_model, dataInPtr, dataOutPtr, buffer.getNumSamples());
             }
-            bool needSmoothing = valueTreeState.getParameterAsValue("amp smooth").getValue();
-            if (needSmoothing) {
+            if (!needSmoothing) {
+                // Nothing to crossfade from: keep old_model on the model
+                // that's playing (only assigned when it changes, to keep
+                // reference counting off the audio thread's every block)
+                if (old_model != amp1_model) {
+                    old_model = amp1_model;
+                }
+            }
+            else if (!crossfaded) {
                 if (projectSr != modelSr) {
-                    mResampler2.ProcessBlock(&dataInPtr, &cfPtr, buffer.getNumSamples(), setResamplingModelProcess(old_model));
+                    // Stereo amp: the outgoing model plays the mono mix
+                    mResampler2.ProcessBlock(&dataInPtr, &cfPtr, buffer.getNumSamples(), ModelProcess { old_model.get() });
                 }
                 else {
                     old_model->process(dataInPtr, cfPtr, buffer.getNumSamples());
                     old_model->finalize_(buffer.getNumSamples());
                 }
-                for (int s = 0; s < buffer.getNumSamples(); s++) {
-                    mix = (float)interpSmplCnt/(float)interpSize;
-                    float x = mix*dataOutPtr[s]+(1.f-mix)*cfPtr[s];
-                    float y = b0*x+b1*x1-a1*y1;
-                    x1 = x;
-                    y1 = y;
-                    dataOutPtr[s] = (1.f-mix)*y+mix*x;
-                    interpSmplCnt++;
-                    if (interpSmplCnt >= interpSize) {
-                        mix = 0.f;
-                        x1 = 0;
-                        y1 = 0;
-                        valueTreeState.getParameterAsValue("amp smooth").setValue(false);
-                        old_model = amp1_model;
-                        interpSmplCnt = 0;
-                        break;
-                    }
+                if (crossfadeModels(dataOutPtr, cfPtr, buffer.getNumSamples(), projectCrossfade)) {
+                    old_model = amp1_model;
+                }
+                // The long crossfade is mono (it's only used for models that
+                // can't be warmed up, which are mono too)
+                if (stereoAmp) {
+                    std::copy(dataOutPtr, dataOutPtr + buffer.getNumSamples(), dataOutRPtr);
                 }
             }
+            if (stereoIn && !stereoAmp) {
+                std::copy(dataOutPtr, dataOutPtr + buffer.getNumSamples(), dataOutRPtr);
+            }
         }
         else {
             for (int s = 0; s < buffer.getNumSamples(); s++) {
-                dataOutPtr[s] = triggerOut[0][s];
+                dataOutPtr[s] = dataInPtr[s];
+                dataOutRPtr[s] = dataInPtr[s];
             }
         }
-        if (threshold >= -99.9) {
-            NAM_SAMPLE** gateGainOutput = mNoiseGateGain.Process(&dataOutPtr, 1, buffer.getNumSamples());
-            for (int i = 0; i < buffer.getNumSamples(); i++) {
-                chL[i] = gateGainOutput[0][i];
-                if (totalNumInputChannels > 1) {
-                    chR[i] = gateGainOutput[0][i];
-                }
+        // From here on the chain runs in float, in place in the buffer
+        for (int i = 0; i < buffer.getNumSamples(); i++) {
+            chL[i] = (float)dataOutPtr[i];
+            if (totalNumInputChannels > 1) {
+                chR[i] = (float)dataOutRPtr[i];
             }
         }
-        else {
-            for (int i = 0; i < buffer.getNumSamples(); i++) {
-                chL[i] = dataOutPtr[i];
-                if (totalNumInputChannels > 1) {
-                    chR[i] = dataOutPtr[i];
-                }
+        if (threshold >= -99.9) {
+            // Same gain reduction on both sides, from the trigger on their mix
+            mNoiseGateGain.ProcessInPlace(&chL, 1, buffer.getNumSamples());
+            if (totalNumInputChannels > 1) {
+                mNoiseGateGain.ProcessInPlace(&chR, 1, buffer.getNumSamples());
             }
         }
         // Check if mStagedIR is not null, and log that it will be processed
         if (mStagedIR != nullptr) {
             mIR = mStagedIR;
+            mIRRight = mStagedIRRight;
             mStagedIR = nullptr;
+            mStagedIRRight = nullptr;
         }
         if (mIR != nullptr && irEnabled.load()) {
-            // Log the size of the buffer and IR data to check for discrepancies
-            for (int i = 0; i < buffer.getNumSamples(); i++) {
-                irIn[0][i] = (double)(chL[i]);
+            // Long IRs mustn't drop out when bouncing faster than real time
+            mIR->SetNonRealtime(isNonRealtime());
+            mIR->ProcessInPlace(&chL, 1, buffer.getNumSamples());
+            const bool stereoIR = mIRRight != nullptr && totalNumInputChannels > 1;
+            if (stereoIR) {
+                mIRRight->SetNonRealtime(isNonRealtime());
+                mIRRight->ProcessInPlace(&chR, 1, buffer.getNumSamples());
             }
-            double** ir_out = nullptr;
-            ir_out = mIR->Process(irIn, 1, buffer.getNumSamples());
-            for (int ch = 0; ch < totalNumInputChannels; ch++) {
-                auto *channelData = buffer.getWritePointer(ch);
-                for (int i = 0; i < buffer.getNumSamples(); i++) {
-                    channelData[i] = (float)ir_out[0][i];
+            else {
+                // The left side's IR plays on every channel
+                for (int ch = 1; ch < totalNumInputChannels; ch++) {
+                    buffer.copyFrom(ch, 0, chL, buffer.getNumSamples());
                 }
             }
         }
@@ -1054,9 +1396,6 @@ void EqAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
             }
             setAmp();
 
-            // Resample factory IRs
-            resampleFactoryIRs(projectSr);
-
             // Restore IR state using unified helper method
             restoreIRFromState();
         }
@@ -1078,23 +1417,69 @@ void EqAudioProcessor::setAmp() {
     int start_idx = std::nan("-1");
     bool ampState = valueTreeState.getParameterAsValue("is amp 1").getValue();
     if (!ampState) {
-        start_idx = models.size()/2;
+        start_idx = modelBank->size()/2;
     }
     else {
         start_idx = 0;
     }
     float gainLvl = valueTreeState.getParameterAsValue("amp gain").getValue();
-    float intpart;
-    float frac = std::modf(gainLvl, &intpart);
     int offset = (unsigned long)((gainLvl-1.0)*2);
-    if (frac == 0.f || frac == 0.5f) {
-        enableSmoothing();
-    }
     model_id = start_idx+offset;
+    if (setBlendedModel(start_idx, gainLvl)) {
+        return;
+    }
 //    DBG("model_id: " << model_id << ", gain level: " << gainLvl << ", offset: " << offset);
     setModel();
 }
 
+bool EqAudioProcessor::setBlendedModel(int ampStart, float gainLvl) {
+    bool interpolate = valueTreeState.getParameterAsValue("amp interpolate").getValue();
+    if (!interpolate) {
+        pendingBlendPair = -1;
+        return false;
+    }
+    // Captures are 0.5 apart on the gain knob
+    const int modelsPerAmp = (int)modelBank->size() / 2;
+    const float position = juce::jlimit(0.f, (float)(modelsPerAmp - 1), (gainLvl - 1.f) * 2.f);
+    const int lo = juce::jlimit(0, modelsPerAmp - 2, (int)position);
+    const float t = position - (float)lo;
+    const int pair = ampStart + lo;
+
+    auto canBlend = modelBank->getBlendResult(pair);
+    auto a = modelBank->getIfLoaded(pair);
+    auto b = modelBank->getIfLoaded(pair + 1);
+    if (!canBlend.has_value() || a == nullptr || b == nullptr) {
+        // Snap for now and come back in handleAsyncUpdate()
+        pendingBlendPair = pair;
+        modelBank->checkBlend(pair);
+        return false;
+    }
+    pendingBlendPair = -1;
+    if (!*canBlend) {
+        return false;
+    }
+
+    auto weightsA = static_cast<dsp::wavenet::WaveNet*>(a.get())->GetWeights();
+    auto weightsB = static_cast<dsp::wavenet::WaveNet*>(b.get())->GetWeights();
+    if (activeBlend >= 0 && blendAmpStart == ampStart && std::abs(pair - blendPair) <= 1) {
+        // Moving along the same amp: glide the active blend, no crossfade
+        blendedModels[activeBlend]->SetTarget(weightsA, weightsB, t);
+    }
+    else {
+        // A new instance every time: the previous one may still be fading out
+        const int next = activeBlend == 0 ? 1 : 0;
+        blendedModels[next] = std::make_shared<dsp::wavenet::BlendedWaveNet>(weightsA, weightsB, t, ampChannels);
+        blendedModels[next]->SetActivationAccuracy(ampActivationAccuracy);
+        stageModel(blendedModels[next], true);
+        activeBlend = next;
+    }
+    blendPair = pair;
+    blendAmpStart = ampStart;
+    pendingModelId = -1;
+    prefetchNeighbouringModels(pair);
+    return true;
+}
+
 void EqAudioProcessor::setMainKnobID() {
     if (auto* editor = dynamic_cast<EqAudioProcessorEditor*>(getActiveEditor()))
     {
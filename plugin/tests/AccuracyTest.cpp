@@ -0,0 +1,77 @@
+//
+//  AccuracyTest.cpp
+//
+// Checks that every model given (the factory models, when run by ctest)
+// plays close enough to the exact float model
+// - with fast activations (dsp::wavenet::ActivationAccuracy::FAST), which
+//   every amp model plays with,
+// - with 8-bit weights (dsp::wavenet::Precision::INT8), and with 8-bit
+//   weights and fast activations, as the low memory mode plays it:
+// no error-to-signal ratio may be over its limit. Also prints the memory
+// taken by the weights in float and in 8-bit form.
+//
+// Usage: AccuracyTest <model.nam> [<model.nam> ...]
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../dsp/SharedWaveNet.h"
+
+namespace
+{
+// Well below what can be heard (a trained capture is typically around 1e-2
+// from its amp), with a margin over the factory models
+constexpr double kMaxFastActivationESR = 1.0e-5;
+constexpr double kMaxQuantizedESR = 1.0e-3;
+}; // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <model.nam> [<model.nam> ...]" << std::endl;
+    return 1;
+  }
+
+  int result = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    try
+    {
+      std::ifstream input(argv[i]);
+      if (!input)
+        throw std::runtime_error("Can't open input file");
+      nlohmann::json json;
+      input >> json;
+      if (json.at("architecture").get<std::string>() != "WaveNet")
+        throw std::runtime_error("Not a WaveNet");
+      const double sampleRate =
+        json.contains("sample_rate") && json["sample_rate"].is_number() ? json["sample_rate"].get<double>() : -1.0;
+
+      auto reference = std::make_shared<const dsp::wavenet::Weights>(
+        json.at("config"), json.at("weights").get<std::vector<float>>(), sampleRate);
+      const double fastESR = dsp::wavenet::GetESR(reference, reference, dsp::wavenet::ActivationAccuracy::FAST);
+      auto quantized = std::make_shared<const dsp::wavenet::Weights>(*reference, dsp::wavenet::Precision::INT8);
+      const double quantizedESR = dsp::wavenet::GetESR(quantized, reference);
+      const double quantizedFastESR =
+        dsp::wavenet::GetESR(quantized, reference, dsp::wavenet::ActivationAccuracy::FAST);
+      const bool ok = fastESR <= kMaxFastActivationESR && quantizedESR <= kMaxQuantizedESR
+                      && quantizedFastESR <= kMaxQuantizedESR;
+      std::cout << argv[i] << ": fast activations ESR " << fastESR << "; int8 ESR " << quantizedESR
+                << " (fast activations " << quantizedFastESR << "), " << quantized->GetSizeInBytes()
+                << " bytes (float " << reference->GetSizeInBytes() << ")" << (ok ? "" : " FAILED") << std::endl;
+      if (!ok)
+        result = 1;
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << argv[i] << ": " << e.what() << std::endl;
+      result = 1;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,89 @@
+//
+//  ConvolutionTest.cpp
+//
+// Checks IR convolution in DIRECT and PARTITIONED mode (see
+// dsp::ImpulseResponse::ConvolutionMode) against a plain direct convolution,
+// with IRs long enough for every partition stage, including the background
+// ones, and host blocks of random sizes.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../dsp/ImpulseResponse.h"
+
+namespace
+{
+using IR = dsp::ImpulseResponse<float>;
+
+constexpr double kSampleRate = 48000.0;
+constexpr size_t kNumFrames = 60000;
+// Relative to the peak of the output
+constexpr double kMaxError = 1.0e-5;
+
+std::vector<float> Noise(const size_t length, const unsigned seed, const bool decay)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+  std::vector<float> result(length);
+  for (size_t i = 0; i < length; i++)
+    result[i] = uniform(rng) * (decay ? (float)std::exp(-3.0 * i / length) : 1.0f);
+  return result;
+}
+
+// Whether ir's output is input convolved with taps, up to kMaxError
+bool Check(const char* name, IR& ir, const std::vector<float>& taps, const std::vector<float>& input)
+{
+  // IRs are played 18dB down (see ImpulseResponse::_SetWeights())
+  const double gain = std::pow(10.0, -18.0 * 0.05) * 48000.0 / kSampleRate;
+  std::vector<float> output = input;
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<size_t> blockSizes(1, 1024);
+  ir.Prepare(1, 1024);
+  ir.SetNonRealtime(true);
+  for (size_t i = 0; i < output.size();)
+  {
+    const size_t count = std::min(blockSizes(rng), output.size() - i);
+    float* buffer = output.data() + i;
+    ir.ProcessInPlace(&buffer, 1, count);
+    i += count;
+  }
+
+  double peak = 0.0, error = 0.0;
+  for (size_t i = 0; i < input.size(); i++)
+  {
+    double expected = 0.0;
+    for (size_t k = 0; k < std::min(taps.size(), i + 1); k++)
+      expected += gain * taps[k] * input[i - k];
+    peak = std::max(peak, std::fabs(expected));
+    error = std::max(error, std::fabs(expected - output[i]));
+  }
+  const bool ok = error <= kMaxError * peak;
+  std::cout << name << ": " << taps.size() << " taps, max error " << error / peak << (ok ? "" : " FAILED")
+            << std::endl;
+  return ok;
+}
+}; // namespace
+
+int main()
+{
+  const std::vector<float> input = Noise(kNumFrames, 2, false);
+
+  bool ok = true;
+  for (const size_t length : {100, 8192, 40000})
+  {
+    IR::IRData irData;
+    irData.mRawAudio = Noise(length, 1, true);
+    irData.mRawAudioSampleRate = kSampleRate;
+    if (length <= 8192)
+    {
+      IR direct(irData, kSampleRate, IR::ConvolutionMode::DIRECT);
+      ok &= Check("DIRECT", direct, irData.mRawAudio, input);
+    }
+    IR partitioned(irData, kSampleRate, IR::ConvolutionMode::PARTITIONED);
+    ok &= Check("PARTITIONED", partitioned, irData.mRawAudio, input);
+  }
+  return ok ? 0 : 1;
+}
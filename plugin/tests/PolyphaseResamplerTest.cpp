@@ -0,0 +1,138 @@
+//
+//  PolyphaseResamplerTest.cpp
+//
+// Checks dsp::PolyphaseResampler, as the resampling container uses it, on
+// sines at 44.1k -> 48k (L = 160, M = 147) and 96k -> 48k: the number of
+// samples it puts out, its passband response, the round trip back to the
+// host's rate, and (at 96k) that what's above the model's Nyquist frequency
+// doesn't alias into the output. Input comes in host blocks of random sizes.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "../dsp/ResamplingContainer/PolyphaseResampler.h"
+
+namespace
+{
+// What ResamplingContainer<float, 1, 12> runs
+constexpr int kTaps = 24;
+using Resampler = dsp::PolyphaseResampler<float, 1, kTaps>;
+
+constexpr double kModelRate = 48000.0;
+constexpr size_t kNumFrames = 65536;
+constexpr double kAmplitude = 0.5;
+// Relative to the amplitude, up to the top of the passband (about -54dB)
+constexpr double kMaxError = 2.0e-3;
+// Relative to the amplitude, for a sine above the model's Nyquist frequency
+constexpr double kMaxAlias = 1.0e-3;
+// Output samples at the start that still depend on the silence before the
+// sine, per resampling
+constexpr size_t kSettleSamples = 2 * kTaps;
+
+std::vector<float> Sine(const double frequency, const double sampleRate, const size_t length)
+{
+  std::vector<float> result(length);
+  for (size_t i = 0; i < length; i++)
+    result[i] = (float)(kAmplitude * std::sin(2.0 * M_PI * frequency * i / sampleRate));
+  return result;
+}
+
+std::vector<float> Resample(const std::vector<float>& input, const double inputRate, const double outputRate)
+{
+  // The input buffer is too large for the stack
+  auto resampler = std::make_unique<Resampler>(inputRate, outputRate);
+  std::vector<float> output;
+  std::vector<float> block(8192);
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<size_t> blockSizes(1, 1024);
+  for (size_t i = 0; i < input.size();)
+  {
+    const size_t count = std::min(blockSizes(rng), input.size() - i);
+    float* inputPointer = const_cast<float*>(input.data()) + i;
+    float* blockPointer = block.data();
+    resampler->PushBlock(&inputPointer, count);
+    const size_t populated = resampler->PopBlock(&blockPointer, block.size());
+    resampler->RenormalizePhases();
+    output.insert(output.end(), block.begin(), block.begin() + populated);
+    i += count;
+  }
+  return output;
+}
+
+// Largest difference between signal and expected after the first skip
+// samples, relative to kAmplitude
+double MaxError(const std::vector<float>& signal, const std::vector<float>& expected, const size_t skip)
+{
+  double error = 0.0;
+  for (size_t i = skip; i < std::min(signal.size(), expected.size()); i++)
+    error = std::max(error, (double)std::fabs(signal[i] - expected[i]));
+  return error / kAmplitude;
+}
+
+bool Report(const double rate, const char* check, const double frequency, const double value, const double limit)
+{
+  const bool ok = value <= limit;
+  std::cout << rate / 1000.0 << "k " << check << " at " << frequency << " Hz: " << value << (ok ? "" : " FAILED")
+            << std::endl;
+  return ok;
+}
+
+// passbandEdge: highest frequency that's checked for kMaxError. The filter
+// spans kTaps samples of the higher rate, so its transition band is wider
+// at 96k.
+bool Check(const double rate, const double passbandEdge)
+{
+  bool ok = true;
+  if (!Resampler::Supports(rate, kModelRate) || !Resampler::Supports(kModelRate, rate))
+  {
+    std::cout << rate / 1000.0 << "k: not supported FAILED" << std::endl;
+    return false;
+  }
+
+  // No delay: output sample n is the input at n * rate / kModelRate, once
+  // kTaps / 2 input samples past it have come in
+  const std::vector<float> silence(kNumFrames, 0.0f);
+  const size_t numOutputs = Resample(silence, rate, kModelRate).size();
+  const double expectedOutputs = kNumFrames * kModelRate / rate;
+  const bool countOk = std::fabs(numOutputs - expectedOutputs) <= kTaps;
+  std::cout << rate / 1000.0 << "k: " << numOutputs << " samples out of " << kNumFrames << " (expected "
+            << expectedOutputs << ")" << (countOk ? "" : " FAILED") << std::endl;
+  ok &= countOk;
+
+  for (const double frequency : {20.0, 1000.0, 5000.0, 10000.0, 15000.0})
+  {
+    if (frequency > passbandEdge)
+      continue;
+    const std::vector<float> input = Sine(frequency, rate, kNumFrames);
+    const std::vector<float> modelInput = Resample(input, rate, kModelRate);
+    ok &= Report(rate, "passband error", frequency,
+                 MaxError(modelInput, Sine(frequency, kModelRate, modelInput.size()), kSettleSamples), kMaxError);
+    // Back to the host's rate, as around the model
+    const std::vector<float> roundTrip = Resample(modelInput, kModelRate, rate);
+    ok &= Report(rate, "round trip error", frequency, MaxError(roundTrip, input, 2 * kSettleSamples), kMaxError);
+  }
+
+  // Above the model's Nyquist frequency, e.g. 36k would alias to 12k
+  for (const double frequency : {36000.0, 40000.0})
+  {
+    if (frequency >= rate / 2.0)
+      continue;
+    const std::vector<float> modelInput = Resample(Sine(frequency, rate, kNumFrames), rate, kModelRate);
+    const std::vector<float> zero(modelInput.size(), 0.0f);
+    ok &= Report(rate, "alias", frequency, MaxError(modelInput, zero, kSettleSamples), kMaxAlias);
+  }
+  return ok;
+}
+}; // namespace
+
+int main()
+{
+  bool ok = true;
+  ok &= Check(44100.0, 15000.0);
+  ok &= Check(96000.0, 10000.0);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+//
+//  WaveNetMatchTest.cpp
+//
+// Checks that dsp::wavenet::WaveNet plays every model given (the factory
+// models, when run by ctest) the same as nam::wavenet::WaveNet, which it
+// replaces: both are settled on silence, then run on the same signal in host
+// blocks of random sizes, and no output sample may differ by more than
+// kMaxDifference.
+//
+// Usage: WaveNetMatchTest <model.nam> [<model.nam> ...]
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../dsp/SharedWaveNet.h"
+
+namespace
+{
+// Rounding only: both compute in float, in different orders
+constexpr double kMaxDifference = 1.0e-4;
+constexpr double kSeconds = 1.0;
+
+// A decaying sweep with a little noise, over the model's whole range
+std::vector<NAM_SAMPLE> MakeSignal(const double sampleRate)
+{
+  const size_t numSamples = (size_t)(kSeconds * sampleRate);
+  std::vector<NAM_SAMPLE> signal(numSamples);
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<double> uniform(-0.01, 0.01);
+  double phase = 0.0;
+  for (size_t i = 0; i < numSamples; i++)
+  {
+    const double position = (double)i / (double)numSamples;
+    phase += 2.0 * M_PI * 60.0 * std::pow(8000.0 / 60.0, position) / sampleRate;
+    signal[i] = (NAM_SAMPLE)(std::exp(-2.0 * position) * std::sin(phase) + uniform(rng));
+  }
+  return signal;
+}
+
+// Output of model on silence, then on input, in blocks of random sizes (the
+// same for every model)
+std::vector<NAM_SAMPLE> Run(nam::DSP& model, const long settleSamples, const std::vector<NAM_SAMPLE>& input)
+{
+  std::vector<NAM_SAMPLE> silence(settleSamples, (NAM_SAMPLE)0.0);
+  std::vector<NAM_SAMPLE> scratch(settleSamples);
+  model.process(silence.data(), scratch.data(), (int)settleSamples);
+  model.finalize_((int)settleSamples);
+
+  std::vector<NAM_SAMPLE> buffer(input);
+  std::vector<NAM_SAMPLE> output(input.size());
+  std::mt19937 rng(2);
+  std::uniform_int_distribution<size_t> blockSizes(1, 1024);
+  for (size_t i = 0; i < input.size();)
+  {
+    const size_t count = std::min(blockSizes(rng), input.size() - i);
+    model.process(buffer.data() + i, output.data() + i, (int)count);
+    model.finalize_((int)count);
+    i += count;
+  }
+  return output;
+}
+}; // namespace
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <model.nam> [<model.nam> ...]" << std::endl;
+    return 1;
+  }
+
+  int result = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    try
+    {
+      std::ifstream input(argv[i]);
+      if (!input)
+        throw std::runtime_error("Can't open input file");
+      nlohmann::json json;
+      input >> json;
+      nam::dspData conf;
+      conf.version = json.at("version").get<std::string>();
+      conf.architecture = json.at("architecture").get<std::string>();
+      conf.config = json.at("config");
+      conf.weights = json.at("weights").get<std::vector<float>>();
+      if (json.contains("sample_rate") && json["sample_rate"].is_number())
+        conf.expected_sample_rate = json["sample_rate"].get<double>();
+      if (conf.architecture != "WaveNet")
+        throw std::runtime_error("Not a WaveNet");
+
+      auto weights =
+        std::make_shared<const dsp::wavenet::Weights>(conf.config, conf.weights, conf.expected_sample_rate);
+      dsp::wavenet::WaveNet shared(weights);
+      std::unique_ptr<nam::DSP> reference = nam::get_dsp(conf);
+
+      const double sampleRate = conf.expected_sample_rate > 0.0 ? conf.expected_sample_rate : 48000.0;
+      const std::vector<NAM_SAMPLE> signal = MakeSignal(sampleRate);
+      const long settleSamples = weights->GetPrewarmSamples();
+      const std::vector<NAM_SAMPLE> expected = Run(*reference, settleSamples, signal);
+      const std::vector<NAM_SAMPLE> actual = Run(shared, settleSamples, signal);
+      double difference = 0.0;
+      for (size_t j = 0; j < signal.size(); j++)
+        difference = std::max(difference, std::fabs((double)actual[j] - (double)expected[j]));
+
+      const bool ok = difference <= kMaxDifference;
+      std::cout << argv[i] << ": max difference " << difference << (ok ? "" : " FAILED") << std::endl;
+      if (!ok)
+        result = 1;
+    }
+    catch (const std::exception& e)
+    {
+      std::cerr << argv[i] << ": " << e.what() << std::endl;
+      result = 1;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,101 @@
+//
+//  ConvolutionBenchmark.cpp
+//
+// Development tool: speed, as a multiple of real time, of an IR in DIRECT
+// and PARTITIONED mode (see dsp::ImpulseResponse::ConvolutionMode) at the
+// host block sizes we see most, with the difference between the two outputs.
+//
+// Usage: ConvolutionBenchmark [<IR length> [<sample rate>]]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../dsp/ImpulseResponse.h"
+
+namespace
+{
+using IR = dsp::ImpulseResponse<float>;
+
+constexpr double kSeconds = 5.0;
+
+// A decaying noise burst, like a cab IR
+IR::IRData MakeIR(const size_t length, const double sampleRate)
+{
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+  IR::IRData irData;
+  irData.mRawAudioSampleRate = sampleRate;
+  irData.mRawAudio.resize(length);
+  for (size_t i = 0; i < length; i++)
+    irData.mRawAudio[i] = uniform(rng) * (float)std::exp(-3.0 * i / length);
+  return irData;
+}
+
+// Runs kSeconds of noise through ir in blocks of blockSize; returns the
+// multiple of real time, and the output in output
+double Run(IR& ir, const size_t blockSize, const double sampleRate, std::vector<float>& output)
+{
+  const size_t numFrames = (size_t)(kSeconds * sampleRate) / blockSize * blockSize;
+  std::mt19937 rng(2);
+  std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+  std::vector<float> input(numFrames);
+  for (float& x : input)
+    x = uniform(rng);
+  output = input;
+
+  ir.Prepare(1, blockSize);
+  // Faster than real time, so wait for the background stages (and time them
+  // too) rather than let them drop out
+  ir.SetNonRealtime(true);
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < numFrames; i += blockSize)
+  {
+    float* buffer = output.data() + i;
+    ir.ProcessInPlace(&buffer, 1, blockSize);
+  }
+  const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return kSeconds / seconds;
+}
+
+double MaxDifference(const std::vector<float>& a, const std::vector<float>& b)
+{
+  double result = 0.0;
+  for (size_t i = 0; i < std::min(a.size(), b.size()); i++)
+    result = std::max(result, (double)std::fabs(a[i] - b[i]));
+  return result;
+}
+}; // namespace
+
+int main(int argc, char* argv[])
+{
+  const long length = argc > 1 ? std::atol(argv[1]) : 8192;
+  const double sampleRate = argc > 2 ? std::atof(argv[2]) : 48000.0;
+  if (length <= 0 || sampleRate <= 0.0)
+  {
+    std::cerr << "Usage: " << argv[0] << " [<IR length> [<sample rate>]]" << std::endl;
+    return 1;
+  }
+  const IR::IRData irData = MakeIR((size_t)length, sampleRate);
+  std::cout << "IR of " << length << " taps at " << sampleRate << " Hz, x real time, single instance" << std::endl;
+
+  for (const size_t blockSize : {32, 64, 128, 512})
+  {
+    std::vector<float> direct, partitioned;
+    // DIRECT mode convolves at most its first 8192 taps
+    IR directIR(irData, sampleRate, IR::ConvolutionMode::DIRECT);
+    IR partitionedIR(irData, sampleRate, IR::ConvolutionMode::PARTITIONED);
+    const double directSpeed = Run(directIR, blockSize, sampleRate, direct);
+    const double partitionedSpeed = Run(partitionedIR, blockSize, sampleRate, partitioned);
+    std::cout << "block " << std::setw(3) << blockSize << ": direct " << std::fixed << std::setprecision(1)
+              << std::setw(7) << directSpeed << "x, partitioned " << std::setw(7) << partitionedSpeed << "x"
+              << std::scientific << std::setprecision(2) << " (max difference " << MaxDifference(direct, partitioned)
+              << ")" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,214 @@
+//
+//  KernelBenchmark.cpp
+//
+// Development tool: times each WaveNet layer kernel (see
+// dsp::wavenet::kernels) for every instruction set this CPU supports, on the
+// shapes of the factory models, and checks the results against the scalar
+// kernels. The convolution is also run with 8-bit weights, checked against
+// the scalar kernel on the floats they stand for.
+//
+// Usage: KernelBenchmark [<block size>]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../dsp/WaveNetKernels.h"
+
+namespace
+{
+using namespace dsp::wavenet::kernels;
+
+constexpr int kKernelSize = 3;
+constexpr int kRepeats = 20000;
+
+struct Data
+{
+  Data(const long channels, const long columns)
+  : mChannels(channels)
+  {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    auto fill = [&](std::vector<float>& v, const size_t size, const float scale) {
+      v.resize(size);
+      for (float& x : v)
+        x = scale * uniform(rng);
+    };
+    fill(mWeights, (kKernelSize + 2) * channels * channels, 0.3f);
+    fill(mBias, channels, 0.1f);
+    fill(mInput, channels * columns, 1.0f);
+    fill(mCondition, columns, 1.0f);
+    mOutput.resize(channels * columns);
+    Quantize();
+  };
+
+  // The convolution and mixin weights at 8 bits, with a scale per row of
+  // each matrix, and the floats they stand for
+  void Quantize()
+  {
+    const size_t size = (kKernelSize + 1) * mChannels * mChannels;
+    mQuantized.resize(size);
+    mDequantized.resize(size);
+    mScales.resize((kKernelSize + 1) * mChannels);
+    for (long m = 0; m <= kKernelSize; m++)
+    {
+      const long depth = m < kKernelSize ? mChannels : 1;
+      const long offset = m * mChannels * mChannels;
+      for (long i = 0; i < mChannels; i++)
+      {
+        float maxAbs = 0.0f;
+        for (long d = 0; d < depth; d++)
+          maxAbs = std::max(maxAbs, std::fabs(mWeights[offset + d * mChannels + i]));
+        const float scale = maxAbs > 0.0f ? maxAbs / 127.0f : 1.0f;
+        mScales[m * mChannels + i] = scale;
+        for (long d = 0; d < depth; d++)
+        {
+          const long index = offset + d * mChannels + i;
+          mQuantized[index] = (int8_t)std::lround(mWeights[index] / scale);
+          mDequantized[index] = scale * (float)mQuantized[index];
+        }
+      }
+    }
+  };
+
+  // Dilated convolution (with the taps all on the same input here) and
+  // input mixin
+  std::vector<Term> ConvTerms() const
+  {
+    std::vector<Term> terms;
+    for (long k = 0; k < kKernelSize; k++)
+      terms.push_back({mWeights.data() + k * mChannels * mChannels, mChannels, mInput.data(), mChannels});
+    terms.push_back({mWeights.data() + kKernelSize * mChannels * mChannels, 1, mCondition.data(), 1});
+    return terms;
+  };
+  std::vector<Term> QuantizedConvTerms() const
+  {
+    std::vector<Term> terms = ConvTerms();
+    for (long m = 0; m <= kKernelSize; m++)
+    {
+      terms[m].mWeights = nullptr;
+      terms[m].mQuantized = mQuantized.data() + m * mChannels * mChannels;
+      terms[m].mScales = mScales.data() + m * mChannels;
+    }
+    return terms;
+  };
+  std::vector<Term> DequantizedConvTerms() const
+  {
+    std::vector<Term> terms = ConvTerms();
+    for (long m = 0; m <= kKernelSize; m++)
+      terms[m].mWeights = mDequantized.data() + m * mChannels * mChannels;
+    return terms;
+  };
+  Term MixerTerm() const
+  {
+    return {mWeights.data() + (kKernelSize + 1) * mChannels * mChannels, mChannels, mInput.data(), mChannels};
+  };
+
+  const long mChannels;
+  std::vector<float> mWeights;
+  std::vector<float> mBias;
+  std::vector<float> mInput;
+  std::vector<float> mCondition;
+  std::vector<float> mOutput;
+  std::vector<int8_t> mQuantized;
+  std::vector<float> mScales;
+  std::vector<float> mDequantized;
+};
+
+template <typename Function>
+double Time(Function f)
+{
+  f();
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRepeats; i++)
+    f();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / kRepeats;
+}
+
+double MaxDifference(const std::vector<float>& a, const std::vector<float>& b)
+{
+  double result = 0.0;
+  for (size_t i = 0; i < a.size(); i++)
+    result = std::max(result, (double)std::fabs(a[i] - b[i]));
+  return result;
+}
+}; // namespace
+
+int main(int argc, char* argv[])
+{
+  const long blockSize = argc > 1 ? std::atol(argv[1]) : 64;
+  if (blockSize <= 0)
+  {
+    std::cerr << "Usage: " << argv[0] << " [<block size>]" << std::endl;
+    return 1;
+  }
+  std::cout << "Best instruction set: " << GetName(GetInstructionSet()) << ", block size " << blockSize << std::endl;
+
+  std::vector<InstructionSet> instructionSets{InstructionSet::SCALAR};
+  if (GetInstructionSet() >= InstructionSet::SSE41)
+    instructionSets.push_back(InstructionSet::SSE41);
+  if (GetInstructionSet() >= InstructionSet::AVX2)
+    instructionSets.push_back(InstructionSet::AVX2);
+
+  for (const long channels : {16L, 8L})
+  {
+    Data data(channels, blockSize);
+    std::vector<float> referenceConv, referenceMixer, referenceTanh, referenceFastTanh;
+    const std::vector<Term> dequantizedTerms = data.DequantizedConvTerms();
+    GetKernels(InstructionSet::SCALAR)
+      .mLinear(dequantizedTerms.data(), (int)dequantizedTerms.size(), data.mBias.data(), nullptr, channels, blockSize,
+               data.mOutput.data(), channels);
+    const std::vector<float> referenceInt8Conv = data.mOutput;
+    for (const InstructionSet instructionSet : instructionSets)
+    {
+      const Kernels& kernels = GetKernels(instructionSet);
+      const std::vector<Term> terms = data.ConvTerms();
+      const Term mixerTerm = data.MixerTerm();
+      const double convTime = Time([&] {
+        kernels.mLinear(terms.data(), (int)terms.size(), data.mBias.data(), nullptr, channels, blockSize,
+                        data.mOutput.data(), channels);
+      });
+      const std::vector<float> convResult = data.mOutput;
+      const std::vector<Term> quantizedTerms = data.QuantizedConvTerms();
+      const double int8ConvTime = Time([&] {
+        kernels.mLinear(quantizedTerms.data(), (int)quantizedTerms.size(), data.mBias.data(), nullptr, channels,
+                        blockSize, data.mOutput.data(), channels);
+      });
+      const std::vector<float> int8ConvResult = data.mOutput;
+      const double mixerTime = Time([&] {
+        kernels.mLinear(&mixerTerm, 1, data.mBias.data(), data.mInput.data(), channels, blockSize,
+                        data.mOutput.data(), channels);
+      });
+      const std::vector<float> mixerResult = data.mOutput;
+      std::vector<float> tanhResult = convResult;
+      kernels.mTanh(tanhResult.data(), channels, blockSize, channels);
+      std::vector<float> fastTanhResult = convResult;
+      kernels.mFastTanh(fastTanhResult.data(), channels, blockSize, channels);
+      std::vector<float> scratch = convResult;
+      const double tanhTime = Time([&] { kernels.mTanh(scratch.data(), channels, blockSize, channels); });
+      const double fastTanhTime = Time([&] { kernels.mFastTanh(scratch.data(), channels, blockSize, channels); });
+      if (instructionSet == InstructionSet::SCALAR)
+      {
+        referenceConv = convResult;
+        referenceMixer = mixerResult;
+        referenceTanh = tanhResult;
+        referenceFastTanh = fastTanhResult;
+      }
+
+      std::cout << std::setw(3) << channels << " channels, " << std::setw(8) << GetName(instructionSet)
+                << std::fixed << std::setprecision(3) << ": conv " << convTime << " us, int8 conv " << int8ConvTime
+                << " us, mixer " << mixerTime << " us, tanh " << tanhTime << " us, fast tanh " << fastTanhTime << " us"
+                << std::scientific << std::setprecision(2)
+                << " (max difference " << MaxDifference(convResult, referenceConv) << ", "
+                << MaxDifference(int8ConvResult, referenceInt8Conv) << ", " << MaxDifference(mixerResult, referenceMixer)
+                << ", " << MaxDifference(tanhResult, referenceTanh) << ", "
+                << MaxDifference(fastTanhResult, referenceFastTanh) << ")" << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,53 @@
+//
+//  NamToBinary.cpp
+//
+// Build-time tool: converts a .nam model (JSON) into the binary format read by
+// dsp::modelbinary, so the plugin doesn't have to parse JSON at run time.
+//
+// Usage: NamToBinary <input.nam> <output.bin>
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../dsp/ModelBinary.h"
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3)
+  {
+    std::cerr << "Usage: " << argv[0] << " <input.nam> <output.bin>" << std::endl;
+    return 1;
+  }
+
+  try
+  {
+    std::ifstream input(argv[1]);
+    if (!input)
+      throw std::runtime_error("Can't open input file");
+    nlohmann::json json;
+    input >> json;
+
+    dsp::modelbinary::Model model;
+    model.mVersion = json.at("version").get<std::string>();
+    model.mArchitecture = json.at("architecture").get<std::string>();
+    model.mConfig = json.at("config");
+    model.mWeights = json.at("weights").get<std::vector<float>>();
+    if (json.contains("sample_rate") && json["sample_rate"].is_number())
+      model.mSampleRate = json["sample_rate"].get<double>();
+
+    const std::vector<uint8_t> blob = dsp::modelbinary::Write(model);
+    std::ofstream output(argv[2], std::ios::binary);
+    output.write(reinterpret_cast<const char*>(blob.data()), (std::streamsize)blob.size());
+    if (!output)
+      throw std::runtime_error("Can't write output file");
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << argv[1] << ": " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
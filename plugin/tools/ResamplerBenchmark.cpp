@@ -0,0 +1,113 @@
+//
+//  ResamplerBenchmark.cpp
+//
+// Development tool: resampling speed, in samples per second, of the Lanczos
+// resampler for every instruction set this CPU supports (see
+// dsp::lanczos), in float and double, checked against the scalar version;
+// and of the polyphase resampler that's used instead for whole ratios.
+//
+// Usage: ResamplerBenchmark [<input rate> [<output rate>]]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "../dsp/ResamplingContainer/Dependencies/LanczosResampler.h"
+#include "../dsp/ResamplingContainer/PolyphaseResampler.h"
+
+namespace
+{
+using dsp::InstructionSet;
+
+constexpr int kBlockSize = 512;
+constexpr int kNumBlocks = 2000;
+
+// Pushes a sine through the resampler in blocks; returns the output samples
+// per second, and the output in output
+template <typename Resampler, typename T>
+double Run(Resampler& resampler, std::vector<T>& output)
+{
+  std::vector<T> input(kBlockSize);
+  std::vector<T> block(4 * kBlockSize);
+  output.clear();
+  size_t numOutputs = 0;
+  double seconds = 0.0;
+  for (int b = 0; b < kNumBlocks; b++)
+  {
+    for (int i = 0; i < kBlockSize; i++)
+      input[i] = (T)(0.5 * std::sin(0.05 * (b * kBlockSize + i)));
+    T* inputPointer = input.data();
+    T* blockPointer = block.data();
+    const auto start = std::chrono::steady_clock::now();
+    resampler.PushBlock(&inputPointer, kBlockSize);
+    const size_t populated = resampler.PopBlock(&blockPointer, block.size());
+    resampler.RenormalizePhases();
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    numOutputs += populated;
+    output.insert(output.end(), block.begin(), block.begin() + populated);
+  }
+  return numOutputs / seconds;
+}
+
+template <typename T>
+double MaxDifference(const std::vector<T>& a, const std::vector<T>& b)
+{
+  double result = 0.0;
+  for (size_t i = 0; i < std::min(a.size(), b.size()); i++)
+    result = std::max(result, (double)std::fabs(a[i] - b[i]));
+  return result;
+}
+
+template <typename T>
+void Benchmark(const char* typeName, const double inputRate, const double outputRate,
+               const std::vector<InstructionSet>& instructionSets)
+{
+  std::vector<T> reference, output;
+  for (const InstructionSet instructionSet : instructionSets)
+  {
+    auto resampler = std::make_unique<dsp::LanczosResampler<T, 1, 12>>(inputRate, outputRate, instructionSet);
+    const double samplesPerSecond = Run(*resampler, output);
+    if (instructionSet == InstructionSet::SCALAR)
+      reference = output;
+    std::cout << std::setw(6) << typeName << " Lanczos   " << std::setw(8) << dsp::GetName(instructionSet)
+              << ": " << std::fixed << std::setprecision(1) << samplesPerSecond / 1.0e6 << " M samples/s"
+              << std::scientific << std::setprecision(2) << " (max difference " << MaxDifference(output, reference)
+              << ")" << std::endl;
+  }
+  if (dsp::PolyphaseResampler<T, 1, 24>::Supports(inputRate, outputRate))
+  {
+    auto resampler = std::make_unique<dsp::PolyphaseResampler<T, 1, 24>>(inputRate, outputRate);
+    const double samplesPerSecond = Run(*resampler, output);
+    std::cout << std::setw(6) << typeName << " polyphase" << std::setw(10) << ""
+              << ": " << std::fixed << std::setprecision(1) << samplesPerSecond / 1.0e6 << " M samples/s" << std::endl;
+  }
+}
+}; // namespace
+
+int main(int argc, char* argv[])
+{
+  const double inputRate = argc > 1 ? std::atof(argv[1]) : 44100.0;
+  const double outputRate = argc > 2 ? std::atof(argv[2]) : 48000.0;
+  if (inputRate <= 0.0 || outputRate <= 0.0)
+  {
+    std::cerr << "Usage: " << argv[0] << " [<input rate> [<output rate>]]" << std::endl;
+    return 1;
+  }
+  std::cout << "Best instruction set: " << dsp::GetName(dsp::GetInstructionSet()) << ", " << inputRate << " to "
+            << outputRate << std::endl;
+
+  std::vector<InstructionSet> instructionSets{InstructionSet::SCALAR};
+  if (dsp::GetInstructionSet() >= InstructionSet::SSE41)
+    instructionSets.push_back(InstructionSet::SSE41);
+  if (dsp::GetInstructionSet() >= InstructionSet::AVX2)
+    instructionSets.push_back(InstructionSet::AVX2);
+
+  Benchmark<float>("float", inputRate, outputRate, instructionSets);
+  Benchmark<double>("double", inputRate, outputRate, instructionSets);
+  return 0;
+}
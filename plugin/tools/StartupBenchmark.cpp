@@ -0,0 +1,70 @@
+//
+//  StartupBenchmark.cpp
+//
+// Development tool: wall time of a cold plugin instance against the number
+// of threads in the setup pool (see Utility::TaskGroup), from 1 to the
+// number the plugin would use on this machine. Each count is measured in a
+// fresh process, so that the process-wide model and IR stores start empty.
+// "Constructor" is the time to construct the processor; "ready" adds the
+// first prepareToPlay(), which waits for the setup jobs.
+//
+// Usage: StartupBenchmark [<threads>]
+// (with <threads>, measures that one count and prints a single row)
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+#include <juce_audio_processors/juce_audio_processors.h>
+
+#include "Utility/TaskGroup.h"
+
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter();
+
+namespace
+{
+constexpr double kSampleRate = 48000.0;
+constexpr int kBlockSize = 512;
+
+int Measure(const int numThreads)
+{
+  Utility::TaskGroup::setMaxThreads(numThreads);
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  std::unique_ptr<juce::AudioProcessor> processor(createPluginFilter());
+  const auto constructed = Clock::now();
+  processor->prepareToPlay(kSampleRate, kBlockSize);
+  const auto ready = Clock::now();
+  auto milliseconds = [start](const Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  };
+  std::cout << std::setw(7) << numThreads << std::fixed << std::setprecision(1) << std::setw(15)
+            << milliseconds(constructed) << std::setw(11) << milliseconds(ready) << std::endl;
+  return 0;
+}
+}; // namespace
+
+int main(int argc, char* argv[])
+{
+  juce::ScopedJuceInitialiser_GUI juce;
+  if (argc > 1)
+    return Measure(std::atoi(argv[1]));
+
+  std::cout << "threads  constructor ms   ready ms" << std::endl;
+  const juce::String executable =
+    juce::File::getSpecialLocation(juce::File::currentExecutableFile).getFullPathName();
+  for (int numThreads = 1; numThreads <= Utility::TaskGroup::getNumThreads(); numThreads++)
+  {
+    // The plugin logs to stderr; only its row is wanted
+    juce::ChildProcess child;
+    if (!child.start(juce::StringArray{executable, juce::String(numThreads)}, juce::ChildProcess::wantStdOut))
+    {
+      std::cerr << "Can't run " << executable << std::endl;
+      return 1;
+    }
+    std::cout << child.readAllProcessOutput() << std::flush;
+  }
+  return 0;
+}